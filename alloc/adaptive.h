@@ -0,0 +1,66 @@
+/**
+ * @file
+ * @brief Controller switching the allocation strategy at runtime
+ */
+#ifndef ALLOC_ADAPTIVE_H
+#define ALLOC_ADAPTIVE_H
+
+#include "alloc/types.h"
+#include <stddef.h>
+
+//! Number of allocations from the segment list between two decisions
+#define ADAPTIVE_WINDOW 1024
+
+//! Share of the storage table in percent held by gaps other than the trailing
+//! one, from which on the gaps are searched more carefully than with next-fit
+#define ADAPTIVE_HOLES_LOW 10
+
+//! Share of the storage table in percent held by gaps other than the trailing
+//! one, from which on best-fit is used
+#define ADAPTIVE_HOLES_HIGH 25
+
+//! Average number of gaps looked at per allocation from which on next-fit is
+//! considered too slow
+#define ADAPTIVE_STEPS_HIGH 32
+
+/**
+ * @brief Start the controller
+ *
+ * This function resets all measurements and begins with next-fit. It is
+ * called by set_alloc_function() for ADAPTIVE.
+ */
+void adaptive_start();
+
+/**
+ * @brief Count an allocation from the segment list
+ *
+ * Called by find_free_seg() while ADAPTIVE is set. Every ADAPTIVE_WINDOW
+ * allocations, the measurements of the window are evaluated, and the
+ * strategy is switched if the same other strategy was chosen twice in a row.
+ *
+ * @param[in] list A pointer to the storage list
+ */
+void adaptive_alloc(seg_list_head_s *list);
+
+/**
+ * @brief Count a free of a chunk of the segment list
+ *
+ * Called by remove_segment() while ADAPTIVE is set.
+ */
+void adaptive_free();
+
+/**
+ * @brief Get the strategy the controller currently uses
+ *
+ * @return One of NEXT_FIT, GOOD_FIT and BEST_FIT
+ */
+sched_strat_e adaptive_strat();
+
+/**
+ * @brief Get the number of strategy switches since adaptive_start()
+ *
+ * @return Number of switches
+ */
+size_t adaptive_switches();
+
+#endif
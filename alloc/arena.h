@@ -0,0 +1,362 @@
+/**
+ * @file
+ * @brief Independent storage tables with a lock each
+ *
+ * An arena is a storage table together with all state needed to allocate from
+ * it: its lock, the next-fit pointer and the index of its gaps. Each arena
+ * reserves a range of address space, which is made accessible page by page as
+ * its table grows. The program break is never used, so other code moving it
+ * does not disturb the tables. The main arena is the only one by default.
+ * Further arenas are reserved with set_arena_count(), and threads are spread
+ * over all arenas round-robin, so that threads of different arenas never wait
+ * for each other.
+ *
+ * Once the range of an arena is exhausted, another arena is reserved as its
+ * extent, and its threads continue in the extent. Chunks of the exhausted
+ * arena stay where they are until freed.
+ *
+ * The functions operating on a storage table (see memory_mgmt.h) work on the
+ * arena bound to the calling thread, which is the main arena unless another
+ * one has been locked with arena_lock().
+ */
+#ifndef ALLOC_ARENA_H
+#define ALLOC_ARENA_H
+
+#include "alloc/gap_array.h"
+#include "alloc/heap_lock.h"
+#include "alloc/hugepage.h"
+#include "alloc/types.h"
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Largest number of arenas
+#define MAX_ARENAS 64
+
+//! Address space reserved for each arena. Pages are only made accessible once
+//! the table grows into them
+#define ARENA_RESERVE ((size_t)1 << 30)
+
+//! Number of next-fit pointers of each arena. Threads sharing an arena use
+//! different pointers, so they allocate into different regions of the table
+#define ARENA_CURSORS 8
+
+//! Memory each arena keeps beyond the end of its table, so that the table can
+//! grow without a system call. Once twice as much is left after shrinking, the
+//! rest is given back after the decay time, see set_decay_time(). With huge
+//! pages enabled, the memory kept reaches up to the next huge page boundary
+#define ARENA_GROW_AHEAD ((size_t)64 * 1024)
+
+//! Default time in milliseconds memory beyond ARENA_GROW_AHEAD is retained
+#define ARENA_DEFAULT_DECAY_MS 1000
+
+//! Runs of purged pages each arena queues to be advised once it is unlocked
+#define PURGE_QUEUE 16
+
+// A run of pages purged under the lock of an arena, see purge.h
+typedef struct purge_run_s {
+    uint8_t *addr; /**< First page of the run */
+    size_t size;   /**< Size of the run in bytes, 0 if none */
+} purge_run_s;
+
+// A next-fit pointer, alone in its cache line since it is written on every
+// allocation of its thread
+typedef struct arena_cursor_s {
+    seg_tail_s *addr; /**< Next-fit pointer, see strats.h */
+} __attribute__((aligned(64))) arena_cursor_s;
+
+typedef struct arena_s {
+    heap_lock_s lock;             /**< Held while working on the arena */
+    heap_lock_s grow_lock;        /**< Held while moving the break */
+    seg_list_head_s *list;        /**< Storage table, nullptr until used */
+    size_t chunks;                /**< Number of chunks in the table */
+    arena_cursor_s cursors[ARENA_CURSORS]; /**< Next-fit pointers */
+    const gap_index_s *gap_index; /**< Gap index in use, see gap_mgmt.h */
+    size_t gap_bytes;             /**< Sum of the sizes of indexed gaps */
+    gap_array_s gaps;             /**< Gaps for next-fit and good-fit */
+    uint8_t *base;                /**< Reserved range, nullptr until the
+                                     table is created */
+    uint8_t *brk;                 /**< Break of the table within the range */
+    uint8_t *limit;               /**< End of the reserved range */
+    _Atomic(uint8_t *) remote;    /**< Chunks freed while the arena was
+                                     locked, see arena_push_remote() */
+    _Atomic(uint8_t *) committed; /**< End of the memory the table may use */
+    _Atomic(uint8_t *) target;    /**< Break wanted by arena_maintain() */
+    atomic_bool pending;          /**< Break to be moved to the target */
+    _Atomic(struct arena_s *) extent; /**< Arena continuing this one once
+                                         its range is exhausted */
+    uint64_t idle_since;          /**< Time in nanoseconds since when more
+                                     memory than needed is retained, 0 if not.
+                                     Only used under the lock */
+    uint64_t *purged;             /**< One bit per page of the range, set if
+                                     purged, see purge.h. nullptr until the
+                                     first purge */
+    size_t purged_bytes;          /**< Bytes marked in purged */
+    heap_lock_s purge_lock;       /**< Held while using the runs below */
+    heap_lock_s advise_lock;      /**< Held while advising queued runs */
+    purge_run_s queued[PURGE_QUEUE]; /**< Runs marked but not advised */
+    atomic_size_t queued_runs;    /**< Number of runs in queued */
+    purge_run_s advising;         /**< Run being advised right now */
+} arena_s;
+
+//! The arena the calling thread works on, the main arena if none is locked
+extern thread_local arena_s *g_arena
+    __attribute__((tls_model("initial-exec")));
+
+/**
+ * @brief Set the number of arenas threads are spread over
+ *
+ * Arenas are reserved on the first call with a larger count than before and
+ * are kept afterwards. Only threads allocating for the first time are assigned
+ * to an arena, threads keep their arena once assigned. All arenas other than
+ * the main one place chunks with next-fit, the strategy set with
+ * set_alloc_function() applies to the main arena only.
+ *
+ * @param[in] count Number of arenas, clamped to [1, MAX_ARENAS]. 1 by default
+ */
+void set_arena_count(size_t count);
+
+/**
+ * @brief Get the number of arenas threads are spread over
+ *
+ * @return Number of arenas set with set_arena_count()
+ */
+size_t get_arena_count();
+
+/**
+ * @brief Set how long freed memory at the end of the tables is retained
+ *
+ * When a table shrinks, the memory it shrank by stays accessible for at least
+ * this long, so that the table can grow into it again without a system call
+ * and without faulting its pages in again. Only if the table has not grown
+ * back within the decay time, all but ARENA_GROW_AHEAD bytes are given back.
+ * The decay is checked whenever an arena is unlocked.
+ *
+ * @param[in] ms Decay time in milliseconds, 0 to give memory back right away.
+ * ARENA_DEFAULT_DECAY_MS by default
+ */
+void set_decay_time(size_t ms);
+
+/**
+ * @brief Get how long freed memory at the end of the tables is retained
+ *
+ * @return Decay time in milliseconds set with set_decay_time()
+ */
+size_t get_decay_time();
+
+/**
+ * @brief Enable or disable transparent huge pages for the storage tables
+ *
+ * While enabled, the ranges of all arenas are advised with MADV_HUGEPAGE, the
+ * memory kept ahead of the end of each table reaches up to the next
+ * HUGE_PAGE_SIZE boundary, interior gaps are purged in whole huge pages only,
+ * and arenas placing chunks with next-fit use first-fit instead, see
+ * hugepage.h. The ranges are aligned to HUGE_PAGE_SIZE either way.
+ *
+ * @param[in] enabled true to enable, false to disable (the default)
+ */
+void set_hugepage_enabled(bool enabled);
+
+/**
+ * @brief Check whether transparent huge pages are enabled
+ *
+ * @return true if enabled, false otherwise
+ */
+bool get_hugepage_enabled();
+
+/**
+ * @brief Get the huge page coverage of all arenas
+ *
+ * Reads /proc/self/smaps, so this is meant for statistics only.
+ *
+ * @param[out] stats Memory accessible in the ranges of all arenas, and how
+ * much of it is backed by huge pages
+ */
+void get_hugepage_stats(hugepage_stats_s *stats);
+
+/**
+ * @brief Get the main arena
+ *
+ * The main arena is the one used by default. Slabs, buddy pools and the
+ * strategy set with set_alloc_function() belong to it.
+ *
+ * @return Pointer to the main arena
+ */
+arena_s *arena_main();
+
+/**
+ * @brief Get the arena of the calling thread
+ *
+ * The first call of a thread assigns it to the next arena round-robin.
+ *
+ * @return Arena new chunks of the calling thread are placed in
+ */
+arena_s *arena_home();
+
+/**
+ * @brief Get the arena continuing an exhausted arena
+ *
+ * Reserves the extent on the first call for @p arena. If @p arena is the home
+ * of the calling thread, the extent becomes its home instead.
+ *
+ * @param[in] arena Arena whose table cannot grow anymore, not locked by the
+ * calling thread
+ *
+ * @return The extent of @p arena, nullptr if no more arenas can be reserved
+ */
+arena_s *arena_extend(arena_s *arena);
+
+/**
+ * @brief Get the arena an address belongs to
+ *
+ * @param[in] addr Any address returned by malloc()
+ *
+ * @return The arena whose reserved range contains @p addr, the main arena
+ * otherwise
+ */
+arena_s *arena_of(const uint8_t *addr);
+
+/**
+ * @brief Find the arena whose reserved range contains an address
+ *
+ * Unlike arena_of(), the range of the main arena is checked as well.
+ *
+ * @param[in] addr Any address
+ *
+ * @return The arena whose reserved range contains @p addr, nullptr if there is
+ * none
+ */
+arena_s *arena_find(const uint8_t *addr);
+
+/**
+ * @brief Lock an arena and bind it to the calling thread
+ *
+ * Until arena_unlock() is called, all functions operating on a storage table
+ * work on @p arena.
+ *
+ * @param[in] arena Arena to lock
+ */
+void arena_lock(arena_s *arena);
+
+/**
+ * @brief Lock an arena and bind it to the calling thread, unless it is locked
+ *
+ * @param[in] arena Arena to lock
+ *
+ * @return true if the arena is locked and bound now, false if it was locked
+ * already
+ */
+bool arena_trylock(arena_s *arena);
+
+/**
+ * @brief Unbind an arena from the calling thread and unlock it
+ *
+ * If the memory retained by the arena has decayed, it is released first, see
+ * set_decay_time(). Pages purged while the arena was locked are advised to the
+ * kernel after unlocking, see purge_flush().
+ *
+ * @param[in] arena Arena locked with arena_lock() before
+ */
+void arena_unlock(arena_s *arena);
+
+/**
+ * @brief Get the counters of the locks of all arenas
+ *
+ * @param[out] stats Sum of the counters of all arenas, see heap_lock.h
+ */
+void get_lock_stats(heap_lock_stats_s *stats);
+
+/**
+ * @brief Hand a freed pointer to the thread holding the lock of an arena
+ *
+ * The pointer is pushed onto the lock-free queue of the arena, which several
+ * threads may push onto at once. Its memory holds the link to the next pointer
+ * of the queue. The pointer stays allocated until the queue is taken with
+ * arena_take_remote() by the next thread locking the arena.
+ *
+ * @param[in] arena Arena @p addr belongs to
+ * @param[in] addr Address returned by malloc(), at least pointer-sized
+ */
+void arena_push_remote(arena_s *arena, uint8_t *addr);
+
+/**
+ * @brief Take all pointers queued for an arena with arena_push_remote()
+ *
+ * @param[in] arena Arena to take the queue of
+ *
+ * @return The most recently pushed pointer, each holds the next one in its
+ * first bytes, the last one holds nullptr. nullptr if the queue is empty
+ */
+uint8_t *arena_take_remote(arena_s *arena);
+
+/**
+ * @brief Make memory at the end of the table of the bound arena usable
+ *
+ * Memory reserved ahead by arena_maintain() is handed out without a system
+ * call. Only if that does not suffice, the break is moved right away. If the
+ * memory left ahead runs low, arena_maintain() reserves more.
+ *
+ * @param[in] end Current end of the table
+ * @param[in] size Number of bytes the table grows by
+ *
+ * @return SUCCESS, or ERROR if the break could not be moved
+ */
+int arena_commit(uint8_t *end, size_t size);
+
+/**
+ * @brief Tell the bound arena its table shrank
+ *
+ * The memory above @p end stays accessible. If more than twice
+ * ARENA_GROW_AHEAD is left, all but ARENA_GROW_AHEAD is given back by a call
+ * of arena_maintain() once the decay time has passed, unless the table grows
+ * back before.
+ *
+ * @param[in] end New end of the table
+ */
+void arena_release(uint8_t *end);
+
+/**
+ * @brief Move the break of an arena as requested by arena_commit() and
+ * arena_release()
+ *
+ * Called after unlocking the arena, so that other threads keep working on the
+ * arena during the system call. Returns right away if nothing is to be done,
+ * or if another thread is moving the break.
+ *
+ * @param[in] arena Arena which is not locked by the calling thread
+ */
+void arena_maintain(arena_s *arena);
+
+/**
+ * @brief Move the break of the bound arena
+ *
+ * Acts like sbrk(), but the break moves within the reserved range of the
+ * arena. Pages above the break are made inaccessible and given back to the
+ * system. Memory reserved ahead is dropped.
+ *
+ * @param[in] increment Number of bytes to move the break by, may be negative
+ *
+ * @return The previous break, (void *)-1 with errno set on failure
+ */
+void *arena_sbrk(intptr_t increment);
+
+/**
+ * @brief Set the break of the bound arena
+ *
+ * Acts like brk(), see arena_sbrk().
+ *
+ * @param[in] addr New break
+ *
+ * @return 0 on success, -1 with errno set on failure
+ */
+int arena_brk(void *addr);
+
+/**
+ * @brief Empty all arenas other than the main one
+ *
+ * Drops the queued pointers of all arenas. Called when the whole storage is
+ * reset by clear_alloc_storage().
+ */
+void arena_clear();
+
+#endif
@@ -0,0 +1,99 @@
+/**
+ * @file
+ * @brief Binary buddy allocator for power-of-two blocks
+ */
+#ifndef ALLOC_BUDDY_H
+#define ALLOC_BUDDY_H
+
+#include "alloc/types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//! Log2 of the smallest block, which needs to hold the free list node
+#define BUDDY_MIN_ORDER 4
+
+//! Log2 of the largest block handed out. Larger requests are served by the
+//! segment list
+#define BUDDY_MAX_ORDER 16
+
+//! Log2 of the size of a pool. Each pool is a single chunk of the segment list
+#define BUDDY_POOL_ORDER 20
+
+//! Number of block sizes within a pool, from the whole pool down to the
+//! smallest block
+#define BUDDY_LEVELS (BUDDY_POOL_ORDER - BUDDY_MIN_ORDER + 1)
+
+//! Number of nodes of the implicit binary tree of blocks of a pool
+#define BUDDY_NODES ((1UL << BUDDY_LEVELS) - 1)
+
+//! Largest request served by the buddy allocator
+#define BUDDY_MAX_SIZE (1UL << BUDDY_MAX_ORDER)
+
+/**
+ * @brief Allocate a block from the buddy pools
+ *
+ * This function rounds @p size up to the next power of two and splits the
+ * smallest free block of all pools which is large enough. If no pool has a
+ * large enough block, a new pool is allocated from the segment list.
+ *
+ * @param[in] size Requested size, at most BUDDY_MAX_SIZE
+ *
+ * @return Address of the block, nullptr if no pool could be allocated
+ */
+uint8_t *buddy_alloc(size_t size);
+
+/**
+ * @brief Free a block of the buddy pools
+ *
+ * This function merges the block with its buddy as long as the buddy is free,
+ * too. A pool which becomes entirely free is returned to the segment list,
+ * unless it is the only pool.
+ *
+ * @warning @p addr must be owned by a pool, see buddy_owns()
+ *
+ * @param[in] addr Address previously returned by buddy_alloc()
+ */
+void buddy_free(uint8_t *addr);
+
+/**
+ * @brief Check whether an address belongs to a buddy pool
+ *
+ * Takes constant time, since pools are looked up by the slot of the range of
+ * the main arena they start in. Needs no lock if @p addr is allocated.
+ *
+ * @param[in] addr Any address
+ *
+ * @return true if @p addr lies within a pool, false otherwise
+ */
+bool buddy_owns(const uint8_t *addr);
+
+/**
+ * @brief Get the size of an allocated block
+ *
+ * The size is found by following the split bitmap from the whole pool down to
+ * the block.
+ *
+ * @param[in] addr Address previously returned by buddy_alloc()
+ *
+ * @return Usable size of the block, which is a power of two
+ */
+size_t buddy_block_size(uint8_t *addr);
+
+/**
+ * @brief Get the block size a request is rounded up to
+ *
+ * @param[in] size Requested size, at most BUDDY_MAX_SIZE
+ *
+ * @return Size of the block buddy_alloc() would hand out for @p size
+ */
+size_t buddy_round_size(size_t size);
+
+/**
+ * @brief Forget about all pools
+ *
+ * This function is called when the whole storage table is reset, which frees
+ * the pools along with it.
+ */
+void buddy_clear();
+
+#endif
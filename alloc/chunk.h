@@ -0,0 +1,144 @@
+/**
+ * @file
+ * @brief Accessors for the fields of segment heads and tails
+ *
+ * All code reads and writes segment heads and tails through these functions,
+ * so that the layout of a chunk can be changed at compile time. By default,
+ * heads and tails store full pointers to their neighbours. With COMPACT_CHUNKS
+ * defined, they store 32-bit sizes and offsets only, and the remaining links
+ * are derived from the position of the chunk.
+ */
+#ifndef ALLOC_CHUNK_H
+#define ALLOC_CHUNK_H
+
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+#ifndef COMPACT_CHUNKS
+
+//! Tail of the segment of @p head
+static inline seg_tail_s *head_next_tail(const seg_head_s *head) {
+    return head->next_seg_tail;
+}
+
+//! Tail of the previous segment, the last tail for the first segment
+static inline seg_tail_s *head_prev_tail(const seg_head_s *head) {
+    return head->prev_seg_tail;
+}
+
+//! Usable size of the segment of @p head
+static inline size_t head_size(const seg_head_s *head) {
+    return head->seg_size;
+}
+
+//! Head of the next segment, the first head for the last tail
+static inline seg_head_s *tail_next_head(const seg_tail_s *tail) {
+    return tail->next_seg_head;
+}
+
+//! Head of the segment of @p tail
+static inline seg_head_s *tail_prev_head(const seg_tail_s *tail) {
+    return tail->prev_seg_head;
+}
+
+//! Number of free bytes after @p tail
+static inline size_t tail_free(const seg_tail_s *tail) {
+    return tail->free_following;
+}
+
+static inline void set_head_next_tail(seg_head_s *head, seg_tail_s *tail) {
+    head->next_seg_tail = tail;
+}
+
+static inline void set_head_prev_tail(seg_head_s *head, seg_tail_s *tail) {
+    head->prev_seg_tail = tail;
+}
+
+static inline void set_head_size(seg_head_s *head, size_t size) {
+    head->seg_size = size;
+}
+
+static inline void set_tail_next_head(seg_tail_s *tail, seg_head_s *head) {
+    tail->next_seg_head = head;
+}
+
+static inline void set_tail_prev_head(seg_tail_s *tail, seg_head_s *head) {
+    tail->prev_seg_head = head;
+}
+
+static inline void set_tail_free(seg_tail_s *tail, size_t free_following) {
+    tail->free_following = free_following;
+}
+
+#else
+
+// The tail of a segment directly follows the rounded up user space, so it is
+// derived from the size stored in the head
+static inline seg_tail_s *head_next_tail(const seg_head_s *head) {
+    size_t user_size = (head->seg_size + ALIGNMENT - 1) & ~(ALIGNMENT - 1);
+
+    return (seg_tail_s *)((uint8_t *)head + sizeof(*head) + user_size);
+}
+
+static inline seg_tail_s *head_prev_tail(const seg_head_s *head) {
+    return (seg_tail_s *)((uint8_t *)g_arena->list + head->prev_seg_tail);
+}
+
+static inline size_t head_size(const seg_head_s *head) {
+    return head->seg_size;
+}
+
+// The next head directly follows the gap after a tail. The gap after the last
+// tail reaches up to the end of the storage table, in which case the list wraps
+// around to the first head
+static inline seg_head_s *tail_next_head(const seg_tail_s *tail) {
+    seg_list_head_s *list = g_arena->list;
+    uint8_t *next = (uint8_t *)tail + sizeof(*tail) + tail->free_following;
+
+    return next == list->end_addr ? list->first_seg : (seg_head_s *)next;
+}
+
+static inline seg_head_s *tail_prev_head(const seg_tail_s *tail) {
+    return (seg_head_s *)((uint8_t *)tail - tail->head_dist);
+}
+
+static inline size_t tail_free(const seg_tail_s *tail) {
+    return tail->free_following;
+}
+
+// Derived from the segment size, see head_next_tail()
+static inline void set_head_next_tail(seg_head_s *head, seg_tail_s *tail) {
+    (void)head;
+    (void)tail;
+}
+
+static inline void set_head_prev_tail(seg_head_s *head, seg_tail_s *tail) {
+    head->prev_seg_tail = (uint8_t *)tail - (uint8_t *)g_arena->list;
+}
+
+static inline void set_head_size(seg_head_s *head, size_t size) {
+    ASSERT(size <= UINT32_MAX);
+    head->seg_size = size;
+}
+
+// Derived from the number of free bytes, see tail_next_head()
+static inline void set_tail_next_head(seg_tail_s *tail, seg_head_s *head) {
+    (void)tail;
+    (void)head;
+}
+
+static inline void set_tail_prev_head(seg_tail_s *tail, seg_head_s *head) {
+    tail->head_dist = (uint8_t *)tail - (uint8_t *)head;
+}
+
+static inline void set_tail_free(seg_tail_s *tail, size_t free_following) {
+    ASSERT(free_following <= UINT32_MAX);
+    tail->free_following = free_following;
+}
+
+#endif
+
+#endif
@@ -0,0 +1,101 @@
+/**
+ * @file
+ * @brief Per-CPU caches of freed chunks built on restartable sequences
+ *
+ * Like the per-thread caches (see tcache.h), but with one cache per CPU
+ * instead of one per thread, so the memory held by the caches is bounded by
+ * the number of CPUs no matter how many threads there are. A cache is only
+ * touched by the thread running on its CPU, inside a restartable sequence
+ * (rseq) the kernel aborts whenever the thread is preempted, migrated or
+ * interrupted by a signal. This needs neither a lock nor atomic instructions.
+ *
+ * The caches need the rseq area the C library registers for each thread, which
+ * glibc does from version 2.35 on, and the rseq fence of membarrier(), which
+ * Linux has since 5.10. They are implemented for x86-64 only. Where they are
+ * not available, enabling them fails and malloc() and free() keep taking the
+ * lock of an arena.
+ */
+#ifndef ALLOC_CPUCACHE_H
+#define ALLOC_CPUCACHE_H
+
+#include "alloc/defines.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//! Largest chunk size kept in the caches. Larger chunks are always given back
+//! to the segment list
+#define CPUCACHE_MAX_SIZE 1024
+
+//! Number of bins of a cache, one per multiple of ALIGNMENT
+#define CPUCACHE_BINS (CPUCACHE_MAX_SIZE / ALIGNMENT)
+
+//! Number of chunks a bin holds at most
+#define CPUCACHE_BIN_SLOTS 32
+
+//! Number of bytes a bin holds at most. Bins of larger chunks hold fewer of
+//! them, so each cache holds well below CPUCACHE_BINS times this. Once a bin
+//! is full, half of it is given back to the segment list at once
+#define CPUCACHE_BIN_BYTES (2 * 1024)
+
+/**
+ * @brief Enable or disable the per-CPU caches
+ *
+ * While enabled, free() keeps chunks of up to CPUCACHE_MAX_SIZE bytes in the
+ * cache of the CPU it runs on, and malloc() takes chunks from that cache. The
+ * per-thread caches take precedence if both are enabled. Disabling closes the
+ * caches of all CPUs, restarts any cache access in flight with membarrier(),
+ * and then gives back the chunks of all caches from the calling thread,
+ * without moving it to another CPU.
+ *
+ * @param[in] enabled true to enable, false to disable (the default)
+ *
+ * @return SUCCESS, or ERROR if restartable sequences or their fence are not
+ * available, in which case the caches stay disabled
+ */
+int set_cpucache_enabled(bool enabled);
+
+/**
+ * @brief Check whether the per-CPU caches are enabled
+ *
+ * @return true if enabled, false otherwise
+ */
+bool get_cpucache_enabled();
+
+/**
+ * @brief Take a chunk from the cache of the current CPU
+ *
+ * The size of the chunk is set to @p size, which is within the same multiple of
+ * ALIGNMENT as before, so the layout of the segment list does not change.
+ *
+ * @param[in] size Requested size, at most CPUCACHE_MAX_SIZE
+ *
+ * @return User address of a cached chunk, nullptr if the bin is empty
+ */
+uint8_t *cpucache_get(size_t size);
+
+/**
+ * @brief Put a freed chunk into the cache of the current CPU
+ *
+ * If the bin of the chunk is full, half of the bin is given back to the segment
+ * list under the lock of their arena.
+ *
+ * @warning @p addr must be a chunk of the segment list, not a block of the
+ * slabs or buddy pools
+ *
+ * @param[in] addr User address of a chunk of the segment list
+ *
+ * @return true if the chunk is cached, false if it is too large, in which case
+ * the caller frees it as usual
+ */
+bool cpucache_put(uint8_t *addr);
+
+/**
+ * @brief Drop all cached chunks without giving them back
+ *
+ * Called when the storage table is reset, which removes the cached chunks as
+ * well. Like clear_alloc_storage(), this must not run concurrently with any
+ * other allocation.
+ */
+void cpucache_clear();
+
+#endif
@@ -30,6 +30,12 @@
 // this is not problematic.
 #define ALIGNMENT _Alignof(max_align_t)
 
+//! The smallest gap that can hold a chunk at all. Gap indices only keep track
+//! of gaps of at least this size, and may store their bookkeeping inside of
+//! those gaps
+#define MIN_GAP_SIZE                                                           \
+    (sizeof(struct seg_head_s) + ALIGNMENT + sizeof(struct seg_tail_s))
+
 //! Macro for LD_PRELOAD asserts because normal assert somehow don't work
 #ifndef NDEBUG
 #define ASSERT(expr)                                                           \
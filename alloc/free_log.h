@@ -0,0 +1,78 @@
+/**
+ * @file
+ * @brief Per-thread logs of deferred frees
+ *
+ * Instead of freeing each chunk under the lock of its arena right away, free()
+ * can append the pointer to a log of the calling thread. Once the log is full,
+ * all pointers in it are freed together with julmalloc_free_batch(), which
+ * sorts them by address and takes the lock of each arena only once. Freeing in
+ * address order merges each chunk into the gap the previous one left, so a
+ * burst of frees costs one lock round-trip and a single pass over the table.
+ *
+ * Unlike the per-thread caches, the log accepts any pointer, including blocks
+ * of the slabs and buddy pools and chunks of any size.
+ */
+#ifndef ALLOC_FREE_LOG_H
+#define ALLOC_FREE_LOG_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Number of pointers the log of a thread holds before it is flushed
+#define FREE_LOG_SIZE 64
+
+/**
+ * @brief Enable or disable deferred frees
+ *
+ * While enabled, free() appends pointers to a log of the calling thread instead
+ * of freeing them right away. The logged chunks stay allocated until the log
+ * is flushed, which happens once it is full, when the thread exits, and when
+ * deferred frees are disabled again. Disabling flushes the log of the calling
+ * thread, every other thread flushes its log on its next call of malloc() or
+ * free(), see free_log_flush_disabled().
+ *
+ * @param[in] enabled true to enable, false to disable (the default)
+ */
+void set_free_log_enabled(bool enabled);
+
+/**
+ * @brief Check whether deferred frees are enabled
+ *
+ * @return true if enabled, false otherwise
+ */
+bool get_free_log_enabled();
+
+/**
+ * @brief Append a pointer to the log of the calling thread
+ *
+ * If the log is full afterwards, all pointers in it are freed at once.
+ *
+ * @param[in] addr Pointer returned by an allocation function and not freed yet
+ */
+void free_log_put(uint8_t *addr);
+
+/**
+ * @brief Free all pointers in the log of the calling thread
+ */
+void free_log_flush();
+
+/**
+ * @brief Free the pointers left in the log of the calling thread once deferred
+ * frees are disabled
+ *
+ * Only the thread disabling deferred frees flushes its log right away.
+ * malloc() and free() call this function, so that the logs of all other
+ * threads are flushed on their next call, too. Does nothing while deferred
+ * frees are enabled or if the log is empty.
+ */
+void free_log_flush_disabled();
+
+/**
+ * @brief Forget about the pointers of all logs
+ *
+ * Called when the whole storage table is reset, which frees the logged chunks
+ * along with it. The logs of other threads are dropped on their next use.
+ */
+void free_log_clear();
+
+#endif
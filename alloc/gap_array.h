@@ -0,0 +1,86 @@
+/**
+ * @file
+ * @brief Address-ordered blocks of gaps outside of the storage table
+ */
+#ifndef ALLOC_GAP_ARRAY_H
+#define ALLOC_GAP_ARRAY_H
+
+#include "alloc/types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//! Largest number of gaps of a block of the gap array
+#define GAP_BLOCK 256
+
+// Unlike the other gap indices, the gap array is not stored inside of the gaps
+// but in its own mapping, outside of the storage table. The gaps are kept in
+// blocks of up to GAP_BLOCK gaps sorted by address, each with separate arrays
+// of addresses and sizes, so that a search only reads the densely packed sizes
+// and never touches the pages of the storage table. Inserting or removing a gap
+// only moves the gaps of its own block, and a search skips every block whose
+// largest gap is too small. Every arena has an array of its own
+typedef struct gap_array_s {
+    struct gap_block_s *blocks; /**< All blocks of the mapping */
+    uint32_t *order;  /**< Blocks in use, sorted by the address of their gaps */
+    uint32_t *spare;  /**< Blocks not in use */
+    size_t used;      /**< Number of blocks in order */
+    size_t spares;    /**< Number of blocks in spare */
+    size_t count;     /**< Number of gaps in the array */
+    size_t capacity;  /**< Number of blocks the mapping has room for */
+    size_t steps;     /**< Sizes compared by all searches, see
+                         gap_array_steps() */
+} gap_array_s;
+
+//! Gap index hooks of the gap array
+extern const gap_index_s gap_array_index;
+
+/**
+ * @brief Search the gap array for the first fitting gap within a range
+ *
+ * This function scans the sizes stored in the array with SIMD compares, so that
+ * neither tails nor gaps within the storage table are read while searching.
+ * Blocks without a fitting gap are skipped after a single compare.
+ * Only tails at addresses in [@p from, @p to) are considered.
+ *
+ * @param[in] from Lowest tail address to consider, nullptr for the first gap
+ * @param[in] to Tail address to stop at, nullptr to search up to the last gap
+ * @param[in] total_size Size of the chunk including header and tail
+ *
+ * @return Tail in front of the gap with the lowest address of at least
+ * @p total_size bytes within the range, nullptr if no gap is large enough
+ */
+seg_tail_s *gap_array_find(const seg_tail_s *from, const seg_tail_s *to,
+                           size_t total_size);
+
+/**
+ * @brief Search the gap array for the smallest of the first fitting gaps
+ *
+ * Like gap_array_find(), but instead of stopping at the first fitting gap, up
+ * to @p candidates fitting gaps are looked at and the smallest of them is
+ * returned. Among gaps of the same size, the one with the lowest address wins.
+ *
+ * @param[in] from Lowest tail address to consider, nullptr for the first gap
+ * @param[in] to Tail address to stop at, nullptr to search up to the last gap
+ * @param[in] total_size Size of the chunk including header and tail
+ * @param[in,out] candidates Number of fitting gaps left to look at. Decremented
+ * by the number of fitting gaps found, so that a search can be continued in
+ * another range
+ *
+ * @return Tail in front of the smallest gap found, nullptr if no gap within the
+ * range is large enough
+ */
+seg_tail_s *gap_array_good(const seg_tail_s *from, const seg_tail_s *to,
+                           size_t total_size, size_t *candidates);
+
+/**
+ * @brief Get the number of gaps looked at by all searches so far
+ *
+ * Every size compared by gap_array_find() and gap_array_good() counts as one
+ * step, as does every block skipped by its largest size. The counter is never
+ * reset, callers compare two readings.
+ *
+ * @return Number of steps in the bound arena since the program started
+ */
+size_t gap_array_steps();
+
+#endif
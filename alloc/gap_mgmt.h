@@ -0,0 +1,93 @@
+/**
+ * @file
+ * @brief Functions keeping the free gap index of the current strategy up to
+ * date
+ */
+#ifndef ALLOC_GAP_MGMT_H
+#define ALLOC_GAP_MGMT_H
+
+#include "alloc/types.h"
+#include <stddef.h>
+
+/**
+ * @brief Announce the gap following a tail to the gap index
+ *
+ * This function adds the gap following @p tail to the index of the currently
+ * used allocation strategy. Gaps smaller than MIN_GAP_SIZE are ignored since no
+ * chunk fits into them anyways. Does nothing if the strategy uses no index.
+ *
+ * @warning The free_following field of @p tail must not change until
+ * gap_unlink() has been called on @p tail again
+ *
+ * @param[in] tail A valid segment tail
+ */
+void gap_link(seg_tail_s *tail);
+
+/**
+ * @brief Make room for a number of gaps in the gap index
+ *
+ * Indices kept inside of the gaps themselves always have room. The gap array of
+ * next-fit and good-fit lives in a mapping of its own, which has to grow before
+ * gaps are linked, since linking cannot fail. Every gap follows the tail of a
+ * chunk, so room for one gap per chunk of the arena is always enough.
+ *
+ * @param[in] count Number of gaps the index needs to hold
+ *
+ * @return SUCCESS if the index has room for @p count gaps, ERROR otherwise
+ */
+int gap_reserve(size_t count);
+
+/**
+ * @brief Withdraw the gap following a tail from the gap index
+ *
+ * This function removes the gap following @p tail from the index of the
+ * currently used allocation strategy. It needs to be called *before* the tail
+ * is moved, its free_following field is changed, or anything is written into
+ * the gap.
+ *
+ * @param[in] tail A valid segment tail
+ */
+void gap_unlink(seg_tail_s *tail);
+
+/**
+ * @brief Select the gap index for a strategy
+ *
+ * This function drops the current gap index, selects the index used by
+ * @p strat and fills it with every gap of @p list.
+ *
+ * @param[in] strat The strategy being switched to
+ * @param[in] list A pointer to a storage list, or nullptr if no list exists yet
+ */
+void set_gap_index(sched_strat_e strat, seg_list_head_s *list);
+
+/**
+ * @brief Get the gap index currently maintained
+ *
+ * Strategies which can also be called while another strategy is in use, e.g.
+ * first_fit() from next_fit(), check with this function whether their index is
+ * up to date.
+ *
+ * @return The hooks of the gap index in use, nullptr if no index is maintained
+ */
+const gap_index_s *get_gap_index();
+
+/**
+ * @brief Get the number of free bytes in indexed gaps
+ *
+ * The sum is kept up to date by gap_link() and gap_unlink(), so this is a
+ * constant time lookup. Gaps smaller than MIN_GAP_SIZE and the gap at the
+ * beginning of the storage table are not included.
+ *
+ * @return Sum of the sizes of all gaps in the current gap index
+ */
+size_t gap_bytes();
+
+/**
+ * @brief Forget about all gaps
+ *
+ * This function empties the current gap index, e.g. after the storage table has
+ * been reset.
+ */
+void gap_clear();
+
+#endif
@@ -0,0 +1,54 @@
+/**
+ * @file
+ * @brief Balanced search trees of gaps
+ */
+#ifndef ALLOC_GAP_TREE_H
+#define ALLOC_GAP_TREE_H
+
+#include "alloc/types.h"
+
+//! Gap index hooks of the tree ordering gaps by size, ties broken by address
+extern const gap_index_s size_tree_index;
+
+/**
+ * @brief Search the size-ordered tree for the smallest fitting gap
+ *
+ * This function descends the size-ordered tree once. Among several smallest
+ * fitting gaps of the same size, the one with the lowest address is returned.
+ *
+ * @param[in] total_size Size of the chunk including header and tail
+ *
+ * @return Tail in front of the smallest gap of at least @p total_size bytes,
+ * nullptr if no gap is large enough
+ */
+seg_tail_s *size_tree_find(size_t total_size);
+
+//! Gap index hooks of the tree ordering gaps by address, where each node also
+//! knows the largest gap of its subtree
+extern const gap_index_s addr_tree_index;
+
+/**
+ * @brief Search the address-ordered tree for the first fitting gap
+ *
+ * This function descends the address-ordered tree once, guided by the largest
+ * gap of each subtree.
+ *
+ * @param[in] total_size Size of the chunk including header and tail
+ *
+ * @return Tail in front of the gap with the lowest address of at least
+ * @p total_size bytes, nullptr if no gap is large enough
+ */
+seg_tail_s *addr_tree_first(size_t total_size);
+
+/**
+ * @brief Search the address-ordered tree for the largest gap
+ *
+ * This function follows the largest gap of the root down to its node. Among
+ * several largest gaps of the same size, the one with the lowest address is
+ * returned.
+ *
+ * @return Tail in front of the largest gap, nullptr if the tree is empty
+ */
+seg_tail_s *addr_tree_largest();
+
+#endif
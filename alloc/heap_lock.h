@@ -0,0 +1,85 @@
+/**
+ * @file
+ * @brief Lock of a storage table, spinning briefly before sleeping
+ *
+ * The critical sections of the allocator, such as add_entry() and
+ * remove_segment(), are short. A thread finding the lock held therefore spins
+ * for a while first, since the lock is likely released before a sleep in the
+ * kernel and the wakeup would even start. Only then it sleeps on a futex. The
+ * number of spins adapts to how long the lock has recently been held: it grows
+ * while spinning succeeds and shrinks while threads end up sleeping anyway.
+ *
+ * Each lock counts its acquisitions, the acquisitions which found it held, and
+ * the time spent waiting for it.
+ */
+#ifndef ALLOC_HEAP_LOCK_H
+#define ALLOC_HEAP_LOCK_H
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+//! Spins of a new lock before sleeping
+#define HEAP_LOCK_INITIAL_SPINS 100
+
+//! Most spins before sleeping, however long the lock is held
+#define HEAP_LOCK_MAX_SPINS 2000
+
+typedef struct heap_lock_s {
+    atomic_uint state; /**< 0 unlocked, 1 locked, 2 locked with sleepers */
+    atomic_uint spins; /**< Current number of spins before sleeping */
+
+    // Only changed while holding the lock, atomic to be read at any time
+    atomic_size_t acquisitions;    /**< Number of times the lock was taken */
+    atomic_size_t contended;       /**< Number of times it was waited for */
+    atomic_uint_least64_t wait_ns; /**< Total time waited, in nanoseconds */
+} heap_lock_s;
+
+typedef struct heap_lock_stats_s {
+    size_t acquisitions; /**< Number of times the lock was taken */
+    size_t contended;    /**< Number of times it had to be waited for */
+    uint64_t wait_ns;    /**< Total time waited, in nanoseconds */
+} heap_lock_stats_s;
+
+//! Initializer of a heap_lock_s with static storage duration
+#define HEAP_LOCK_INITIALIZER {.spins = HEAP_LOCK_INITIAL_SPINS}
+
+/**
+ * @brief Initialize a lock
+ *
+ * @param[out] lock Lock to initialize, unlocked afterwards
+ */
+void heap_lock_init(heap_lock_s *lock);
+
+/**
+ * @brief Take a lock, waiting until it is released if needed
+ *
+ * @param[in] lock Lock to take
+ */
+void heap_lock(heap_lock_s *lock);
+
+/**
+ * @brief Take a lock if it is not held
+ *
+ * @param[in] lock Lock to take
+ *
+ * @return true if the lock is taken now, false if it was held
+ */
+bool heap_trylock(heap_lock_s *lock);
+
+/**
+ * @brief Release a lock and wake a sleeping thread, if any
+ *
+ * @param[in] lock Lock taken with heap_lock() or heap_trylock() before
+ */
+void heap_unlock(heap_lock_s *lock);
+
+/**
+ * @brief Read the counters of a lock
+ *
+ * @param[in] lock Lock to read the counters of
+ * @param[out] stats Counters, added to the values already in @p stats
+ */
+void heap_lock_stats(heap_lock_s *lock, heap_lock_stats_s *stats);
+
+#endif
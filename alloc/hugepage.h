@@ -0,0 +1,49 @@
+/**
+ * @file
+ * @brief Transparent huge pages backing the storage tables
+ *
+ * With huge pages enabled (see set_hugepage_enabled() in arena.h), the ranges
+ * of the arenas are advised with MADV_HUGEPAGE, and the tables grow and shrink
+ * in steps ending on HUGE_PAGE_SIZE boundaries, so the kernel can back each
+ * aligned step with a single huge page. Interior gaps are only purged in whole
+ * huge pages, see purge.h, so a huge page still holding chunks is never split
+ * up, while one left empty is given back at once.
+ *
+ * Chunks are packed towards the beginning of each table, so that the huge
+ * pages there stay full and those at the end are left empty. Arenas placing
+ * chunks with next-fit, which includes all arenas other than the main one, use
+ * address-ordered first-fit instead while huge pages are enabled. Strategies
+ * set explicitly with set_alloc_function() are kept.
+ *
+ * Whether the kernel actually uses huge pages is reported through
+ * /proc/self/smaps, see get_hugepage_stats().
+ */
+#ifndef ALLOC_HUGEPAGE_H
+#define ALLOC_HUGEPAGE_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Size of a transparent huge page. The ranges of the arenas are aligned to it
+#define HUGE_PAGE_SIZE ((size_t)2 * 1024 * 1024)
+
+typedef struct hugepage_stats_s {
+    size_t committed; /**< Bytes accessible in the ranges of the arenas */
+    size_t huge;      /**< Bytes of those backed by huge pages */
+} hugepage_stats_s;
+
+/**
+ * @brief Get the memory of a range backed by huge pages
+ *
+ * Reads /proc/self/smaps without allocating. Mappings reaching beyond the
+ * range count in full.
+ *
+ * @param[in] from Beginning of the range
+ * @param[in] to End of the range
+ *
+ * @return Bytes of anonymous huge pages in mappings within the range, 0 if
+ * smaps cannot be read
+ */
+size_t hugepage_bytes(const uint8_t *from, const uint8_t *to);
+
+#endif
@@ -78,10 +78,21 @@ seg_list_head_s *create_list();
 uint8_t *get_prev_reference(seg_list_head_s *list, uint8_t *addr);
 
 /**
- * @brief Reset the list
+ * @brief Empty the list
  *
  * This function clears the first segment entry in @p list and sets the tail to
  * the address directly after @p list, that is after the storage table header.
+ * The memory of the table stays accessible.
+ *
+ * @param[in] list A list to be emptied
+ */
+void empty_list(seg_list_head_s *list);
+
+/**
+ * @brief Reset the list
+ *
+ * This function empties @p list like empty_list() and moves the break back to
+ * the end of the storage table header right away.
  *
  * @param[in] list A list to be resetted
  * @return SUCCESS on success, ERROR on error.
@@ -0,0 +1,108 @@
+/**
+ * @file
+ * @brief Large allocations in mappings of their own
+ *
+ * Requests of at least the mmap threshold are not placed in a storage table.
+ * Each gets a mapping of its own instead, which is unmapped again when freed.
+ * A large chunk in a storage table would only be given back to the system if
+ * it sat at the very end of the table, and would split the table for the
+ * small chunks around it otherwise.
+ *
+ * Like glibc's M_MMAP_THRESHOLD, the threshold adapts to the program. When a
+ * mapped chunk larger than the threshold is freed, the threshold is raised to
+ * the size of its mapping, up to MAPPED_THRESHOLD_MAX. Programs which
+ * repeatedly allocate and free buffers of the same size then get them from the
+ * storage table, without a system call each.
+ */
+#ifndef ALLOC_MAPPED_H
+#define ALLOC_MAPPED_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Initial and smallest mmap threshold. It lies above SLAB_MAX_SIZE and
+//! BUDDY_MAX_SIZE, so blocks of the slabs and buddy pools are never mapped
+#define MAPPED_THRESHOLD_MIN ((size_t)128 * 1024)
+
+//! The mmap threshold is never raised beyond this on its own
+#define MAPPED_THRESHOLD_MAX ((size_t)32 * 1024 * 1024)
+
+/**
+ * @brief Set the mmap threshold
+ *
+ * Setting the threshold stops it from adapting to the sizes freed.
+ *
+ * @param[in] threshold Smallest request getting a mapping of its own, raised
+ * to MAPPED_THRESHOLD_MIN if lower. SIZE_MAX places all requests in the
+ * storage tables
+ */
+void set_mmap_threshold(size_t threshold);
+
+/**
+ * @brief Get the mmap threshold
+ *
+ * @return Smallest request getting a mapping of its own
+ */
+size_t get_mmap_threshold();
+
+/**
+ * @brief Allocate a chunk in a mapping of its own
+ *
+ * @param[in] size Requested size
+ *
+ * @return User address of the chunk, aligned to ALIGNMENT and zeroed, nullptr
+ * if the mapping failed
+ */
+uint8_t *mapped_alloc(size_t size);
+
+/**
+ * @brief Unmap a chunk
+ *
+ * Raises the threshold to the size of the mapping if it is larger and the
+ * threshold has not been set with set_mmap_threshold().
+ *
+ * @warning @p addr must be a mapped chunk, see mapped_owns()
+ *
+ * @param[in] addr Address previously returned by mapped_alloc()
+ */
+void mapped_free(uint8_t *addr);
+
+/**
+ * @brief Resize a mapped chunk
+ *
+ * The mapping is resized in place if possible and moved otherwise. The
+ * contents are kept up to the lesser of the old and new size.
+ *
+ * @warning @p addr must be a mapped chunk, see mapped_owns()
+ *
+ * @param[in] addr Address previously returned by mapped_alloc()
+ * @param[in] size New size
+ *
+ * @return New user address of the chunk, nullptr if the mapping could not be
+ * resized, in which case @p addr stays valid
+ */
+uint8_t *mapped_realloc(uint8_t *addr, size_t size);
+
+/**
+ * @brief Check whether an address is a mapped chunk
+ *
+ * This needs no lock. Any address outside of the reserved ranges of all arenas
+ * is a mapped chunk, so nothing the user stores next to a chunk of the
+ * storage tables is taken for the header of a mapping.
+ *
+ * @param[in] addr Any address returned by malloc()
+ *
+ * @return true if @p addr was returned by mapped_alloc()
+ */
+bool mapped_owns(uint8_t *addr);
+
+/**
+ * @brief Get the size of a mapped chunk
+ *
+ * @param[in] addr Address previously returned by mapped_alloc()
+ *
+ * @return Size requested for the chunk
+ */
+size_t mapped_size(const uint8_t *addr);
+
+#endif
@@ -14,9 +14,9 @@
  *
  * This function searches for gaps with one of the memory allocation algorithms
  *(First, Next, Best,
- * Worst etc.). If no gap is found, the table is expanded with sbrk() and a
- *suitable beginning of free segment is returned. It sets up the initial
- *structures (Table header) on beginning
+ * Worst etc.). If no gap is found, the table is expanded within the range of
+ *the arena and a suitable beginning of free segment is returned. It sets up
+ *the initial structures (Table header) on beginning
  *
  * @note This function does not actually allocate anything, for this, call
  *add_entry()
@@ -27,7 +27,8 @@
  * @param[in] size Size of new segment
  *
  * @return Address of gap where there is at least size many space free (not
- * allocated yet).
+ * allocated yet). nullptr if the range of the arena is exhausted or the system
+ * is out of memory.
  *
  */
 uint8_t *find_free_seg(size_t size);
@@ -112,15 +113,37 @@ uint8_t *add_entry(uint8_t *addr, size_t size);
  * @brief Change alloc function
  *
  * This function changes the alloc function. Currently, NEXT_FIT, BEST_FIT,
- * WORST_FIT and FIRST_FIT are supported.
- *
- * @note Only useful for testing purposes
+ * WORST_FIT, FIRST_FIT, SEGREGATED_FIT, TLSF_FIT, BUDDY, GOOD_FIT and ADAPTIVE
+ * are supported. The gap index of the new strategy, if any, is rebuilt from the
+ * current storage table. With BUDDY, requests of up to BUDDY_MAX_SIZE bytes are
+ * served from buddy pools, and the segment list uses first-fit. With ADAPTIVE,
+ * a controller measures the fragmentation of the storage table while running,
+ * and switches between next-fit, good-fit and best-fit (see adaptive.h).
  *
  * @param[in] strat Enum constant of the corresponding memory strategy
  *
  */
 void set_alloc_function(sched_strat_e strat);
 
+/**
+ * @brief Switch the alloc function only
+ *
+ * Like set_alloc_function(), but the strategy returned by get_alloc_strat() is
+ * left unchanged. Used by the controller of ADAPTIVE.
+ *
+ * @param[in] strat Enum constant of the corresponding memory strategy, not
+ * ADAPTIVE
+ */
+void use_alloc_function(sched_strat_e strat);
+
+/**
+ * @brief Get the current strategy
+ *
+ * @return Enum constant of the strategy set last with set_alloc_function(),
+ * NEXT_FIT by default
+ */
+sched_strat_e get_alloc_strat();
+
 /**
  * @brief Destroy allocated storage
  *
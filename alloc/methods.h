@@ -58,4 +58,34 @@ void *calloc(size_t n_memb, size_t size);
  */
 void *realloc(void *ptr, size_t size);
 
+/** @brief Allocate several spaces of the same size at once
+ *
+ * Acts like calling malloc() @p n times, but the arena is locked only once,
+ * and consecutive spaces are carved from the same gap as long as it lasts, so
+ * the gap is searched for only once per gap instead of once per space.
+ *
+ * @param[in] size Size of each space to be allocated
+ * @param[in] n Number of spaces to be allocated
+ * @param[out] out Array of at least @p n pointers receiving the spaces
+ * @return Number of spaces allocated, which are stored at the beginning of
+ * @p out. Less than @p n only if storage is exhausted, 0 if @p size or @p n is
+ * 0
+ *
+ */
+size_t julmalloc_alloc_batch(size_t size, size_t n, void **out);
+
+/** @brief Free several spaces at once
+ *
+ * Acts like calling free() on each pointer, but the pointers are freed in
+ * address order and the arena of consecutive pointers is locked only once.
+ * Freeing in address order merges each space into the gap left by the
+ * previous one.
+ *
+ * @param[in,out] ptrs Pointers to be freed, nullptr entries are ignored. The
+ * array is sorted by address afterwards
+ * @param[in] n Number of pointers
+ *
+ */
+void julmalloc_free_batch(void **ptrs, size_t n);
+
 #endif
@@ -0,0 +1,117 @@
+/**
+ * @file
+ * @brief Giving back the pages inside of large gaps
+ *
+ * Memory at the end of a storage table is given back once the table shrinks,
+ * but a gap in the middle of a table keeps its pages forever, since the chunks
+ * behind it pin the break. A long-running program would keep the memory of its
+ * highest peak even after freeing most of it.
+ *
+ * Whenever freeing leaves a gap of at least PURGE_MIN_SIZE, the whole pages
+ * inside of it are advised to the kernel with MADV_FREE, which lets it reclaim
+ * them lazily, or with MADV_DONTNEED, which drops them right away. The pages
+ * stay accessible and read as zero once reclaimed. The bookkeeping of the gap
+ * index at the beginning of the gap is never purged.
+ *
+ * The pages are only marked as purged while the arena is locked. The runs of
+ * marked pages are queued and advised by arena_unlock() once the lock is
+ * released, so that other threads keep working on the arena during the system
+ * call. A queued run whose pages are reused before is dropped.
+ *
+ * Each arena remembers the pages it purged in a bitmap, so that a gap growing
+ * by a neighbor does not advise the pages purged before a second time. Pages
+ * lose their mark once a chunk is placed on them again.
+ */
+#ifndef ALLOC_PURGE_H
+#define ALLOC_PURGE_H
+
+#include "alloc/arena.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//! Smallest range of whole pages within a gap which is purged
+#define PURGE_MIN_SIZE ((size_t)64 * 1024)
+
+typedef enum purge_advice_e {
+    PURGE_NONE,     /**< Gaps keep their pages */
+    PURGE_FREE,     /**< MADV_FREE, pages are reclaimed under memory pressure */
+    PURGE_DONTNEED, /**< MADV_DONTNEED, pages are dropped right away */
+} purge_advice_e;
+
+typedef struct purge_stats_s {
+    size_t purged;  /**< Bytes purged and not reused since */
+    size_t advised; /**< Bytes advised to the kernel in total */
+} purge_stats_s;
+
+/**
+ * @brief Set how the pages inside of large gaps are given back
+ *
+ * Kernels without MADV_FREE fall back to MADV_DONTNEED.
+ *
+ * @param[in] advice Advice for the pages, PURGE_FREE by default
+ */
+void set_purge_advice(purge_advice_e advice);
+
+/**
+ * @brief Get how the pages inside of large gaps are given back
+ *
+ * @return Advice set with set_purge_advice()
+ */
+purge_advice_e get_purge_advice();
+
+/**
+ * @brief Purge the whole pages within a free range of the bound arena
+ *
+ * Does nothing if the pages add up to less than PURGE_MIN_SIZE. Pages purged
+ * before are skipped. The pages are advised by purge_flush() once the arena is
+ * unlocked, or right away if PURGE_QUEUE runs are queued already.
+ *
+ * @warning The arena must be locked, and nothing may be stored in the range
+ *
+ * @param[in] from Beginning of the free range, past any gap bookkeeping
+ * @param[in] to End of the free range
+ */
+void purge_range(uint8_t *from, uint8_t *to);
+
+/**
+ * @brief Advise the runs of pages queued by purge_range() to the kernel
+ *
+ * Returns right away if nothing is queued, or if another thread is advising
+ * the runs of @p arena.
+ *
+ * @param[in] arena Arena which is not locked by the calling thread
+ */
+void purge_flush(arena_s *arena);
+
+/**
+ * @brief Unmark the pages of a range of the bound arena as purged
+ *
+ * Called when a chunk is placed on memory which may have been purged, so that
+ * its pages are purged again once it is freed. Queued runs overlapping the
+ * range are dropped, and a run being advised is waited for.
+ *
+ * @warning The arena must be locked
+ *
+ * @param[in] from Beginning of the range, including any gap bookkeeping
+ * written after it
+ * @param[in] to End of the range
+ */
+void purge_reuse(uint8_t *from, uint8_t *to);
+
+/**
+ * @brief Forget all pages purged in an arena
+ *
+ * Used when the table of the arena is reset.
+ *
+ * @param[in] arena Arena not used by any thread
+ */
+void purge_forget(arena_s *arena);
+
+/**
+ * @brief Get the counters of purged memory of all arenas
+ *
+ * @param[out] stats Counters
+ */
+void get_purge_stats(purge_stats_s *stats);
+
+#endif
@@ -0,0 +1,37 @@
+/**
+ * @file
+ * @brief Segregated size-class free lists of gaps
+ */
+#ifndef ALLOC_SEG_CLASSES_H
+#define ALLOC_SEG_CLASSES_H
+
+#include "alloc/types.h"
+
+//! Gaps below this size are binned exactly in steps of ALIGNMENT, larger gaps
+//! are binned by powers of two
+#define SEG_CLASS_LINEAR_LIMIT 1024
+
+//! Number of size classes
+#define NUM_SEG_CLASSES 128
+
+//! Number of gaps looked at in a power-of-two class before moving on to the
+//! next larger class
+#define SEG_CLASS_SCAN_LIMIT 8
+
+//! Gap index hooks of the size-class lists
+extern const gap_index_s seg_class_index;
+
+/**
+ * @brief Search the size-class lists for a gap
+ *
+ * This function looks for a gap of at least @p total_size bytes. It looks into
+ * the class of @p total_size first, then takes the first gap of the next larger
+ * non-empty class.
+ *
+ * @param[in] total_size Size of the chunk including header and tail
+ *
+ * @return Tail in front of a fitting gap, nullptr if no gap is large enough
+ */
+seg_tail_s *seg_class_find(size_t total_size);
+
+#endif
@@ -0,0 +1,118 @@
+/**
+ * @file
+ * @brief Slab allocator for small objects
+ */
+#ifndef ALLOC_SLAB_H
+#define ALLOC_SLAB_H
+
+#include "alloc/defines.h"
+#include "alloc/types.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//! Largest request served by the slabs. Larger requests are chunks of the
+//! segment list
+#define SLAB_MAX_SIZE 512
+
+//! Number of object sizes, see slab.c for the sizes themselves
+#define NUM_SLAB_CLASSES 16
+
+//! Number of pages of a span, which is the unit slabs are allocated from the
+//! segment list in
+#define SLAB_SPAN_PAGES 64
+
+//! Number of threads whose objects never share a slab, and therefore never
+//! share a cache line. Further threads share the slabs of the others. Chunks
+//! of the storage table are only kept a cache line apart by their tails and
+//! headers without COMPACT_CHUNKS, so with it, small objects of different
+//! threads only stay apart while the slabs are enabled
+#define SLAB_OWNERS 64
+
+/**
+ * @brief Enable or disable the slab allocator
+ *
+ * While enabled, malloc() serves requests of up to SLAB_MAX_SIZE bytes from
+ * the slabs. Objects allocated before disabling the slabs stay valid and can
+ * still be freed or reallocated.
+ *
+ * @param[in] enabled true to enable, false to disable
+ */
+void set_slab_enabled(bool enabled);
+
+/**
+ * @brief Check whether the slab allocator is enabled
+ *
+ * @return true if enabled, false otherwise (the default)
+ */
+bool get_slab_enabled();
+
+/**
+ * @brief Allocate an object from the slabs
+ *
+ * This function takes a free object of the smallest fitting size class from a
+ * partially used slab of the calling thread, or sets up a new slab. A new span
+ * is allocated from the segment list if no span has a page left.
+ *
+ * Each thread allocates from slabs of its own, so that hot objects of
+ * different threads never share a cache line. A thread gets one of
+ * SLAB_OWNERS owner slots on its first allocation, which is handed to another
+ * thread once it has exited, together with its partially used slabs.
+ *
+ * @param[in] size Requested size, at most SLAB_MAX_SIZE
+ *
+ * @return Address of the object, nullptr if no span could be allocated
+ */
+uint8_t *slab_alloc(size_t size);
+
+/**
+ * @brief Free an object of the slabs
+ *
+ * This function finds the slab of @p addr by masking the address, and marks the
+ * object free in the bitmap of the slab. Empty slabs are given back to their
+ * span, and empty spans to the segment list.
+ *
+ * @warning @p addr must be owned by a span, see slab_owns()
+ *
+ * @param[in] addr Address previously returned by slab_alloc()
+ */
+void slab_free(uint8_t *addr);
+
+/**
+ * @brief Check whether an address belongs to a slab
+ *
+ * Takes constant time, since spans are looked up by the slot of the range of
+ * the main arena they start in. Needs no lock if @p addr is allocated.
+ *
+ * @param[in] addr Any address
+ *
+ * @return true if @p addr lies within a span, false otherwise
+ */
+bool slab_owns(const uint8_t *addr);
+
+/**
+ * @brief Get the size of an object
+ *
+ * @param[in] addr Address previously returned by slab_alloc()
+ *
+ * @return Object size of the slab of @p addr
+ */
+size_t slab_object_size(uint8_t *addr);
+
+/**
+ * @brief Get the object size a request is rounded up to
+ *
+ * @param[in] size Requested size, at most SLAB_MAX_SIZE
+ *
+ * @return Size of the objects slab_alloc() would hand out for @p size
+ */
+size_t slab_round_size(size_t size);
+
+/**
+ * @brief Forget about all spans and slabs
+ *
+ * This function is called when the whole storage table is reset, which frees
+ * the spans along with it.
+ */
+void slab_clear();
+
+#endif
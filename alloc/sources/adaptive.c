@@ -0,0 +1,95 @@
+#include "alloc/adaptive.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/gap_array.h"
+#include "alloc/gap_mgmt.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Measurements of the current window and the state of the controller. All
+// measurements are cheap counters, no chunk or gap is looked at
+typedef struct adaptive_s {
+    sched_strat_e strat;   /**< Strategy in use */
+    sched_strat_e pending; /**< Strategy chosen at the end of the last window */
+    size_t allocs;         /**< Allocations in the current window */
+    size_t frees;          /**< Frees in the current window */
+    size_t steps;          /**< gap_array_steps() at the start of the window */
+    size_t switches;       /**< Number of switches since the start */
+} adaptive_s;
+
+static adaptive_s adaptive = {.strat = NEXT_FIT, .pending = NEXT_FIT};
+
+// Percentage of the storage table held by gaps a chunk could be placed in, not
+// counting the trailing gap at the end of the table, which is where the table
+// simply hasn't been used yet
+static size_t holes_percent(seg_list_head_s *list) {
+    size_t table = list->end_addr - ((uint8_t *)list + sizeof(*list));
+    size_t holes = gap_bytes();
+
+    if (!table || !list->first_seg) {
+        return 0;
+    }
+
+    seg_tail_s *last = head_prev_tail(list->first_seg);
+    if (tail_free(last) >= MIN_GAP_SIZE) {
+        holes -= tail_free(last);
+    }
+
+    return holes * 100 / table;
+}
+
+// The policy: During allocation bursts, speed matters most, and the gaps are
+// about to be filled up anyways, so next-fit is preferred. Otherwise, the more
+// of the table is wasted in gaps, the more carefully gaps are chosen. Long
+// next-fit searches are a sign of many small gaps in front of the roving
+// pointer, which good-fit fills up
+static sched_strat_e choose(seg_list_head_s *list) {
+    size_t holes = holes_percent(list);
+    size_t steps = (gap_array_steps() - adaptive.steps) / adaptive.allocs;
+    bool burst = adaptive.frees * 4 < adaptive.allocs;
+
+    if (holes >= ADAPTIVE_HOLES_HIGH) {
+        return burst ? GOOD_FIT : BEST_FIT;
+    }
+    if (holes >= ADAPTIVE_HOLES_LOW || steps >= ADAPTIVE_STEPS_HIGH) {
+        return burst ? NEXT_FIT : GOOD_FIT;
+    }
+    return NEXT_FIT;
+}
+
+void adaptive_start() {
+    adaptive = (adaptive_s){.strat = NEXT_FIT, .pending = NEXT_FIT};
+    adaptive.steps = gap_array_steps();
+
+    use_alloc_function(NEXT_FIT);
+}
+
+void adaptive_alloc(seg_list_head_s *list) {
+    if (++adaptive.allocs < ADAPTIVE_WINDOW) {
+        return;
+    }
+
+    sched_strat_e target = choose(list);
+
+    // Switching rebuilds the gap index by walking the whole table, so a single
+    // unusual window is not enough to switch
+    if (target != adaptive.strat && target == adaptive.pending) {
+        adaptive.strat = target;
+        adaptive.switches++;
+        use_alloc_function(target);
+    }
+
+    adaptive.pending = target;
+    adaptive.allocs = 0;
+    adaptive.frees = 0;
+    adaptive.steps = gap_array_steps();
+}
+
+void adaptive_free() { adaptive.frees++; }
+
+sched_strat_e adaptive_strat() { return adaptive.strat; }
+
+size_t adaptive_switches() { return adaptive.switches; }
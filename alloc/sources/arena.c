@@ -0,0 +1,495 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/gap_array.h"
+#include "alloc/heap_lock.h"
+#include "alloc/hugepage.h"
+#include "alloc/purge.h"
+#include "alloc/types.h"
+#include "alloc/utils.h"
+
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <time.h>
+#include <unistd.h>
+
+// next-fit is the default strategy, so the gap array is the index of the main
+// arena from the start. All other arenas always use it
+static arena_s arenas[MAX_ARENAS] = {
+    [0] = {.lock = HEAP_LOCK_INITIALIZER,
+           .grow_lock = HEAP_LOCK_INITIALIZER,
+           .purge_lock = HEAP_LOCK_INITIALIZER,
+           .advise_lock = HEAP_LOCK_INITIALIZER,
+           .gap_index = &gap_array_index},
+};
+
+// Number of arenas threads are assigned to, and number of arenas reserved so
+// far. Arenas are never released, so arena_of() can read both without a lock
+static atomic_size_t arena_count = 1;
+static atomic_size_t arena_reserved = 1;
+
+// Serializes reserving arenas
+static pthread_mutex_t reserve_lock = PTHREAD_MUTEX_INITIALIZER;
+
+// Assigns threads to arenas round-robin
+static atomic_size_t next_home = 0;
+
+static atomic_size_t decay_ms = ARENA_DEFAULT_DECAY_MS;
+
+static atomic_bool hugepages = false;
+
+// The library may be preloaded in front of the C library's malloc. With the
+// initial-exec model, these live in the static TLS block of the thread, so
+// accessing them never allocates itself
+thread_local arena_s *g_arena
+    __attribute__((tls_model("initial-exec"))) = &arenas[0];
+
+static thread_local arena_s *home __attribute__((tls_model("initial-exec")));
+
+// Tells the kernel whether to back the range of an arena with huge pages
+static void advise_range(arena_s *arena) {
+    int advice = atomic_load(&hugepages) ? MADV_HUGEPAGE : MADV_NOHUGEPAGE;
+
+    if (madvise(arena->base, ARENA_RESERVE, advice)) {
+        pr_warning("madvise error: %s", strerror(errno));
+    }
+}
+
+// Reserves the address space of an arena. Nothing is accessible until the
+// table grows, so an unused arena costs no memory. The range starts on a huge
+// page boundary, so the steps the table grows by in huge page mode line up
+// with the huge pages of the kernel
+static int reserve_range(arena_s *arena) {
+    uint8_t *map = mmap(nullptr, ARENA_RESERVE + HUGE_PAGE_SIZE, PROT_NONE,
+                        MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE, -1, 0);
+    if (map == MAP_FAILED) {
+        pr_error("mmap error: %s", strerror(errno));
+        return ERROR;
+    }
+
+    uint8_t *base = (uint8_t *)round_up((uintptr_t)map, HUGE_PAGE_SIZE);
+
+    // Give back the slack in front of and behind the aligned range
+    if (base > map) {
+        munmap(map, base - map);
+    }
+    munmap(base + ARENA_RESERVE, map + HUGE_PAGE_SIZE - base);
+
+    arena->base = base;
+    arena->brk = base;
+    arena->limit = base + ARENA_RESERVE;
+
+    if (atomic_load(&hugepages)) {
+        advise_range(arena);
+    }
+
+    return SUCCESS;
+}
+
+static int reserve(arena_s *arena) {
+    if (reserve_range(arena) == ERROR) {
+        return ERROR;
+    }
+
+    heap_lock_init(&arena->lock);
+    heap_lock_init(&arena->grow_lock);
+    heap_lock_init(&arena->purge_lock);
+    heap_lock_init(&arena->advise_lock);
+    arena->gap_index = &gap_array_index;
+
+    return SUCCESS;
+}
+
+void set_arena_count(size_t count) {
+    count = count < 1 ? 1 : count > MAX_ARENAS ? MAX_ARENAS : count;
+
+    pthread_mutex_lock(&reserve_lock);
+
+    size_t reserved = atomic_load(&arena_reserved);
+    while (reserved < count && reserve(&arenas[reserved]) == SUCCESS) {
+        reserved++;
+    }
+
+    // The range of an arena is complete before arena_of() gets to see it
+    atomic_store(&arena_reserved, reserved);
+    atomic_store(&arena_count, reserved < count ? reserved : count);
+
+    pthread_mutex_unlock(&reserve_lock);
+}
+
+size_t get_arena_count() { return atomic_load(&arena_count); }
+
+void set_decay_time(size_t ms) { atomic_store(&decay_ms, ms); }
+
+size_t get_decay_time() { return atomic_load(&decay_ms); }
+
+// Ranges reserved later are advised by reserve_range()
+void set_hugepage_enabled(bool enabled) {
+    pthread_mutex_lock(&reserve_lock);
+
+    atomic_store(&hugepages, enabled);
+
+    size_t reserved = atomic_load(&arena_reserved);
+    for (size_t i = 0; i < reserved; i++) {
+        if (arenas[i].base) {
+            advise_range(&arenas[i]);
+        }
+    }
+
+    pthread_mutex_unlock(&reserve_lock);
+}
+
+bool get_hugepage_enabled() { return atomic_load(&hugepages); }
+
+// The end of the memory kept ahead of a table ending at end
+static uint8_t *ahead_of(uint8_t *end) {
+    uint8_t *ahead = end + ARENA_GROW_AHEAD;
+
+    if (atomic_load_explicit(&hugepages, memory_order_relaxed)) {
+        ahead = (uint8_t *)round_up((uintptr_t)ahead, HUGE_PAGE_SIZE);
+    }
+    return ahead;
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Lowers the committed end of a locked arena to ARENA_GROW_AHEAD beyond the
+// end of its table. Lowering it while holding the lock of the arena keeps all
+// threads from using the memory above before it is given back
+static void trim(arena_s *arena, uint8_t *end) {
+    uint8_t *keep = ahead_of(end);
+    uint8_t *committed = atomic_load(&arena->committed);
+
+    // Only threads holding the grow lock raise the committed end concurrently
+    while (committed > keep &&
+           !atomic_compare_exchange_weak(&arena->committed, &committed, keep)) {
+    }
+
+    atomic_store(&arena->target, keep);
+    atomic_store_explicit(&arena->pending, true, memory_order_relaxed);
+}
+
+arena_s *arena_main() { return &arenas[0]; }
+
+arena_s *arena_home() {
+    if (!home) {
+        home = &arenas[atomic_fetch_add(&next_home, 1) %
+                       atomic_load(&arena_count)];
+    }
+    return home;
+}
+
+// The extent is published only once it is reserved completely. Threads of the
+// exhausted arena which have not noticed yet find it on their next failure
+arena_s *arena_extend(arena_s *arena) {
+    pthread_mutex_lock(&reserve_lock);
+
+    if (!arena->extent) {
+        size_t reserved = atomic_load(&arena_reserved);
+
+        if (reserved < MAX_ARENAS && reserve(&arenas[reserved]) == SUCCESS) {
+            atomic_store(&arena_reserved, reserved + 1);
+            atomic_store(&arena->extent, &arenas[reserved]);
+        }
+    }
+
+    pthread_mutex_unlock(&reserve_lock);
+
+    arena_s *extent = atomic_load(&arena->extent);
+    if (extent && home == arena) {
+        home = extent;
+    }
+
+    return extent;
+}
+
+arena_s *arena_of(const uint8_t *addr) {
+    size_t reserved = atomic_load(&arena_reserved);
+
+    // The main arena is the fallback, its range is not checked
+    for (size_t i = 1; i < reserved; i++) {
+        if (addr >= arenas[i].base && addr < arenas[i].limit) {
+            return &arenas[i];
+        }
+    }
+
+    return &arenas[0];
+}
+
+arena_s *arena_find(const uint8_t *addr) {
+    size_t reserved = atomic_load(&arena_reserved);
+
+    for (size_t i = 0; i < reserved; i++) {
+        if (addr >= arenas[i].base && addr < arenas[i].limit) {
+            return &arenas[i];
+        }
+    }
+
+    return nullptr;
+}
+
+void arena_lock(arena_s *arena) {
+    heap_lock(&arena->lock);
+    g_arena = arena;
+}
+
+bool arena_trylock(arena_s *arena) {
+    if (!heap_trylock(&arena->lock)) {
+        return false;
+    }
+    g_arena = arena;
+    return true;
+}
+
+// The retained memory has decayed if the table has not grown back since. It is
+// given back by the next call of arena_maintain(). Purged pages are advised
+// only after unlocking, since madvise() may take a while for large runs
+void arena_unlock(arena_s *arena) {
+    if (arena->idle_since &&
+        now_ns() - arena->idle_since >= get_decay_time() * 1000000) {
+        trim(arena, arena->list->end_addr);
+        arena->idle_since = 0;
+    }
+
+    g_arena = &arenas[0];
+    heap_unlock(&arena->lock);
+    purge_flush(arena);
+}
+
+void get_lock_stats(heap_lock_stats_s *stats) {
+    size_t reserved = atomic_load(&arena_reserved);
+
+    *stats = (heap_lock_stats_s){};
+    for (size_t i = 0; i < reserved; i++) {
+        heap_lock_stats(&arenas[i].lock, stats);
+    }
+}
+
+// The committed memory is the accessible part of each range, up to its break
+void get_hugepage_stats(hugepage_stats_s *stats) {
+    size_t reserved = atomic_load(&arena_reserved);
+
+    *stats = (hugepage_stats_s){};
+    for (size_t i = 0; i < reserved; i++) {
+        if (arenas[i].base) {
+            stats->committed +=
+                round_up(arenas[i].brk - arenas[i].base, PAGE_SIZE);
+            stats->huge += hugepage_bytes(arenas[i].base, arenas[i].limit);
+        }
+    }
+}
+
+// A stack with a single consumer, which always takes all of it at once. So a
+// pointer can never be popped and pushed again while another thread pushes,
+// and a plain compare-and-swap is free of ABA problems
+void arena_push_remote(arena_s *arena, uint8_t *addr) {
+    uint8_t *head = atomic_load_explicit(&arena->remote, memory_order_relaxed);
+
+    do {
+        *(uint8_t **)addr = head;
+    } while (!atomic_compare_exchange_weak_explicit(&arena->remote, &head, addr,
+                                                    memory_order_release,
+                                                    memory_order_relaxed));
+}
+
+uint8_t *arena_take_remote(arena_s *arena) {
+    // Cheap check first, the queue is empty most of the time
+    if (!atomic_load_explicit(&arena->remote, memory_order_relaxed)) {
+        return nullptr;
+    }
+
+    return atomic_exchange_explicit(&arena->remote, nullptr,
+                                    memory_order_acquire);
+}
+
+// The current break of an arena
+static uint8_t *current_break(arena_s *arena) { return arena->brk; }
+
+// Moves the break of an arena, called with its grow lock held. Pages between
+// the new and the old break are made accessible when growing. When shrinking,
+// all whole pages above the new break are made inaccessible again, which also
+// gives their memory back to the system. The range of the main arena is only
+// reserved when its table is created
+static void *move_break(arena_s *arena, intptr_t increment) {
+    if (!arena->base && reserve_range(arena) == ERROR) {
+        return (void *)-1;
+    }
+
+    uint8_t *old_brk = arena->brk;
+    uint8_t *new_brk = old_brk + increment;
+
+    if (new_brk < arena->base || new_brk > arena->limit) {
+        errno = ENOMEM;
+        return (void *)-1;
+    }
+
+    uint8_t *old_page = (uint8_t *)round_up((uintptr_t)old_brk, PAGE_SIZE);
+    uint8_t *new_page = (uint8_t *)round_up((uintptr_t)new_brk, PAGE_SIZE);
+
+    if (new_page > old_page &&
+        mprotect(old_page, new_page - old_page, PROT_READ | PROT_WRITE)) {
+        return (void *)-1;
+    }
+    if (new_page < old_page &&
+        mmap(new_page, old_page - new_page, PROT_NONE,
+             MAP_PRIVATE | MAP_ANONYMOUS | MAP_NORESERVE | MAP_FIXED, -1,
+             0) == MAP_FAILED) {
+        return (void *)-1;
+    }
+
+    arena->brk = new_brk;
+    return old_brk;
+}
+
+// Moving the break directly drops any memory reserved ahead
+void *arena_sbrk(intptr_t increment) {
+    arena_s *arena = g_arena;
+
+    heap_lock(&arena->grow_lock);
+
+    uint8_t *old_brk = move_break(arena, increment);
+    if (old_brk != (void *)-1) {
+        atomic_store(&arena->committed, old_brk + increment);
+        atomic_store(&arena->target, old_brk + increment);
+        arena->idle_since = 0;
+    }
+
+    heap_unlock(&arena->grow_lock);
+
+    return old_brk;
+}
+
+int arena_brk(void *addr) {
+    arena_s *arena = g_arena;
+
+    heap_lock(&arena->grow_lock);
+    intptr_t increment = (uint8_t *)addr - current_break(arena);
+    heap_unlock(&arena->grow_lock);
+
+    return arena_sbrk(increment) == (void *)-1 ? -1 : 0;
+}
+
+// Usually, the memory is committed already and this only checks whether the
+// memory reserved ahead runs low. Otherwise, the thread has to grow the arena
+// itself while holding the lock of the arena
+int arena_commit(uint8_t *end, size_t size) {
+    arena_s *arena = g_arena;
+    uint8_t *want = end + size;
+    uint8_t *committed = atomic_load(&arena->committed);
+
+    // The table grew back into the retained memory, which is not too much
+    // anymore
+    if (ahead_of(want) + ARENA_GROW_AHEAD >= committed) {
+        arena->idle_since = 0;
+    }
+
+    if (want + ARENA_GROW_AHEAD / 2 > committed) {
+        atomic_store(&arena->target, ahead_of(want));
+        atomic_store_explicit(&arena->pending, true, memory_order_relaxed);
+    }
+
+    if (want <= committed) {
+        return SUCCESS;
+    }
+
+    heap_lock(&arena->grow_lock);
+
+    uint8_t *brk = current_break(arena);
+
+    // Try to reserve ahead right away, but settle for what is needed
+    if (brk < want && move_break(arena, ahead_of(want) - brk) == (void *)-1 &&
+        move_break(arena, want - brk) == (void *)-1) {
+        heap_unlock(&arena->grow_lock);
+        return ERROR;
+    }
+
+    atomic_store(&arena->committed, current_break(arena));
+    heap_unlock(&arena->grow_lock);
+
+    return SUCCESS;
+}
+
+// Too much memory left is only given back once it has not been used for the
+// decay time, see arena_unlock(). A loop allocating and freeing a large chunk
+// thus keeps its memory
+void arena_release(uint8_t *end) {
+    arena_s *arena = g_arena;
+    uint8_t *committed = atomic_load(&arena->committed);
+
+    if (committed <= ahead_of(end) + ARENA_GROW_AHEAD) {
+        return;
+    }
+
+    if (!get_decay_time()) {
+        trim(arena, end);
+    } else if (!arena->idle_since) {
+        arena->idle_since = now_ns();
+    }
+}
+
+// Called without the lock of the arena. The break is moved towards the target,
+// but never below the committed end. The committed end is only lowered
+// concurrently, which is safe, and only raised by the holder of the grow lock
+void arena_maintain(arena_s *arena) {
+    if (!atomic_load_explicit(&arena->pending, memory_order_relaxed) ||
+        !heap_trylock(&arena->grow_lock)) {
+        return;
+    }
+
+    atomic_store_explicit(&arena->pending, false, memory_order_relaxed);
+
+    uint8_t *brk = current_break(arena);
+    uint8_t *committed = atomic_load(&arena->committed);
+    uint8_t *target = atomic_load(&arena->target);
+
+    if (target < committed) {
+        target = committed;
+    }
+
+    if (target > brk) {
+        if (move_break(arena, target - brk) == (void *)-1) {
+            pr_warning("Could not grow arena ahead: %s", strerror(errno));
+        } else {
+            atomic_compare_exchange_strong(&arena->committed, &committed,
+                                           target);
+        }
+    } else if (target < brk && move_break(arena, target - brk) == (void *)-1) {
+        pr_warning("Could not shrink arena: %s", strerror(errno));
+    }
+
+    heap_unlock(&arena->grow_lock);
+}
+
+void arena_clear() {
+    size_t reserved = atomic_load(&arena_reserved);
+
+    // Queued pointers and purged pages are gone together with their tables
+    for (size_t i = 0; i < reserved; i++) {
+        atomic_store(&arenas[i].remote, nullptr);
+        purge_forget(&arenas[i]);
+    }
+
+    for (size_t i = 1; i < reserved; i++) {
+        arena_s *arena = &arenas[i];
+
+        g_arena = arena;
+        arena_brk(arena->base);
+        gap_array_index.clear();
+        g_arena = &arenas[0];
+
+        arena->list = nullptr;
+        arena->chunks = 0;
+        for (size_t k = 0; k < ARENA_CURSORS; k++) {
+            arena->cursors[k].addr = nullptr;
+        }
+        arena->gap_bytes = 0;
+    }
+}
@@ -0,0 +1,339 @@
+#include "alloc/buddy.h"
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/types.h"
+
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// List node of a free block, stored right at the beginning of the block itself.
+// The smallest block has just enough space for it
+typedef struct buddy_block_s {
+    struct buddy_block_s *prev; /**< Previous free block of the same size */
+    struct buddy_block_s *next; /**< Next free block of the same size */
+} buddy_block_s;
+
+// A pool of 2^BUDDY_POOL_ORDER bytes, which is split into blocks. The blocks
+// form an implicit binary tree: level 0 is the whole pool, and each block of
+// level l consists of two buddies of level l + 1. The nodes are numbered level
+// by level, so node (l, i) has the number 2^l - 1 + i.
+// The pool itself is allocated as a single chunk of the segment list, with this
+// descriptor at its beginning, followed by the blocks.
+typedef struct buddy_pool_s {
+    uint8_t *base; /**< Beginning of the first block */
+
+    //! Neighbors in the list of pools with free blocks, for every level
+    struct buddy_pool_s *prev_free[BUDDY_LEVELS];
+    struct buddy_pool_s *next_free[BUDDY_LEVELS];
+
+    //! First free block of every level, nullptr if there is none
+    buddy_block_s *free_heads[BUDDY_LEVELS];
+
+    //! One bit per node, set if the block has been split into its buddies
+    uint64_t split_map[(BUDDY_NODES + 63) / 64];
+
+    //! One bit per node, set if the block is in a free list
+    uint64_t free_map[(BUDDY_NODES + 63) / 64];
+} buddy_pool_s;
+
+// Number of slots of the range of the main arena, which pools are placed in
+#define BUDDY_SLOTS (ARENA_RESERVE >> BUDDY_POOL_ORDER)
+
+// Base of the pool starting in each slot of 2^BUDDY_POOL_ORDER bytes of the
+// range of the main arena, nullptr if none. A pool is as large as a slot, so
+// an address belongs to the pool starting in its own slot or in the slot
+// before. Read without the lock of the main arena by buddy_owns(), so stale
+// entries only ever name pools which do not overlap the address
+static _Atomic(uint8_t *) pool_bases[BUDDY_SLOTS];
+
+// Pools with a free block of each level, and one bit per level with any pool
+static buddy_pool_s *level_pools[BUDDY_LEVELS];
+static uint32_t pool_levels = 0;
+
+static size_t pool_count = 0;
+
+static size_t node_of(size_t level, size_t index) {
+    return ((1UL << level) - 1) + index;
+}
+
+static size_t order_of(size_t level) { return BUDDY_POOL_ORDER - level; }
+
+static bool test_bit(const uint64_t *map, size_t node) {
+    return map[node / 64] & (1ULL << (node % 64));
+}
+
+static void set_bit(uint64_t *map, size_t node) {
+    map[node / 64] |= 1ULL << (node % 64);
+}
+
+static void clear_bit(uint64_t *map, size_t node) {
+    map[node / 64] &= ~(1ULL << (node % 64));
+}
+
+// Log2 of the block a request needs, at least BUDDY_MIN_ORDER
+static size_t order_for(size_t size) {
+    if (size <= (1UL << BUDDY_MIN_ORDER)) {
+        return BUDDY_MIN_ORDER;
+    }
+    return 64 - __builtin_clzll(size - 1);
+}
+
+static uint8_t *block_addr(buddy_pool_s *pool, size_t level, size_t index) {
+    return pool->base + (index << order_of(level));
+}
+
+static size_t slot_of(const uint8_t *addr) {
+    return (size_t)(addr - arena_main()->base) >> BUDDY_POOL_ORDER;
+}
+
+static buddy_pool_s *pool_at(uint8_t *base) {
+    return (buddy_pool_s *)(base - round_up(sizeof(buddy_pool_s), ALIGNMENT));
+}
+
+// Called once the free list of a level of the pool is no longer empty
+static void link_level(buddy_pool_s *pool, size_t level) {
+    pool->prev_free[level] = nullptr;
+    pool->next_free[level] = level_pools[level];
+
+    if (pool->next_free[level]) {
+        pool->next_free[level]->prev_free[level] = pool;
+    }
+
+    level_pools[level] = pool;
+    pool_levels |= 1U << level;
+}
+
+// Called once the free list of a level of the pool is empty
+static void unlink_level(buddy_pool_s *pool, size_t level) {
+    if (pool->prev_free[level]) {
+        pool->prev_free[level]->next_free[level] = pool->next_free[level];
+    } else {
+        ASSERT(level_pools[level] == pool);
+        level_pools[level] = pool->next_free[level];
+    }
+
+    if (pool->next_free[level]) {
+        pool->next_free[level]->prev_free[level] = pool->prev_free[level];
+    }
+
+    if (!level_pools[level]) {
+        pool_levels &= ~(1U << level);
+    }
+}
+
+// Puts a block into the free list of its level and marks it free
+static void push_free(buddy_pool_s *pool, size_t level, size_t index) {
+    buddy_block_s *block = (buddy_block_s *)block_addr(pool, level, index);
+
+    block->prev = nullptr;
+    block->next = pool->free_heads[level];
+
+    if (block->next) {
+        block->next->prev = block;
+    } else {
+        link_level(pool, level);
+    }
+
+    pool->free_heads[level] = block;
+    set_bit(pool->free_map, node_of(level, index));
+}
+
+// Takes a block out of the free list of its level and marks it used
+static void unlink_free(buddy_pool_s *pool, size_t level, size_t index) {
+    buddy_block_s *block = (buddy_block_s *)block_addr(pool, level, index);
+
+    if (block->prev) {
+        block->prev->next = block->next;
+    } else {
+        ASSERT(pool->free_heads[level] == block);
+        pool->free_heads[level] = block->next;
+    }
+
+    if (block->next) {
+        block->next->prev = block->prev;
+    }
+
+    if (!pool->free_heads[level]) {
+        unlink_level(pool, level);
+    }
+    clear_bit(pool->free_map, node_of(level, index));
+}
+
+// Allocates a new pool as a chunk of the segment list, with the whole pool
+// being a single free block
+static buddy_pool_s *create_pool() {
+    size_t size = round_up(sizeof(buddy_pool_s), ALIGNMENT) +
+                  (1UL << BUDDY_POOL_ORDER);
+
+    uint8_t *gap = find_free_seg(size);
+    if (!gap) {
+        return nullptr;
+    }
+
+    buddy_pool_s *pool = (buddy_pool_s *)add_entry(gap, size);
+    if (!pool) {
+        return nullptr;
+    }
+
+    pool->base = (uint8_t *)pool + round_up(sizeof(buddy_pool_s), ALIGNMENT);
+
+    for (size_t level = 0; level < BUDDY_LEVELS; level++) {
+        pool->free_heads[level] = nullptr;
+    }
+    for (size_t i = 0; i < (BUDDY_NODES + 63) / 64; i++) {
+        pool->split_map[i] = 0;
+        pool->free_map[i] = 0;
+    }
+
+    push_free(pool, 0, 0);
+
+    atomic_store_explicit(&pool_bases[slot_of(pool->base)], pool->base,
+                          memory_order_relaxed);
+    pool_count++;
+
+    return pool;
+}
+
+// Pools are chunks of the main arena, so only its range needs to be checked
+static buddy_pool_s *find_pool(const uint8_t *addr) {
+    arena_s *arena = arena_main();
+
+    if (!arena->base || addr < arena->base || addr >= arena->limit) {
+        return nullptr;
+    }
+
+    size_t slot = slot_of(addr);
+    uint8_t *base =
+        atomic_load_explicit(&pool_bases[slot], memory_order_relaxed);
+
+    if (base && addr >= base) {
+        return pool_at(base);
+    }
+
+    base = slot ? atomic_load_explicit(&pool_bases[slot - 1],
+                                       memory_order_relaxed) :
+                  nullptr;
+
+    if (base && addr < base + (1UL << BUDDY_POOL_ORDER)) {
+        return pool_at(base);
+    }
+
+    return nullptr;
+}
+
+// Follows the split bits from the whole pool down to the block starting at
+// addr. Every block not split any further is either free or allocated
+static size_t find_level(buddy_pool_s *pool, const uint8_t *addr) {
+    size_t offset = addr - pool->base;
+    size_t level = 0;
+
+    while (level < BUDDY_LEVELS - 1 &&
+           test_bit(pool->split_map,
+                    node_of(level, offset >> order_of(level)))) {
+        level++;
+    }
+
+    // A block always starts at a multiple of its size within the pool,
+    // otherwise addr has never been handed out
+    ASSERT(offset % (1UL << order_of(level)) == 0);
+
+    return level;
+}
+
+// Takes the smallest free block of at least the requested order of all pools.
+// The pool_levels bitmap tells right away which levels have free blocks in any
+// pool, then the block is split in halves until it has the right size, putting
+// the upper halves into the free lists
+uint8_t *buddy_alloc(size_t size) {
+
+    ASSERT(size <= BUDDY_MAX_SIZE);
+
+    size_t target = BUDDY_POOL_ORDER - order_for(size);
+
+    // Only levels up to the target level have large enough blocks
+    uint32_t mask = (2U << target) - 1;
+
+    if (!(pool_levels & mask) && !create_pool()) {
+        return nullptr;
+    }
+
+    // The deepest level with a free block has the smallest fitting block
+    size_t level = 31 - __builtin_clz(pool_levels & mask);
+    buddy_pool_s *pool = level_pools[level];
+    size_t index =
+        ((uint8_t *)pool->free_heads[level] - pool->base) >> order_of(level);
+
+    unlink_free(pool, level, index);
+
+    while (level < target) {
+        set_bit(pool->split_map, node_of(level, index));
+
+        level++;
+        index *= 2;
+
+        push_free(pool, level, index + 1);
+    }
+
+    return block_addr(pool, level, index);
+}
+
+// Merges the block with its buddy for as long as the buddy is free as well.
+// Checking the buddy is a single bit test
+void buddy_free(uint8_t *addr) {
+    buddy_pool_s *pool = find_pool(addr);
+
+    ASSERT(pool);
+
+    size_t level = find_level(pool, addr);
+    size_t index = (addr - pool->base) >> order_of(level);
+
+    // Freeing a block twice is a bug of the caller
+    ASSERT(!test_bit(pool->free_map, node_of(level, index)));
+
+    while (level > 0 && test_bit(pool->free_map, node_of(level, index ^ 1))) {
+        unlink_free(pool, level, index ^ 1);
+
+        level--;
+        index /= 2;
+
+        clear_bit(pool->split_map, node_of(level, index));
+    }
+
+    // The whole pool is free, give it back to the segment list unless it is
+    // the only one, to avoid creating it again on the next allocation
+    if (level == 0 && pool_count > 1) {
+        atomic_store_explicit(&pool_bases[slot_of(pool->base)], nullptr,
+                              memory_order_relaxed);
+        pool_count--;
+
+        remove_segment((uint8_t *)pool);
+        return;
+    }
+
+    push_free(pool, level, index);
+}
+
+bool buddy_owns(const uint8_t *addr) { return find_pool(addr); }
+
+size_t buddy_block_size(uint8_t *addr) {
+    buddy_pool_s *pool = find_pool(addr);
+
+    ASSERT(pool);
+
+    return 1UL << order_of(find_level(pool, addr));
+}
+
+size_t buddy_round_size(size_t size) { return 1UL << order_for(size); }
+
+void buddy_clear() {
+    for (size_t i = 0; i < BUDDY_SLOTS; i++) {
+        atomic_store_explicit(&pool_bases[i], nullptr, memory_order_relaxed);
+    }
+    for (size_t level = 0; level < BUDDY_LEVELS; level++) {
+        level_pools[level] = nullptr;
+    }
+    pool_levels = 0;
+    pool_count = 0;
+}
@@ -0,0 +1,368 @@
+#include "alloc/cpucache.h"
+#include "alloc/arena.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/types.h"
+
+#include <assert.h>
+#include <errno.h>
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+#include <sys/sysinfo.h>
+
+// The restartable sequences below are written for x86-64, and the rseq area
+// is only exported by glibc 2.35 and later, which comes with sys/rseq.h
+#if defined(__x86_64__) && __has_include(<sys/rseq.h>)
+#include <linux/membarrier.h>
+#include <sys/rseq.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+#define HAVE_RSEQ 1
+#else
+#define HAVE_RSEQ 0
+#endif
+
+// A bin is a stack of chunks which all have the same size rounded up to
+// ALIGNMENT, so any of them can serve any request of that bin. Like in the
+// per-thread caches, cached chunks stay allocated in the segment list. The
+// restartable sequences rely on this exact layout
+typedef struct cpucache_bin_s {
+    uint32_t count;                     /**< Number of chunks in the bin */
+    uint32_t limit;                     /**< Number of chunks allowed, 0 while
+                                           the caches are closed */
+    uint8_t *slots[CPUCACHE_BIN_SLOTS]; /**< Chunks, the last one on top */
+} cpucache_bin_s;
+
+static_assert(offsetof(cpucache_bin_s, limit) == 4, "limit at offset 4");
+static_assert(offsetof(cpucache_bin_s, slots) == 8, "slots at offset 8");
+
+// The cache of a CPU, a cache line aligned array of them is mapped on the first
+// call of set_cpucache_enabled()
+typedef struct cpucache_s {
+    cpucache_bin_s bins[CPUCACHE_BINS];
+} __attribute__((aligned(64))) cpucache_s;
+
+static atomic_bool g_cpucache_enabled = false;
+
+// The caches of all CPUs, and their number. Both never change once set
+static cpucache_s *caches = nullptr;
+static size_t num_cpus = 0;
+
+// Serializes enabling and disabling
+static pthread_mutex_t setup_lock = PTHREAD_MUTEX_INITIALIZER;
+
+static size_t bin_of(size_t size) {
+    return round_up(size, ALIGNMENT) / ALIGNMENT - 1;
+}
+
+#if HAVE_RSEQ
+
+// Each sequence below registers its descriptor in the rseq area of the thread,
+// reads the CPU the thread runs on and works on the bin of that CPU. Only the
+// last instruction of a sequence, the store of the new count, publishes
+// anything. If the kernel preempts or migrates the thread, or delivers a
+// signal, before that store, the thread continues at the abort handler, which
+// starts the sequence over. The abort handler is preceded by the signature
+// glibc registered the rseq area with. A CPU number beyond the caches, which
+// includes a thread without a registered rseq area, counts as an empty or full
+// bin, and so does a bin with a limit of 0
+
+static struct rseq *thread_rseq() {
+    return (struct rseq *)((uint8_t *)__builtin_thread_pointer() +
+                           __rseq_offset);
+}
+
+// Pops the top chunk of a bin of the current CPU. @p bin is the bin within the
+// cache of CPU 0
+static uint8_t *percpu_pop(cpucache_bin_s *bin) {
+    uint8_t *entry;
+
+    __asm__ __volatile__(
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0, 0\n\t"
+        ".quad 1f, 2f - 1f, 4f\n\t"
+        ".popsection\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long 0x53053053\n\t"
+        "4:\n\t"
+        "jmp 0f\n\t"
+        ".popsection\n\t"
+        "0:\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, 8(%[rseq])\n\t"
+        "1:\n\t"
+        "movl 4(%[rseq]), %%eax\n\t"
+        "cmpq %[cpus], %%rax\n\t"
+        "jae 5f\n\t"
+        "imulq %[stride], %%rax\n\t"
+        "addq %[bin], %%rax\n\t"
+        "cmpl $0, 4(%%rax)\n\t"
+        "je 5f\n\t"
+        "movl (%%rax), %%ecx\n\t"
+        "testl %%ecx, %%ecx\n\t"
+        "jz 5f\n\t"
+        "subl $1, %%ecx\n\t"
+        "movq 8(%%rax, %%rcx, 8), %[entry]\n\t"
+        "movl %%ecx, (%%rax)\n\t"
+        "2:\n\t"
+        "jmp 6f\n\t"
+        "5:\n\t"
+        "xorl %k[entry], %k[entry]\n\t"
+        "6:\n\t"
+        : [entry] "=&r"(entry)
+        : [rseq] "r"(thread_rseq()), [bin] "r"(bin),
+          [stride] "r"(sizeof(cpucache_s)), [cpus] "r"(num_cpus)
+        : "rax", "rcx", "cc", "memory");
+
+    return entry;
+}
+
+// Pushes a chunk onto a bin of the current CPU, unless the bin is full
+static bool percpu_push(cpucache_bin_s *bin, uint8_t *entry) {
+    uint32_t pushed;
+
+    __asm__ __volatile__(
+        ".pushsection __rseq_cs, \"aw\"\n\t"
+        ".balign 32\n\t"
+        "3:\n\t"
+        ".long 0, 0\n\t"
+        ".quad 1f, 2f - 1f, 4f\n\t"
+        ".popsection\n\t"
+        ".pushsection __rseq_failure, \"ax\"\n\t"
+        ".byte 0x0f, 0xb9, 0x3d\n\t"
+        ".long 0x53053053\n\t"
+        "4:\n\t"
+        "jmp 0f\n\t"
+        ".popsection\n\t"
+        "0:\n\t"
+        "leaq 3b(%%rip), %%rax\n\t"
+        "movq %%rax, 8(%[rseq])\n\t"
+        "1:\n\t"
+        "movl 4(%[rseq]), %%eax\n\t"
+        "cmpq %[cpus], %%rax\n\t"
+        "jae 5f\n\t"
+        "imulq %[stride], %%rax\n\t"
+        "addq %[bin], %%rax\n\t"
+        "movl (%%rax), %%ecx\n\t"
+        "cmpl 4(%%rax), %%ecx\n\t"
+        "jae 5f\n\t"
+        "movq %[entry], 8(%%rax, %%rcx, 8)\n\t"
+        "addl $1, %%ecx\n\t"
+        "movl %%ecx, (%%rax)\n\t"
+        "2:\n\t"
+        "movl $1, %[pushed]\n\t"
+        "jmp 6f\n\t"
+        "5:\n\t"
+        "xorl %[pushed], %[pushed]\n\t"
+        "6:\n\t"
+        : [pushed] "=&r"(pushed)
+        : [rseq] "r"(thread_rseq()), [bin] "r"(bin), [entry] "r"(entry),
+          [stride] "r"(sizeof(cpucache_s)), [cpus] "r"(num_cpus)
+        : "rax", "rcx", "cc", "memory");
+
+    return pushed;
+}
+
+// The C library registers an rseq area for each thread, unless disabled with
+// the glibc.pthread.rseq tunable or refused by the kernel. Closing the caches
+// also needs the rseq fence of membarrier(), which the process registers for
+// once
+static bool rseq_available() {
+    static bool registered = false;
+
+    if (!registered &&
+        !syscall(SYS_membarrier,
+                 MEMBARRIER_CMD_REGISTER_PRIVATE_EXPEDITED_RSEQ, 0, 0)) {
+        registered = true;
+    }
+
+    return registered && __rseq_size > 0 && thread_rseq()->cpu_id < num_cpus;
+}
+
+// Restarts the sequences running on all other CPUs. Afterwards, every
+// sequence reads the bins as they are now
+static int rseq_fence() {
+    return (int)syscall(SYS_membarrier, MEMBARRIER_CMD_PRIVATE_EXPEDITED_RSEQ,
+                        0, 0);
+}
+
+#else
+
+static uint8_t *percpu_pop(cpucache_bin_s *bin) { return nullptr; }
+
+static bool percpu_push(cpucache_bin_s *bin, uint8_t *entry) { return false; }
+
+static bool rseq_available() { return false; }
+
+static int rseq_fence() { return 0; }
+
+#endif
+
+// Give chunks taken from a cache back to the segment list. They mostly belong
+// to the same arena, whose lock is then taken only once for all of them
+static void give_back(uint8_t **entries, size_t count) {
+    arena_s *locked = nullptr;
+
+    for (size_t i = 0; i < count; i++) {
+        arena_s *arena = arena_of(entries[i]);
+        if (arena != locked) {
+            if (locked) {
+                arena_unlock(locked);
+            }
+            arena_lock(arena);
+            locked = arena;
+        }
+
+        remove_segment(entries[i]);
+    }
+
+    if (locked) {
+        arena_unlock(locked);
+    }
+}
+
+// Take up to count chunks off a bin of the current CPU and give them back
+static void flush_bin(size_t bin, size_t count) {
+    uint8_t *entries[CPUCACHE_BIN_SLOTS];
+    size_t taken = 0;
+
+    while (taken < count &&
+           (entries[taken] = percpu_pop(&caches[0].bins[bin]))) {
+        taken++;
+    }
+
+    give_back(entries, taken);
+}
+
+// Opens the bins of all caches with their limits, or closes them with a limit
+// of 0. Each bin holds at most CPUCACHE_BIN_BYTES, but at least two chunks
+static void set_limits(bool open) {
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+        for (size_t bin = 0; bin < CPUCACHE_BINS; bin++) {
+            size_t limit = CPUCACHE_BIN_BYTES / ((bin + 1) * ALIGNMENT);
+            limit = limit > CPUCACHE_BIN_SLOTS ? CPUCACHE_BIN_SLOTS :
+                    limit < 2                  ? 2 :
+                                                 limit;
+
+            caches[cpu].bins[bin].limit = open ? limit : 0;
+        }
+    }
+}
+
+// Give back the chunks of all caches from the calling thread, wherever it
+// runs. Once all bins are closed and the fence has restarted every sequence
+// which might still have read an open bin, no thread pushes or pops anymore,
+// including threads which checked get_cpucache_enabled() before the caches
+// were disabled. The bins then belong to the calling thread alone
+static void flush_all() {
+    set_limits(false);
+
+    if (rseq_fence()) {
+        pr_error("membarrier error: %s", strerror(errno));
+        return;
+    }
+
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+        for (size_t bin = 0; bin < CPUCACHE_BINS; bin++) {
+            cpucache_bin_s *closed = &caches[cpu].bins[bin];
+
+            give_back(closed->slots, closed->count);
+            closed->count = 0;
+        }
+    }
+}
+
+// Maps the caches of all CPUs, closed until enabled
+static int map_caches() {
+    size_t cpus = get_nprocs_conf();
+
+    cpucache_s *mapped =
+        mmap(nullptr, cpus * sizeof(cpucache_s), PROT_READ | PROT_WRITE,
+             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (mapped == MAP_FAILED) {
+        pr_error("mmap error: %s", strerror(errno));
+        return ERROR;
+    }
+
+    caches = mapped;
+    num_cpus = cpus;
+
+    return SUCCESS;
+}
+
+int set_cpucache_enabled(bool enabled) {
+    int status = SUCCESS;
+
+    pthread_mutex_lock(&setup_lock);
+
+    if (enabled) {
+        if (!caches && map_caches() == ERROR) {
+            status = ERROR;
+        } else if (!rseq_available()) {
+            pr_error("Restartable sequences not available");
+            status = ERROR;
+        } else {
+            set_limits(true);
+            atomic_store(&g_cpucache_enabled, true);
+        }
+    } else if (atomic_exchange(&g_cpucache_enabled, false)) {
+        flush_all();
+    }
+
+    pthread_mutex_unlock(&setup_lock);
+
+    return status;
+}
+
+bool get_cpucache_enabled() { return atomic_load(&g_cpucache_enabled); }
+
+uint8_t *cpucache_get(size_t size) {
+    uint8_t *entry = percpu_pop(&caches[0].bins[bin_of(size)]);
+
+    if (!entry) {
+        return nullptr;
+    }
+
+    // The size stays within the same multiple of ALIGNMENT, so the tail of
+    // the chunk does not move
+    set_head_size((seg_head_s *)(entry - sizeof(seg_head_s)), size);
+
+    return entry;
+}
+
+bool cpucache_put(uint8_t *addr) {
+    size_t size = head_size((seg_head_s *)(addr - sizeof(seg_head_s)));
+
+    if (size > CPUCACHE_MAX_SIZE) {
+        return false;
+    }
+
+    cpucache_bin_s *bin = &caches[0].bins[bin_of(size)];
+
+    if (percpu_push(bin, addr)) {
+        return true;
+    }
+
+    // The bin is full, or the thread has no rseq area. Half of the bin goes
+    // back to the segment list before trying once more. All CPUs have the
+    // same limits
+    flush_bin(bin_of(size), bin->limit / 2);
+
+    return percpu_push(bin, addr);
+}
+
+void cpucache_clear() {
+    for (size_t cpu = 0; cpu < num_cpus; cpu++) {
+        for (size_t bin = 0; bin < CPUCACHE_BINS; bin++) {
+            caches[cpu].bins[bin].count = 0;
+        }
+    }
+}
@@ -0,0 +1,102 @@
+#include "alloc/free_log.h"
+#include "alloc/methods.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// The log of a thread. Pointers are appended in the order they are freed and
+// sorted by julmalloc_free_batch() when flushed
+typedef struct free_log_s {
+    void *ptrs[FREE_LOG_SIZE]; /**< Pointers freed but not given back yet */
+    size_t count;              /**< Number of pointers in the log */
+    size_t generation;         /**< g_generation the pointers belong to */
+    bool registered;           /**< Flushed on thread exit */
+} free_log_s;
+
+static atomic_bool g_free_log_enabled = false;
+
+// Bumped whenever the storage table is reset. Logs of an older generation hold
+// pointers to chunks which do not exist anymore
+static atomic_size_t g_generation = 0;
+
+static pthread_key_t free_log_key;
+static pthread_once_t free_log_key_once = PTHREAD_ONCE_INIT;
+
+// Like the per-thread caches, the log lives in the static TLS block of the
+// thread, so accessing it never allocates itself
+static thread_local free_log_s free_log
+    __attribute__((tls_model("initial-exec")));
+
+// Drop all pointers of a log if the storage table has been reset since they
+// were logged
+static void check_generation(free_log_s *log) {
+    size_t generation = atomic_load(&g_generation);
+
+    if (log->generation != generation) {
+        log->count = 0;
+        log->generation = generation;
+    }
+}
+
+static void flush_log(free_log_s *log) {
+    check_generation(log);
+
+    size_t count = log->count;
+    log->count = 0;
+
+    if (!count) {
+        return;
+    }
+
+    julmalloc_free_batch(log->ptrs, count);
+}
+
+// Destructor of free_log_key, called on thread exit with the log of the thread
+static void flush_on_exit(void *log) { flush_log((free_log_s *)log); }
+
+static void create_key() {
+    pthread_key_create(&free_log_key, &flush_on_exit);
+}
+
+void set_free_log_enabled(bool enabled) {
+    atomic_store(&g_free_log_enabled, enabled);
+
+    if (!enabled) {
+        free_log_flush();
+    }
+}
+
+bool get_free_log_enabled() { return atomic_load(&g_free_log_enabled); }
+
+void free_log_put(uint8_t *addr) {
+    check_generation(&free_log);
+
+    // The log is flushed on thread exit by the destructor of free_log_key,
+    // which is only called for threads which have set a value for it
+    if (!free_log.registered) {
+        pthread_once(&free_log_key_once, &create_key);
+        pthread_setspecific(free_log_key, &free_log);
+        free_log.registered = true;
+    }
+
+    free_log.ptrs[free_log.count++] = addr;
+
+    if (free_log.count == FREE_LOG_SIZE) {
+        flush_log(&free_log);
+    }
+}
+
+void free_log_flush() { flush_log(&free_log); }
+
+void free_log_flush_disabled() {
+    if (free_log.count && !atomic_load(&g_free_log_enabled)) {
+        flush_log(&free_log);
+    }
+}
+
+void free_log_clear() {
+    atomic_fetch_add(&g_generation, 1);
+    check_generation(&free_log);
+}
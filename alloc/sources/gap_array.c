@@ -0,0 +1,499 @@
+#include "alloc/gap_array.h"
+#include "alloc/arena.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/types.h"
+
+#include <errno.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+#ifdef __SSE2__
+#include <immintrin.h>
+#endif
+
+//! Number of blocks the array has room for when it is first mapped
+#define GAP_ARRAY_INITIAL 16
+
+// Gaps of a block, sorted by address. Blocks are never empty while in use
+typedef struct gap_block_s {
+    uintptr_t tails[GAP_BLOCK]; /**< Address of the tail in front of each gap */
+    uint32_t sizes[GAP_BLOCK];  /**< free_following of each tail, at most
+                                   UINT32_MAX */
+    uint32_t count;             /**< Number of gaps in the block */
+    uint32_t max;               /**< Largest size of the block */
+} gap_block_s;
+
+// Position of a gap, the block in address order and the gap within it
+typedef struct gap_pos_s {
+    size_t block; /**< Index into order, used for positions behind all gaps */
+    size_t index; /**< Index into the block */
+} gap_pos_s;
+
+static size_t mapping_size(size_t capacity) {
+    return capacity * (sizeof(gap_block_s) + 2 * sizeof(uint32_t));
+}
+
+// Two neighboring blocks together always hold more than GAP_BLOCK / 2 gaps,
+// see gap_array_remove(). So n gaps never need more than 4n / GAP_BLOCK + 1
+// blocks
+static size_t blocks_for(size_t count) {
+    return count / (GAP_BLOCK / 4) + 2;
+}
+
+// Doubles the capacity until blocks for count gaps fit, by mapping a new array
+// and moving the blocks over. This happens before any gap is linked, see
+// gap_reserve(), so if the mapping fails, the old array is kept as it is and
+// the caller refuses to place the chunk
+static bool gap_array_reserve(size_t count) {
+    gap_array_s *gaps = &g_arena->gaps;
+
+    if (blocks_for(count) <= gaps->capacity) {
+        return true;
+    }
+
+    size_t capacity = gaps->capacity ? gaps->capacity : GAP_ARRAY_INITIAL;
+    while (capacity < blocks_for(count)) {
+        capacity *= 2;
+    }
+
+    uint8_t *map = mmap(nullptr, mapping_size(capacity), PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        pr_warning("mmap error: %s", strerror(errno));
+        return false;
+    }
+
+    gap_block_s *blocks = (gap_block_s *)map;
+    uint32_t *order = (uint32_t *)(map + capacity * sizeof(gap_block_s));
+    uint32_t *spare = order + capacity;
+
+    if (gaps->capacity) {
+        memcpy(blocks, gaps->blocks, gaps->capacity * sizeof(*blocks));
+        memcpy(order, gaps->order, gaps->used * sizeof(*order));
+        memcpy(spare, gaps->spare, gaps->spares * sizeof(*spare));
+        munmap(gaps->blocks, mapping_size(gaps->capacity));
+    }
+
+    for (size_t i = gaps->capacity; i < capacity; i++) {
+        spare[gaps->spares++] = (uint32_t)i;
+    }
+
+    gaps->blocks = blocks;
+    gaps->order = order;
+    gaps->spare = spare;
+    gaps->capacity = capacity;
+
+    return true;
+}
+
+static gap_block_s *block_at(gap_array_s *gaps, size_t k) {
+    return &gaps->blocks[gaps->order[k]];
+}
+
+static uint32_t block_max(const gap_block_s *block) {
+    uint32_t max = 0;
+
+    for (size_t i = 0; i < block->count; i++) {
+        max = block->sizes[i] > max ? block->sizes[i] : max;
+    }
+
+    return max;
+}
+
+// Position of the first gap whose tail is at or after addr, {used, 0} if there
+// is none. The block is found by the first tail of each block, then the gap
+// within the block
+static gap_pos_s lower_bound(uintptr_t addr) {
+    gap_array_s *gaps = &g_arena->gaps;
+    size_t low = 0;
+    size_t high = gaps->used;
+
+    while (low < high) {
+        size_t mid = low + (high - low) / 2;
+        if (block_at(gaps, mid)->tails[0] < addr) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    if (!low) {
+        return (gap_pos_s){};
+    }
+
+    gap_block_s *block = block_at(gaps, low - 1);
+    size_t first = 0;
+    size_t last = block->count;
+
+    while (first < last) {
+        size_t mid = first + (last - first) / 2;
+        if (block->tails[mid] < addr) {
+            first = mid + 1;
+        } else {
+            last = mid;
+        }
+    }
+
+    if (first == block->count) {
+        return (gap_pos_s){.block = low};
+    }
+    return (gap_pos_s){.block = low - 1, .index = first};
+}
+
+static size_t scan_scalar(const uint32_t *sizes, size_t i, size_t end,
+                          uint32_t need) {
+    while (i < end && sizes[i] < need) {
+        i++;
+    }
+    return i;
+}
+
+#ifdef __SSE2__
+// SSE2 only compares signed integers. Flipping the sign bit of both sides maps
+// the unsigned order onto the signed one, and sizes[i] >= need becomes
+// sizes[i] > need - 1, need is never 0
+static size_t scan_sse2(const uint32_t *sizes, size_t i, size_t end,
+                        uint32_t need) {
+    __m128i bias = _mm_set1_epi32(INT32_MIN);
+    __m128i limit = _mm_set1_epi32((int32_t)((need - 1) ^ 0x80000000u));
+
+    for (; i + 4 <= end; i += 4) {
+        __m128i v = _mm_loadu_si128((const __m128i *)(sizes + i));
+        __m128i fits = _mm_cmpgt_epi32(_mm_xor_si128(v, bias), limit);
+        int mask = _mm_movemask_ps(_mm_castsi128_ps(fits));
+
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return scan_scalar(sizes, i, end, need);
+}
+#endif
+
+#ifdef __x86_64__
+// Same as scan_sse2, eight sizes at a time. Only called if the CPU supports
+// AVX2, the rest of the library is built for the baseline instruction set
+__attribute__((target("avx2"))) static size_t
+scan_avx2(const uint32_t *sizes, size_t i, size_t end, uint32_t need) {
+    __m256i bias = _mm256_set1_epi32(INT32_MIN);
+    __m256i limit = _mm256_set1_epi32((int32_t)((need - 1) ^ 0x80000000u));
+
+    for (; i + 8 <= end; i += 8) {
+        __m256i v = _mm256_loadu_si256((const __m256i *)(sizes + i));
+        __m256i fits = _mm256_cmpgt_epi32(_mm256_xor_si256(v, bias), limit);
+        int mask = _mm256_movemask_ps(_mm256_castsi256_ps(fits));
+
+        if (mask) {
+            return i + __builtin_ctz(mask);
+        }
+    }
+
+    return scan_sse2(sizes, i, end, need);
+}
+#endif
+
+// Position of the first size of at least need within [i, end), end if there is
+// none
+static size_t scan(const uint32_t *sizes, size_t i, size_t end,
+                   uint32_t need) {
+#ifdef __x86_64__
+    // malloc may be called before the constructors of the C runtime ran, so
+    // the CPU model is initialized here explicitly
+    static int has_avx2 = -1;
+    if (has_avx2 < 0) {
+        __builtin_cpu_init();
+        has_avx2 = __builtin_cpu_supports("avx2");
+    }
+    if (has_avx2) {
+        return scan_avx2(sizes, i, end, need);
+    }
+#endif
+#ifdef __SSE2__
+    return scan_sse2(sizes, i, end, need);
+#else
+    return scan_scalar(sizes, i, end, need);
+#endif
+}
+
+// Takes a spare block and puts it into order at position k
+static gap_block_s *add_block(gap_array_s *gaps, size_t k) {
+    // Room for the blocks of every gap has been reserved before
+    ASSERT(gaps->spares);
+
+    uint32_t index = gaps->spare[--gaps->spares];
+
+    memmove(gaps->order + k + 1, gaps->order + k,
+            (gaps->used - k) * sizeof(*gaps->order));
+    gaps->order[k] = index;
+    gaps->used++;
+
+    gaps->blocks[index].count = 0;
+    gaps->blocks[index].max = 0;
+
+    return &gaps->blocks[index];
+}
+
+// Takes the block at position k out of order. Only the indices of the blocks
+// are moved, never their gaps
+static void drop_block(gap_array_s *gaps, size_t k) {
+    gaps->spare[gaps->spares++] = gaps->order[k];
+
+    gaps->used--;
+    memmove(gaps->order + k, gaps->order + k + 1,
+            (gaps->used - k) * sizeof(*gaps->order));
+}
+
+// Moves the upper half of the full block at position k into a new block
+// behind it
+static void split_block(gap_array_s *gaps, size_t k) {
+    gap_block_s *upper = add_block(gaps, k + 1);
+    gap_block_s *lower = block_at(gaps, k);
+
+    upper->count = GAP_BLOCK / 2;
+    memcpy(upper->tails, lower->tails + GAP_BLOCK / 2,
+           upper->count * sizeof(*upper->tails));
+    memcpy(upper->sizes, lower->sizes + GAP_BLOCK / 2,
+           upper->count * sizeof(*upper->sizes));
+    upper->max = block_max(upper);
+
+    lower->count = GAP_BLOCK / 2;
+    lower->max = block_max(lower);
+}
+
+// Appends the gaps of the block at position k + 1 to the block at position k
+static void merge_blocks(gap_array_s *gaps, size_t k) {
+    gap_block_s *lower = block_at(gaps, k);
+    gap_block_s *upper = block_at(gaps, k + 1);
+
+    memcpy(lower->tails + lower->count, upper->tails,
+           upper->count * sizeof(*upper->tails));
+    memcpy(lower->sizes + lower->count, upper->sizes,
+           upper->count * sizeof(*upper->sizes));
+    lower->count += upper->count;
+    lower->max = upper->max > lower->max ? upper->max : lower->max;
+
+    drop_block(gaps, k + 1);
+}
+
+// A gap in front of the first gap of a block goes into that block, one behind
+// all gaps into the last block. A full block is split first
+static void gap_array_insert(seg_tail_s *tail) {
+    gap_array_s *gaps = &g_arena->gaps;
+    gap_pos_s pos = lower_bound((uintptr_t)tail);
+
+    if (!gaps->used) {
+        add_block(gaps, 0);
+    } else if (pos.block == gaps->used) {
+        pos.block = gaps->used - 1;
+        pos.index = block_at(gaps, pos.block)->count;
+    }
+
+    gap_block_s *block = block_at(gaps, pos.block);
+
+    // A gap must not be linked twice
+    ASSERT(pos.index == block->count ||
+           block->tails[pos.index] != (uintptr_t)tail);
+
+    if (block->count == GAP_BLOCK) {
+        split_block(gaps, pos.block);
+        if (pos.index > GAP_BLOCK / 2) {
+            pos.index -= GAP_BLOCK / 2;
+            block = block_at(gaps, ++pos.block);
+        }
+    }
+
+    size_t i = pos.index;
+    uint32_t size = tail_free(tail) < UINT32_MAX ? tail_free(tail) : UINT32_MAX;
+
+    memmove(block->tails + i + 1, block->tails + i,
+            (block->count - i) * sizeof(*block->tails));
+    memmove(block->sizes + i + 1, block->sizes + i,
+            (block->count - i) * sizeof(*block->sizes));
+
+    block->tails[i] = (uintptr_t)tail;
+    block->sizes[i] = size;
+    block->count++;
+    block->max = size > block->max ? size : block->max;
+    gaps->count++;
+}
+
+// Neighboring blocks holding at most GAP_BLOCK / 2 gaps together are merged,
+// which bounds the number of blocks, see blocks_for()
+static void gap_array_remove(seg_tail_s *tail) {
+    gap_array_s *gaps = &g_arena->gaps;
+    gap_pos_s pos = lower_bound((uintptr_t)tail);
+
+    // The gap has to be in the array, otherwise linking and unlinking got out
+    // of sync somewhere
+    ASSERT(pos.block < gaps->used &&
+           block_at(gaps, pos.block)->tails[pos.index] == (uintptr_t)tail);
+
+    size_t k = pos.block;
+    size_t i = pos.index;
+    gap_block_s *block = block_at(gaps, k);
+    uint32_t size = block->sizes[i];
+
+    block->count--;
+    gaps->count--;
+
+    memmove(block->tails + i, block->tails + i + 1,
+            (block->count - i) * sizeof(*block->tails));
+    memmove(block->sizes + i, block->sizes + i + 1,
+            (block->count - i) * sizeof(*block->sizes));
+
+    if (size == block->max) {
+        block->max = block_max(block);
+    }
+
+    if (!block->count) {
+        drop_block(gaps, k);
+    } else if (k && block_at(gaps, k - 1)->count + block->count <=
+                        GAP_BLOCK / 2) {
+        merge_blocks(gaps, k - 1);
+    } else if (k + 1 < gaps->used &&
+               block->count + block_at(gaps, k + 1)->count <= GAP_BLOCK / 2) {
+        merge_blocks(gaps, k);
+    }
+}
+
+size_t gap_array_steps() { return g_arena->gaps.steps; }
+
+// The mapping is kept for the next gaps
+static void gap_array_clear() {
+    gap_array_s *gaps = &g_arena->gaps;
+
+    while (gaps->used) {
+        drop_block(gaps, gaps->used - 1);
+    }
+    gaps->count = 0;
+}
+
+const gap_index_s gap_array_index = {
+    .insert = &gap_array_insert,
+    .remove = &gap_array_remove,
+    .clear = &gap_array_clear,
+    .reserve = &gap_array_reserve,
+};
+
+// Range of gaps of the block at position k within [from, to)
+static void block_range(gap_pos_s from, gap_pos_s to, size_t k, size_t *i,
+                        size_t *end) {
+    *i = k == from.block ? from.index : 0;
+    *end = k == to.block ? to.index : block_at(&g_arena->gaps, k)->count;
+}
+
+seg_tail_s *gap_array_find(const seg_tail_s *from, const seg_tail_s *to,
+                           size_t total_size) {
+    gap_array_s *gaps = &g_arena->gaps;
+    gap_pos_s first = from ? lower_bound((uintptr_t)from) : (gap_pos_s){};
+    gap_pos_s last =
+        to ? lower_bound((uintptr_t)to) : (gap_pos_s){.block = gaps->used};
+
+    uint32_t need = total_size < UINT32_MAX ? total_size : UINT32_MAX;
+
+    ASSERT(need);
+
+    for (size_t k = first.block; k <= last.block && k < gaps->used; k++) {
+        gap_block_s *block = block_at(gaps, k);
+        size_t i;
+        size_t end;
+
+        block_range(first, last, k, &i, &end);
+        if (i >= end) {
+            continue;
+        }
+
+        // The largest size rules out the whole block at once
+        if (block->max < need) {
+            gaps->steps++;
+            continue;
+        }
+
+        size_t begin = i;
+
+        for (i = scan(block->sizes, i, end, need); i < end;
+             i = scan(block->sizes, i + 1, end, need)) {
+
+            // Sizes of 4 GiB and more are all stored as UINT32_MAX. Only for
+            // requests of that size, the tail itself has to be checked
+            if (need < UINT32_MAX ||
+                tail_free((seg_tail_s *)block->tails[i]) >= total_size) {
+                gaps->steps += i + 1 - begin;
+                return (seg_tail_s *)block->tails[i];
+            }
+        }
+
+        gaps->steps += end - begin;
+    }
+
+    return nullptr;
+}
+
+// The fitting gaps are found with the same scan as in gap_array_find, only the
+// sizes of those are compared. An exact fit can't be beaten, the search stops
+// there
+seg_tail_s *gap_array_good(const seg_tail_s *from, const seg_tail_s *to,
+                           size_t total_size, size_t *candidates) {
+    gap_array_s *gaps = &g_arena->gaps;
+    gap_pos_s first = from ? lower_bound((uintptr_t)from) : (gap_pos_s){};
+    gap_pos_s last =
+        to ? lower_bound((uintptr_t)to) : (gap_pos_s){.block = gaps->used};
+
+    uint32_t need = total_size < UINT32_MAX ? total_size : UINT32_MAX;
+
+    ASSERT(need);
+
+    gap_block_s *best = nullptr;
+    size_t best_index = 0;
+
+    if (!*candidates) {
+        return nullptr;
+    }
+
+    for (size_t k = first.block; k <= last.block && k < gaps->used; k++) {
+        gap_block_s *block = block_at(gaps, k);
+        size_t i;
+        size_t end;
+
+        block_range(first, last, k, &i, &end);
+        if (i >= end) {
+            continue;
+        }
+
+        if (block->max < need) {
+            gaps->steps++;
+            continue;
+        }
+
+        size_t begin = i;
+
+        for (i = scan(block->sizes, i, end, need); i < end;
+             i = scan(block->sizes, i + 1, end, need)) {
+
+            if (need == UINT32_MAX &&
+                tail_free((seg_tail_s *)block->tails[i]) < total_size) {
+                continue;
+            }
+
+            (*candidates)--;
+
+            if (!best || block->sizes[i] < best->sizes[best_index]) {
+                best = block;
+                best_index = i;
+            }
+
+            if (!*candidates || best->sizes[best_index] == need) {
+                gaps->steps += i + 1 - begin;
+                return (seg_tail_s *)best->tails[best_index];
+            }
+        }
+
+        gaps->steps += end - begin;
+    }
+
+    return best ? (seg_tail_s *)best->tails[best_index] : nullptr;
+}
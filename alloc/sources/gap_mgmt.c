@@ -0,0 +1,114 @@
+#include "alloc/gap_mgmt.h"
+#include "alloc/arena.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/gap_array.h"
+#include "alloc/gap_tree.h"
+#include "alloc/seg_classes.h"
+#include "alloc/tlsf.h"
+#include "alloc/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// The gap index of the current allocation strategy and the sum of the sizes of
+// all indexed gaps are kept per arena, see arena.h. Strategies which walk the
+// segment list themselves don't need an index, in this case it is nullptr
+
+// Only gaps a chunk fits into are indexed. Whether a gap is indexed or not is
+// thus decided by the free_following value, which is why this value must not
+// change between linking and unlinking
+void gap_link(seg_tail_s *tail) {
+    arena_s *arena = g_arena;
+
+    if (arena->gap_index && tail_free(tail) >= MIN_GAP_SIZE) {
+        arena->gap_index->insert(tail);
+        arena->gap_bytes += tail_free(tail);
+    }
+}
+
+void gap_unlink(seg_tail_s *tail) {
+    arena_s *arena = g_arena;
+
+    if (arena->gap_index && tail_free(tail) >= MIN_GAP_SIZE) {
+        arena->gap_index->remove(tail);
+        arena->gap_bytes -= tail_free(tail);
+    }
+}
+
+int gap_reserve(size_t count) {
+    const gap_index_s *gap_index = g_arena->gap_index;
+
+    if (gap_index && gap_index->reserve && !gap_index->reserve(count)) {
+        return ERROR;
+    }
+    return SUCCESS;
+}
+
+size_t gap_bytes() { return g_arena->gap_bytes; }
+
+const gap_index_s *get_gap_index() { return g_arena->gap_index; }
+
+void gap_clear() {
+    if (g_arena->gap_index) {
+        g_arena->gap_index->clear();
+    }
+    g_arena->gap_bytes = 0;
+}
+
+// Switches the gap index. Only the index of the strategy in use is maintained,
+// so it has to be rebuilt from scratch by walking all tails once
+void set_gap_index(sched_strat_e strat, seg_list_head_s *list) {
+
+    // Drop the old index first, its bookkeeping inside of the gaps is simply
+    // overwritten by the new one
+    gap_clear();
+
+    const gap_index_s *gap_index;
+
+    switch (strat) {
+    case NEXT_FIT:
+    case GOOD_FIT:
+        gap_index = &gap_array_index;
+        break;
+    case FIRST_FIT:
+    case WORST_FIT:
+    case BUDDY:
+        gap_index = &addr_tree_index;
+        break;
+    case BEST_FIT:
+        gap_index = &size_tree_index;
+        break;
+    case SEGREGATED_FIT:
+        gap_index = &seg_class_index;
+        break;
+    case TLSF_FIT:
+        gap_index = &tlsf_index;
+        break;
+    default:
+        gap_index = nullptr;
+        break;
+    }
+
+    g_arena->gap_index = gap_index;
+
+    if (!gap_index || !list || !list->first_seg) {
+        return;
+    }
+
+    // Without room for all gaps, no index is kept at all, and the strategies
+    // walk the table instead
+    if (gap_reserve(g_arena->chunks)) {
+        pr_warning("No room for %zu gaps, walking the table", g_arena->chunks);
+        g_arena->gap_index = nullptr;
+        return;
+    }
+
+    // Walk over all tails in the same fashion the strategies do
+    seg_tail_s *iter = head_next_tail(list->first_seg);
+
+    do {
+        gap_link(iter);
+        iter = head_next_tail(tail_next_head(iter));
+    } while ((uint8_t *)head_prev_tail(tail_prev_head(iter)) < (uint8_t *)iter);
+}
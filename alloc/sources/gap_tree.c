@@ -0,0 +1,307 @@
+#include "alloc/gap_tree.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// Tree node of a gap. Like the list nodes of the size classes, the node is
+// stored right at the beginning of the gap itself, which has at least
+// MIN_GAP_SIZE free bytes
+typedef struct gap_tree_node_s {
+    seg_tail_s *left;  /**< Tail of the gap at the root of the left subtree */
+    seg_tail_s *right; /**< Tail of the gap at the root of the right subtree */
+    size_t height;     /**< Height of the subtree, 1 for a leaf */
+    size_t max_gap;    /**< Largest free_following within the subtree */
+} gap_tree_node_s;
+
+// An AVL tree of gaps. The nodes are identified by the tails in front of the
+// gaps, compare defines the order of the tree
+typedef struct gap_tree_s {
+    seg_tail_s *root; /**< Tail of the gap at the root, nullptr if empty */
+    int (*compare)(const seg_tail_s *, const seg_tail_s *); /**< Order */
+} gap_tree_s;
+
+static gap_tree_node_s *node_of(seg_tail_s *tail) {
+    return (gap_tree_node_s *)((uint8_t *)tail + sizeof(*tail));
+}
+
+static size_t height(seg_tail_s *tail) {
+    return tail ? node_of(tail)->height : 0;
+}
+
+static size_t max_gap(seg_tail_s *tail) {
+    return tail ? node_of(tail)->max_gap : 0;
+}
+
+// Recomputes height and largest gap of a subtree from its children. Needs to be
+// called bottom-up whenever the children of a node change
+static void update(seg_tail_s *tail) {
+    gap_tree_node_s *node = node_of(tail);
+
+    size_t left = height(node->left);
+    size_t right = height(node->right);
+
+    node->height = (left > right ? left : right) + 1;
+
+    node->max_gap = tail_free(tail);
+    if (max_gap(node->left) > node->max_gap) {
+        node->max_gap = max_gap(node->left);
+    }
+    if (max_gap(node->right) > node->max_gap) {
+        node->max_gap = max_gap(node->right);
+    }
+}
+
+static seg_tail_s *rotate_right(seg_tail_s *tail) {
+    seg_tail_s *left = node_of(tail)->left;
+
+    node_of(tail)->left = node_of(left)->right;
+    node_of(left)->right = tail;
+
+    update(tail);
+    update(left);
+
+    return left;
+}
+
+static seg_tail_s *rotate_left(seg_tail_s *tail) {
+    seg_tail_s *right = node_of(tail)->right;
+
+    node_of(tail)->right = node_of(right)->left;
+    node_of(right)->left = tail;
+
+    update(tail);
+    update(right);
+
+    return right;
+}
+
+// Restores the AVL property of a subtree whose children differ in height by at
+// most two, and returns the new root of the subtree
+static seg_tail_s *rebalance(seg_tail_s *tail) {
+    gap_tree_node_s *node = node_of(tail);
+
+    update(tail);
+
+    if (height(node->left) > height(node->right) + 1) {
+
+        // Left-right case, rotate the left child first
+        if (height(node_of(node->left)->right) >
+            height(node_of(node->left)->left)) {
+            node->left = rotate_left(node->left);
+        }
+        return rotate_right(tail);
+    }
+
+    if (height(node->right) > height(node->left) + 1) {
+
+        // Right-left case, rotate the right child first
+        if (height(node_of(node->right)->left) >
+            height(node_of(node->right)->right)) {
+            node->right = rotate_right(node->right);
+        }
+        return rotate_left(tail);
+    }
+
+    return tail;
+}
+
+static seg_tail_s *insert_rec(gap_tree_s *tree, seg_tail_s *root,
+                              seg_tail_s *tail) {
+    if (!root) {
+        node_of(tail)->left = nullptr;
+        node_of(tail)->right = nullptr;
+        node_of(tail)->height = 1;
+        node_of(tail)->max_gap = tail_free(tail);
+        return tail;
+    }
+
+    if (tree->compare(tail, root) < 0) {
+        node_of(root)->left = insert_rec(tree, node_of(root)->left, tail);
+    } else {
+        node_of(root)->right = insert_rec(tree, node_of(root)->right, tail);
+    }
+
+    return rebalance(root);
+}
+
+// Unlinks the leftmost gap of a subtree, which is returned through min
+static seg_tail_s *remove_min_rec(seg_tail_s *root, seg_tail_s **min) {
+    if (!node_of(root)->left) {
+        *min = root;
+        return node_of(root)->right;
+    }
+
+    node_of(root)->left = remove_min_rec(node_of(root)->left, min);
+
+    return rebalance(root);
+}
+
+static seg_tail_s *remove_rec(gap_tree_s *tree, seg_tail_s *root,
+                              seg_tail_s *tail) {
+
+    // The gap has to be somewhere in the tree, otherwise the gap hooks have
+    // not been called in pairs
+    ASSERT(root);
+
+    if (root == tail) {
+        gap_tree_node_s *node = node_of(tail);
+
+        if (!node->left) {
+            return node->right;
+        }
+        if (!node->right) {
+            return node->left;
+        }
+
+        // The node has two children, replace it with the smallest gap of its
+        // right subtree. Since the nodes live inside the gaps, the nodes are
+        // relinked instead of copying keys around
+        seg_tail_s *min = nullptr;
+        seg_tail_s *right = remove_min_rec(node->right, &min);
+
+        node_of(min)->left = node->left;
+        node_of(min)->right = right;
+
+        return rebalance(min);
+    }
+
+    if (tree->compare(tail, root) < 0) {
+        node_of(root)->left = remove_rec(tree, node_of(root)->left, tail);
+    } else {
+        node_of(root)->right = remove_rec(tree, node_of(root)->right, tail);
+    }
+
+    return rebalance(root);
+}
+
+// Orders gaps by size first and address second. Since no two tails share an
+// address, this is a strict order
+static int compare_size(const seg_tail_s *a, const seg_tail_s *b) {
+    if (tail_free(a) != tail_free(b)) {
+        return tail_free(a) < tail_free(b) ? -1 : 1;
+    }
+    if (a != b) {
+        return a < b ? -1 : 1;
+    }
+    return 0;
+}
+
+static gap_tree_s size_tree = {.root = nullptr, .compare = &compare_size};
+
+static void size_tree_insert(seg_tail_s *tail) {
+    size_tree.root = insert_rec(&size_tree, size_tree.root, tail);
+}
+
+static void size_tree_remove(seg_tail_s *tail) {
+    size_tree.root = remove_rec(&size_tree, size_tree.root, tail);
+}
+
+static void size_tree_clear() { size_tree.root = nullptr; }
+
+const gap_index_s size_tree_index = {
+    .insert = &size_tree_insert,
+    .remove = &size_tree_remove,
+    .clear = &size_tree_clear,
+};
+
+// Descends the tree once, remembering the last gap which was large enough. Each
+// time a gap fits, a smaller fitting gap can only be in its left subtree
+seg_tail_s *size_tree_find(size_t total_size) {
+    seg_tail_s *best = nullptr;
+    seg_tail_s *iter = size_tree.root;
+
+    while (iter) {
+        if (tail_free(iter) >= total_size) {
+            best = iter;
+            iter = node_of(iter)->left;
+        } else {
+            iter = node_of(iter)->right;
+        }
+    }
+
+    return best;
+}
+
+// Orders gaps by the address of their tails, which is the order of the segment
+// list itself
+static int compare_addr(const seg_tail_s *a, const seg_tail_s *b) {
+    if (a != b) {
+        return a < b ? -1 : 1;
+    }
+    return 0;
+}
+
+static gap_tree_s addr_tree = {.root = nullptr, .compare = &compare_addr};
+
+static void addr_tree_insert(seg_tail_s *tail) {
+    addr_tree.root = insert_rec(&addr_tree, addr_tree.root, tail);
+}
+
+static void addr_tree_remove(seg_tail_s *tail) {
+    addr_tree.root = remove_rec(&addr_tree, addr_tree.root, tail);
+}
+
+static void addr_tree_clear() { addr_tree.root = nullptr; }
+
+const gap_index_s addr_tree_index = {
+    .insert = &addr_tree_insert,
+    .remove = &addr_tree_remove,
+    .clear = &addr_tree_clear,
+};
+
+// The largest gap of each subtree tells whether a fitting gap is in there at
+// all. Thus, prefer the left subtree if it has a fitting gap, then the node
+// itself, then the right subtree. Only one path is ever followed
+seg_tail_s *addr_tree_first(size_t total_size) {
+    seg_tail_s *iter = addr_tree.root;
+
+    if (max_gap(iter) < total_size) {
+        return nullptr;
+    }
+
+    while (iter) {
+        gap_tree_node_s *node = node_of(iter);
+
+        if (max_gap(node->left) >= total_size) {
+            iter = node->left;
+        } else if (tail_free(iter) >= total_size) {
+            return iter;
+        } else {
+            iter = node->right;
+        }
+    }
+
+    // The largest gap of the root promised a fitting gap
+    ASSERT(false);
+    return nullptr;
+}
+
+// Follows the largest gap of the root down to the node it belongs to, again
+// preferring the left subtree to find the lowest address among equal gaps
+seg_tail_s *addr_tree_largest() {
+    seg_tail_s *iter = addr_tree.root;
+
+    if (!iter) {
+        return nullptr;
+    }
+
+    size_t largest = node_of(iter)->max_gap;
+
+    while (iter) {
+        gap_tree_node_s *node = node_of(iter);
+
+        if (max_gap(node->left) == largest) {
+            iter = node->left;
+        } else if (tail_free(iter) == largest) {
+            return iter;
+        } else {
+            iter = node->right;
+        }
+    }
+
+    ASSERT(false);
+    return nullptr;
+}
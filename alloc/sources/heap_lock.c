@@ -0,0 +1,134 @@
+#include "alloc/heap_lock.h"
+
+#include <linux/futex.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <time.h>
+#include <unistd.h>
+
+// Tells the CPU the thread is spinning, which frees resources for the sibling
+// hyperthread, possibly the one holding the lock
+static void cpu_relax() {
+#if defined(__x86_64__) || defined(__i386__)
+    __builtin_ia32_pause();
+#elif defined(__aarch64__)
+    __asm__ __volatile__("yield");
+#endif
+}
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static void futex_wait(atomic_uint *addr, unsigned int expected) {
+    syscall(SYS_futex, addr, FUTEX_WAIT_PRIVATE, expected, nullptr, nullptr, 0);
+}
+
+static void futex_wake(atomic_uint *addr) {
+    syscall(SYS_futex, addr, FUTEX_WAKE_PRIVATE, 1, nullptr, nullptr, 0);
+}
+
+// The counters are only written while holding the lock, so they need no
+// atomic read-modify-write
+static void count(atomic_size_t *counter, size_t add) {
+    atomic_store_explicit(
+        counter, atomic_load_explicit(counter, memory_order_relaxed) + add,
+        memory_order_relaxed);
+}
+
+void heap_lock_init(heap_lock_s *lock) {
+    atomic_init(&lock->state, 0);
+    atomic_init(&lock->spins, HEAP_LOCK_INITIAL_SPINS);
+    atomic_init(&lock->acquisitions, 0);
+    atomic_init(&lock->contended, 0);
+    atomic_init(&lock->wait_ns, 0);
+}
+
+bool heap_trylock(heap_lock_s *lock) {
+    unsigned int unlocked = 0;
+
+    if (!atomic_compare_exchange_strong_explicit(&lock->state, &unlocked, 1,
+                                                 memory_order_acquire,
+                                                 memory_order_relaxed)) {
+        return false;
+    }
+
+    count(&lock->acquisitions, 1);
+    return true;
+}
+
+void heap_lock(heap_lock_s *lock) {
+    if (heap_trylock(lock)) {
+        return;
+    }
+
+    uint64_t start = now_ns();
+    unsigned int spins =
+        atomic_load_explicit(&lock->spins, memory_order_relaxed);
+    unsigned int spun = 0;
+    bool acquired = false;
+
+    // Spin while the lock is held, reading only, so the cache line stays
+    // shared until the lock is released
+    while (spun < spins) {
+        cpu_relax();
+        spun++;
+
+        unsigned int unlocked = 0;
+        if (!atomic_load_explicit(&lock->state, memory_order_relaxed) &&
+            atomic_compare_exchange_weak_explicit(&lock->state, &unlocked, 1,
+                                                  memory_order_acquire,
+                                                  memory_order_relaxed)) {
+            acquired = true;
+            break;
+        }
+    }
+
+    // Sleep until the lock is released. The state 2 tells the holder to wake a
+    // sleeper on unlock. Since it is not known whether other sleepers are left,
+    // a woken thread takes the lock with state 2 as well
+    if (!acquired) {
+        while (atomic_exchange_explicit(&lock->state, 2,
+                                        memory_order_acquire)) {
+            futex_wait(&lock->state, 2);
+        }
+    }
+
+    // Spinning long enough to take the lock twice over is the target. If
+    // spinning did not help, the lock is held too long for it and the budget
+    // shrinks. Only the holder writes the budget
+    unsigned int target = acquired ? 2 * spun + 10 : spins / 2;
+    if (target > HEAP_LOCK_MAX_SPINS) {
+        target = HEAP_LOCK_MAX_SPINS;
+    }
+    atomic_store_explicit(&lock->spins,
+                          spins + ((int)target - (int)spins) / 8,
+                          memory_order_relaxed);
+
+    count(&lock->acquisitions, 1);
+    count(&lock->contended, 1);
+    atomic_store_explicit(
+        &lock->wait_ns,
+        atomic_load_explicit(&lock->wait_ns, memory_order_relaxed) +
+            (now_ns() - start),
+        memory_order_relaxed);
+}
+
+void heap_unlock(heap_lock_s *lock) {
+    if (atomic_exchange_explicit(&lock->state, 0, memory_order_release) == 2) {
+        futex_wake(&lock->state);
+    }
+}
+
+void heap_lock_stats(heap_lock_s *lock, heap_lock_stats_s *stats) {
+    stats->acquisitions +=
+        atomic_load_explicit(&lock->acquisitions, memory_order_relaxed);
+    stats->contended +=
+        atomic_load_explicit(&lock->contended, memory_order_relaxed);
+    stats->wait_ns +=
+        atomic_load_explicit(&lock->wait_ns, memory_order_relaxed);
+}
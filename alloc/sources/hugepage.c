@@ -0,0 +1,68 @@
+#include "alloc/hugepage.h"
+
+#include <fcntl.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <unistd.h>
+
+// Longest line of smaps looked at. Longer ones are header lines with long
+// paths, which never belong to an arena
+#define SMAPS_LINE 512
+
+#define ANON_HUGE "AnonHugePages:"
+
+// A mapping header starts with its range in hex, "start-end"
+static bool parse_header(const char *line, uintptr_t *start, uintptr_t *end) {
+    char *rest;
+
+    *start = strtoull(line, &rest, 16);
+    if (rest == line || *rest != '-') {
+        return false;
+    }
+    *end = strtoull(rest + 1, nullptr, 16);
+    return true;
+}
+
+// The library may be malloc() itself, so the file is read with plain system
+// calls into a buffer on the stack instead of with stdio
+size_t hugepage_bytes(const uint8_t *from, const uint8_t *to) {
+    int fd = open("/proc/self/smaps", O_RDONLY | O_CLOEXEC);
+    if (fd < 0) {
+        return 0;
+    }
+
+    char buf[4096];
+    char line[SMAPS_LINE];
+    size_t length = 0;
+    bool inside = false;
+    size_t bytes = 0;
+    ssize_t got;
+
+    while ((got = read(fd, buf, sizeof(buf))) > 0) {
+        for (ssize_t i = 0; i < got; i++) {
+            if (buf[i] != '\n') {
+                if (length < SMAPS_LINE - 1) {
+                    line[length++] = buf[i];
+                }
+                continue;
+            }
+
+            line[length] = '\0';
+            length = 0;
+
+            uintptr_t start;
+            uintptr_t end;
+
+            if (parse_header(line, &start, &end)) {
+                inside = start < (uintptr_t)to && end > (uintptr_t)from;
+            } else if (inside && !strncmp(line, ANON_HUGE, strlen(ANON_HUGE))) {
+                bytes += strtoull(line + strlen(ANON_HUGE), nullptr, 10) * 1024;
+            }
+        }
+    }
+
+    close(fd);
+    return bytes;
+}
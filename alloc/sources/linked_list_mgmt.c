@@ -1,4 +1,6 @@
 #include "alloc/linked_list_mgmt.h"
+#include "alloc/arena.h"
+#include "alloc/chunk.h"
 #include "alloc/defines.h"
 #include "alloc/storage.h"
 #include "alloc/types.h"
@@ -39,8 +41,8 @@ static void init_tail(seg_list_head_s *list) {
 seg_list_head_s *create_list() {
 
     // Create a new address which is not yet aligned yet
-    void *addr = (seg_list_head_s *)sbrk((int)sizeof(struct seg_list_head_s) +
-                                         ALIGNMENT);
+    void *addr = (seg_list_head_s *)arena_sbrk(
+        (int)sizeof(struct seg_list_head_s) + ALIGNMENT);
 
     if (addr == (void *)-1) {
         // sbrk failed for some reason, aborting
@@ -84,7 +86,7 @@ seg_tail_s *find_last_tail(seg_list_head_s *list) {
     // Trick: Find the last segment header by iterating backwards over the list.
     // First look up the initial segment header, then from there go to the
     // previous segment tail
-    seg_tail_s *temp = list->first_seg->prev_seg_tail;
+    seg_tail_s *temp = head_prev_tail(list->first_seg);
 
     // It is necessary for the last segment tail address plus segment tail size
     // to be smaller than the end of the storage list
@@ -95,7 +97,7 @@ seg_tail_s *find_last_tail(seg_list_head_s *list) {
     // Assume this is less than the storage tail address. This would mean some
     // other segment existed before the end of the storage list, which is a
     // contradiction. Thus this condiction needs to hold
-    ASSERT((uint8_t *)temp + sizeof(struct seg_tail_s) + temp->free_following ==
+    ASSERT((uint8_t *)temp + sizeof(struct seg_tail_s) + tail_free(temp) ==
            list->end_addr)
 
     return temp;
@@ -115,7 +117,7 @@ size_t get_following_gap_size(uint8_t *addr) {
 
     // The number of free bytes after the tail is stored in the tail, this is
     // exactly the value we need
-    return header->next_seg_tail->free_following;
+    return tail_free(head_next_tail(header));
 }
 
 // This function returns the segment size, assuming addr points to a valid
@@ -132,7 +134,7 @@ size_t get_segment_size(uint8_t *addr) {
 
     // The size of the segment (without header and tail size, that is storage
     // size only) is stored in the header.
-    return header->seg_size;
+    return head_size(header);
 }
 
 // This function tries to find the header of a storage segment located before
@@ -169,8 +171,8 @@ uint8_t *get_prev_reference(seg_list_head_s *list, uint8_t *addr) {
     // addr minus tail size, then go one pointer back to the head to obtain the
     // previous head address
 
-    return (uint8_t *)((seg_tail_s *)(addr - sizeof(struct seg_tail_s)))
-        ->prev_seg_head;
+    return (uint8_t *)tail_prev_head(
+        (seg_tail_s *)(addr - sizeof(struct seg_tail_s)));
 
     /*
     // Iterate over all segment heads, beginning from the first segment
@@ -200,20 +202,26 @@ uint8_t *get_prev_reference(seg_list_head_s *list, uint8_t *addr) {
     */
 }
 
-// This function resets the list
-int reset_list(seg_list_head_s *list) {
+// This function empties the list, keeping its memory
+void empty_list(seg_list_head_s *list) {
 
     // Reset head
     init_first(list);
 
     // Reset tail
     init_tail(list);
+}
+
+// This function resets the list
+int reset_list(seg_list_head_s *list) {
+
+    empty_list(list);
 
-    // Reset program break all the way back to the end of the storage table
-    // header
-    if (brk((void *)((uint8_t *)list + sizeof(*list)))) {
+    // Reset the break of the arena all the way back to the end of the storage
+    // table header
+    if (arena_brk((void *)((uint8_t *)list + sizeof(*list)))) {
 
-        pr_error("Failed to reset program break: %s", strerror(errno));
+        pr_error("Failed to reset break: %s", strerror(errno));
 
         return ERROR;
     }
@@ -0,0 +1,155 @@
+// mremap() is a GNU extension
+#define _GNU_SOURCE
+
+#include "alloc/mapped.h"
+#include "alloc/arena.h"
+#include "alloc/buddy.h"
+#include "alloc/defines.h"
+#include "alloc/slab.h"
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/mman.h>
+
+// Stored in front of the user area of a mapped chunk, at the beginning of the
+// mapping. The user area therefore always starts at the same offset into its
+// page
+typedef struct mapped_head_s {
+    size_t map_size; /**< Size of the whole mapping */
+    size_t size;     /**< Size requested for the chunk */
+    uintptr_t magic; /**< User address XORed with MAPPED_MAGIC */
+} mapped_head_s;
+
+// Offset of the user area into the mapping, the header rounded up to
+// ALIGNMENT
+#define MAPPED_OFFSET                                                          \
+    ((sizeof(mapped_head_s) + ALIGNMENT - 1) / ALIGNMENT * ALIGNMENT)
+
+// Only used to catch pointers which were never returned by mapped_alloc() in
+// debug builds. The memory in front of other pointers belongs to the user, who
+// could store the same value there
+#define MAPPED_MAGIC ((uintptr_t)0x6a756c6d6d617021)
+
+static atomic_size_t g_threshold = MAPPED_THRESHOLD_MIN;
+
+// Cleared once the threshold is set explicitly
+static atomic_bool g_dynamic = true;
+
+static mapped_head_s *head_of(const uint8_t *addr) {
+    return (mapped_head_s *)(addr - MAPPED_OFFSET);
+}
+
+static size_t map_size_of(size_t size) {
+    return round_up(MAPPED_OFFSET + size, PAGE_SIZE);
+}
+
+// Writes the header of a mapping and returns the user address
+static uint8_t *init_mapping(uint8_t *map, size_t map_size, size_t size) {
+    mapped_head_s *head = (mapped_head_s *)map;
+    uint8_t *addr = map + MAPPED_OFFSET;
+
+    head->map_size = map_size;
+    head->size = size;
+    head->magic = (uintptr_t)addr ^ MAPPED_MAGIC;
+
+    return addr;
+}
+
+static_assert(MAPPED_THRESHOLD_MIN > SLAB_MAX_SIZE, "slab blocks mapped");
+static_assert(MAPPED_THRESHOLD_MIN > BUDDY_MAX_SIZE, "buddy blocks mapped");
+
+// Lower thresholds would map requests the slabs and buddy pools serve, one
+// system call and one page each
+void set_mmap_threshold(size_t threshold) {
+    if (threshold < MAPPED_THRESHOLD_MIN) {
+        threshold = MAPPED_THRESHOLD_MIN;
+    }
+
+    atomic_store(&g_dynamic, false);
+    atomic_store(&g_threshold, threshold);
+}
+
+size_t get_mmap_threshold() { return atomic_load(&g_threshold); }
+
+uint8_t *mapped_alloc(size_t size) {
+
+    // Guard against the size wrapping around when adding the header
+    if (size > SIZE_MAX - MAPPED_OFFSET - PAGE_SIZE) {
+        return nullptr;
+    }
+
+    size_t map_size = map_size_of(size);
+
+    uint8_t *map = mmap(nullptr, map_size, PROT_READ | PROT_WRITE,
+                        MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+    if (map == MAP_FAILED) {
+        pr_warning("mapped_alloc(): mmap of %zu bytes failed", map_size);
+        return nullptr;
+    }
+
+    return init_mapping(map, map_size, size);
+}
+
+void mapped_free(uint8_t *addr) {
+    mapped_head_s *head = head_of(addr);
+    size_t size = head->map_size;
+
+    // The threshold is raised to the size of the whole mapping, so that the
+    // next chunk of this size is placed in a storage table, where freeing it
+    // needs no system call. Only sizes a storage table is fine with are taken
+    // over
+    size_t threshold = atomic_load(&g_threshold);
+    while (atomic_load(&g_dynamic) && size > threshold &&
+           size <= MAPPED_THRESHOLD_MAX &&
+           !atomic_compare_exchange_weak(&g_threshold, &threshold, size)) {
+    }
+
+    // Clear the magic first, so that the memory is not taken for a chunk if
+    // the same address is mapped again
+    head->magic = 0;
+
+    if (munmap(head, head->map_size)) {
+        pr_error("mapped_free(): munmap failed");
+    }
+}
+
+uint8_t *mapped_realloc(uint8_t *addr, size_t size) {
+    mapped_head_s *head = head_of(addr);
+
+    if (size > SIZE_MAX - MAPPED_OFFSET - PAGE_SIZE) {
+        return nullptr;
+    }
+
+    size_t map_size = map_size_of(size);
+
+    // Shrinking and growing within the last page keep the mapping
+    if (map_size == head->map_size) {
+        head->size = size;
+        return addr;
+    }
+
+    uint8_t *map = mremap(head, head->map_size, map_size, MREMAP_MAYMOVE);
+    if (map == MAP_FAILED) {
+        pr_warning("mapped_realloc(): mremap to %zu bytes failed", map_size);
+        return nullptr;
+    }
+
+    return init_mapping(map, map_size, size);
+}
+
+// Every other chunk and every block of the slabs and buddy pools lies in the
+// reserved range of an arena, and mappings never overlap these ranges. Neither
+// is up to the memory the user writes to
+bool mapped_owns(uint8_t *addr) {
+    if ((uintptr_t)addr % PAGE_SIZE != MAPPED_OFFSET || arena_find(addr)) {
+        return false;
+    }
+
+    ASSERT(head_of(addr)->magic == ((uintptr_t)addr ^ MAPPED_MAGIC));
+
+    return true;
+}
+
+size_t mapped_size(const uint8_t *addr) { return head_of(addr)->size; }
@@ -1,8 +1,18 @@
 #include "alloc/memory_mgmt.h"
+#include "alloc/adaptive.h"
+#include "alloc/arena.h"
+#include "alloc/buddy.h"
+#include "alloc/chunk.h"
+#include "alloc/cpucache.h"
 #include "alloc/defines.h"
+#include "alloc/free_log.h"
+#include "alloc/gap_mgmt.h"
 #include "alloc/linked_list_mgmt.h"
+#include "alloc/purge.h"
+#include "alloc/slab.h"
 #include "alloc/storage.h"
 #include "alloc/strats.h"
+#include "alloc/tcache.h"
 #include "alloc/types.h"
 #include "alloc/utils.h"
 
@@ -15,16 +25,19 @@
 #include <string.h>
 #include <unistd.h>
 
-// Declaration of storage list
-seg_list_head_s *start = nullptr;
-
 // Declaration and initialization of allocation function
 alloc_function g_alloc_function = &next_fit;
 
+// Strategy g_alloc_function belongs to
+sched_strat_e g_alloc_strat = NEXT_FIT;
+
 // This function actually allocated spaces for a given address by adding a
 // segment head, and segment tail with minimum distance size
 uint8_t *add_entry(uint8_t *addr, size_t size) {
 
+    // Storage list of the arena bound to the calling thread
+    seg_list_head_s *start = g_arena->list;
+
     // If neither the list nor the end pointer is initialized, it is not
     // possible to add an entry
     if (!start || !start->end_addr) {
@@ -32,6 +45,14 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
         return nullptr;
     }
 
+    // Every gap follows the tail of a chunk. With room for one gap per chunk,
+    // linking the gaps below never fails, and neither does freeing any of the
+    // chunks later on
+    if (gap_reserve(g_arena->chunks + 1)) {
+        pr_warning("Gap index has no room for another chunk");
+        return nullptr;
+    }
+
     size_t effective_size = round_up(size, ALIGNMENT);
 
     // Note that size only described the user space size. But if we want to
@@ -84,7 +105,7 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // this means that addr points to some area before the first
             // segment, which means the "previous" tail is the last tail of the
             // entire list!
-            temp = start->first_seg->prev_seg_tail;
+            temp = head_prev_tail(start->first_seg);
 
             // This case is slightly easier than the following case, because
             // we don't need to recalculate the previous (last) tails number
@@ -119,39 +140,39 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
 
             // The predecessor tail of the new segment header is exactly the
             // previous tail
-            new_seg->prev_seg_tail = temp;
+            set_head_prev_tail(new_seg, temp);
 
             // The tail of the new segment is located at an offset of the
             // size of the segment header, plus the user size
-            new_seg->next_seg_tail =
-                (seg_tail_s *)((uint8_t *)new_seg + sizeof(*new_seg) +
-                               effective_size);
+            set_head_next_tail(new_seg, (seg_tail_s *)((uint8_t *)new_seg +
+                                                       sizeof(*new_seg) +
+                                                       effective_size));
 
             // The new segment user space size is the desired size
-            new_seg->seg_size = size;
+            set_head_size(new_seg, size);
 
             // The predecessor of the new segment tail is the new segment
             // header, quite obviously
-            new_seg->next_seg_tail->prev_seg_head = new_seg;
+            set_tail_prev_head(head_next_tail(new_seg), new_seg);
 
             // The successor of the new segment tail is the old successor of
             // the previous tail, which is exactly the list head
-            new_seg->next_seg_tail->next_seg_head = temp->next_seg_head;
+            set_tail_next_head(head_next_tail(new_seg), tail_next_head(temp));
 
             // The number of free following bytes is the old start gap size,
             // minus the new necessary size (with overhead) together with
             // the new segment offset
-            new_seg->next_seg_tail->free_following =
-                start_gap - (offset + new_size);
+            set_tail_free(head_next_tail(new_seg),
+                          start_gap - (offset + new_size));
 
             // The successor of the predecessor of the new head needs to
             // point to the new head
-            new_seg->prev_seg_tail->next_seg_head = new_seg;
+            set_tail_next_head(head_prev_tail(new_seg), new_seg);
 
             // The predecessor, of the successor, of the new segment tail,
             // points to the new segment tail
-            new_seg->next_seg_tail->next_seg_head->prev_seg_tail =
-                new_seg->next_seg_tail;
+            set_head_prev_tail(tail_next_head(head_next_tail(new_seg)),
+                               head_next_tail(new_seg));
 
             // The address of the new segment, minus the address of the
             // start, needs to be exactly the offset plus the start table
@@ -165,7 +186,7 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // be exactly the old number of free bytes when the new segment
             // did not yet exist at the current gap
             ASSERT(offset + new_size +
-                       (int)new_seg->next_seg_tail->free_following ==
+                       (int)tail_free(head_next_tail(new_seg)) ==
                    start_gap);
 
             // Also, the new segment address, plus the entire segment size
@@ -174,9 +195,13 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // otherwise something went wrong and we can expect nice
             // SEGFAULTS we all like.
             ASSERT((uint8_t *)new_seg + new_size +
-                       new_seg->next_seg_tail->free_following <=
+                       tail_free(head_next_tail(new_seg)) <=
                    start->end_addr);
 
+            // The rest of the start gap now follows the new tail. The start
+            // gap itself is never part of the gap index
+            gap_link(head_next_tail(new_seg));
+
             // Finally, update the first segment pointer
             start->first_seg = new_seg;
 
@@ -188,7 +213,7 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // casted to an appropriate pointer and we can assume that addr
             // points *after* some existing segment, an important distinction
 
-            temp = (seg_tail_s *)((seg_head_s *)previous)->next_seg_tail;
+            temp = head_next_tail((seg_head_s *)previous);
 
             // If this assertion doesn't hold, that would mean addr points
             // directly into the previous tail, which is quite bad
@@ -198,7 +223,12 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             //        temp->prev_seg_head->seg_size);
 
             // Store the old consequtive number of free bytes
-            size_t old_free_size = temp->free_following;
+            size_t old_free_size = tail_free(temp);
+
+            // The gap is about to be split (and its beginning possibly
+            // overwritten by the new header), so withdraw it from the gap index
+            // first
+            gap_unlink(temp);
 
             // Store the distance of the new segment location compared
             // to the previous segment location
@@ -224,61 +254,61 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
 
             // The predecessor tail of the new segment header is exactly
             // the previous tail
-            new_seg->prev_seg_tail = temp;
+            set_head_prev_tail(new_seg, temp);
 
             // On the contrary, the free following size of the previous
             // segment is now simply the offset
-            new_seg->prev_seg_tail->free_following = offset;
+            set_tail_free(head_prev_tail(new_seg), offset);
 
             // The address of the new segment needs to be the address of
             // the previous tail, plus the size of the previous tail,
             // plus the number of new free following bytes
             ASSERT((uint8_t *)new_seg ==
-                   (uint8_t *)new_seg->prev_seg_tail +
-                       sizeof(*new_seg->prev_seg_tail) +
-                       new_seg->prev_seg_tail->free_following);
+                   (uint8_t *)head_prev_tail(new_seg) +
+                       sizeof(*head_prev_tail(new_seg)) +
+                       tail_free(head_prev_tail(new_seg)));
 
             // The tail of the new segment is located at an offset of
             // the size of the segment header, plus the user size
-            new_seg->next_seg_tail =
-                (seg_tail_s *)((uint8_t *)new_seg + sizeof(*new_seg) +
-                               effective_size);
+            set_head_next_tail(new_seg, (seg_tail_s *)((uint8_t *)new_seg +
+                                                       sizeof(*new_seg) +
+                                                       effective_size));
 
             // The new segment user space size is the desired size
-            new_seg->seg_size = size;
+            set_head_size(new_seg, size);
 
             // The predecessor of the new segment tail is the new
             // segment header, quite obviously
-            new_seg->next_seg_tail->prev_seg_head = new_seg;
+            set_tail_prev_head(head_next_tail(new_seg), new_seg);
 
             // The successor of the new segment tail is the old
             // successor of the previous tail
-            new_seg->next_seg_tail->next_seg_head = temp->next_seg_head;
+            set_tail_next_head(head_next_tail(new_seg), tail_next_head(temp));
 
             // THe number of free following bytes is the old free
             // folloying bytes number of the previous segment, minus the
             // new necessary size (with overhead) together with the new
             // segment offset
-            new_seg->next_seg_tail->free_following =
-                old_free_size - (offset + new_size);
+            set_tail_free(head_next_tail(new_seg),
+                          old_free_size - (offset + new_size));
 
             // The successor of the predecessor of the new head needs to
             // point to the new head
-            new_seg->prev_seg_tail->next_seg_head = new_seg;
+            set_tail_next_head(head_prev_tail(new_seg), new_seg);
 
             // Integrity check. The sum of the previous segment free
             // following bytes, plus the new segment size (with
             // overhead), plus the consecutive number of free bytes,
             // needs to add up exactly to the old free bytes size when
             // the current segment did not exist yet!
-            ASSERT(new_seg->prev_seg_tail->free_following + new_size +
-                       new_seg->next_seg_tail->free_following ==
+            ASSERT(tail_free(head_prev_tail(new_seg)) + new_size +
+                       tail_free(head_next_tail(new_seg)) ==
                    old_free_size);
 
             // The predecessor, of the successor, of the new segment
             // tail, points to the new segment tail
-            new_seg->next_seg_tail->next_seg_head->prev_seg_tail =
-                new_seg->next_seg_tail;
+            set_head_prev_tail(tail_next_head(head_next_tail(new_seg)),
+                               head_next_tail(new_seg));
 
             // Also, the new segment address, plus the entire segment
             // size (with overhead), plus the subsequent number of free
@@ -286,8 +316,12 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // table, otherwise something went wrong and we can expect
             // nice SEGFAULTS we all like.
             ASSERT((uint8_t *)new_seg + new_size +
-                       new_seg->next_seg_tail->free_following <=
+                       tail_free(head_next_tail(new_seg)) <=
                    start->end_addr);
+
+            // Announce both parts of the split gap to the gap index
+            gap_link(temp);
+            gap_link(head_next_tail(new_seg));
         }
 
     } else {
@@ -330,30 +364,30 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // The tail of the new segment is located at the address of the new
             // segment header, plus the size of the new segment header, plus the
             // user space size
-            new_seg->next_seg_tail =
-                (seg_tail_s *)((uint8_t *)new_seg + sizeof(*new_seg) +
-                               effective_size);
+            set_head_next_tail(new_seg, (seg_tail_s *)((uint8_t *)new_seg +
+                                                       sizeof(*new_seg) +
+                                                       effective_size));
 
             // The user space size is the desired size
-            new_seg->seg_size = size;
+            set_head_size(new_seg, size);
 
             // The previous segment header of the new tail is the segment header
             // of the new segment obviously
-            new_seg->next_seg_tail->prev_seg_head = new_seg;
+            set_tail_prev_head(head_next_tail(new_seg), new_seg);
 
             // Since there is only one segment, the predecessor of the new
             // segment points to the new segment tail
-            new_seg->prev_seg_tail = new_seg->next_seg_tail;
+            set_head_prev_tail(new_seg, head_next_tail(new_seg));
 
             // Also, the successor of the new segment tail is equal to the new
             // segment header
-            new_seg->next_seg_tail->next_seg_head = new_seg;
+            set_tail_next_head(head_next_tail(new_seg), new_seg);
 
             // The number of free bytes following the new segment tail is equal
             // to the old empty storage table size minus the desired size (with
             // overhead) - minus the offset!
-            new_seg->next_seg_tail->free_following =
-                free_size - (new_size + offset);
+            set_tail_free(head_next_tail(new_seg),
+                          free_size - (new_size + offset));
 
             // We created a new segment, as such the first segment pointer of
             // the storage table header needs to be updated properly
@@ -370,7 +404,7 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // The tail of the new segment is located exactly user size plus the
             // size of the segment header away from the new segment header
             // address
-            ASSERT((uint8_t *)new_seg->next_seg_tail - (uint8_t *)new_seg ==
+            ASSERT((uint8_t *)head_next_tail(new_seg) - (uint8_t *)new_seg ==
                    (int)(sizeof(*new_seg) + effective_size));
 
             // The address constructed by taking the new segment address, adding
@@ -378,17 +412,20 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
             // free size has to be equal to the end address of the
             // storage table
             ASSERT((uint8_t *)new_seg + new_size +
-                       new_seg->next_seg_tail->free_following ==
+                       tail_free(head_next_tail(new_seg)) ==
                    start->end_addr);
 
             // Similarly, the address of the new segment tail, plus the segment
             // tail size, plus the number of free following bytes needs to be
             // equal to the end address of the storage table
-            ASSERT((uint8_t *)new_seg->next_seg_tail +
-                       sizeof(*new_seg->next_seg_tail) +
-                       new_seg->next_seg_tail->free_following ==
+            ASSERT((uint8_t *)head_next_tail(new_seg) +
+                       sizeof(*head_next_tail(new_seg)) +
+                       tail_free(head_next_tail(new_seg)) ==
                    start->end_addr);
 
+            // The rest of the storage table is the only gap
+            gap_link(head_next_tail(new_seg));
+
         } else {
 
             // The size of the storage table is not large enough. But don't fret
@@ -407,7 +444,14 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
 
         // For Nextfit, set the last allocated tail address to the tail
         // of the just allocated segment
-        set_last_addr(new_seg->next_seg_tail);
+        set_last_addr(head_next_tail(new_seg));
+
+        g_arena->chunks++;
+
+        // The chunk and the bookkeeping of the gap after it may lie on
+        // purged pages, which are in use again now
+        purge_reuse((uint8_t *)new_seg, (uint8_t *)head_next_tail(new_seg) +
+                                            sizeof(seg_tail_s) + MIN_GAP_SIZE);
 
         // We are again only interested in the usable address for the
         // user, as such we return the new segment address (pointing to
@@ -433,6 +477,8 @@ uint8_t *add_entry(uint8_t *addr, size_t size) {
 // redirected appropriately
 void remove_segment(uint8_t *addr) {
 
+    seg_list_head_s *start = g_arena->list;
+
     // Check that addr is valid
     ASSERT(addr >= (uint8_t *)start + sizeof(*start));
     ASSERT(addr < (uint8_t *)start->end_addr);
@@ -450,6 +496,13 @@ void remove_segment(uint8_t *addr) {
     // located after the storage table header
     ASSERT((uint8_t *)old >= (uint8_t *)start + sizeof(*start));
 
+    g_arena->chunks--;
+
+    // The controller only watches the main arena
+    if (g_alloc_strat == ADAPTIVE && g_arena == arena_main()) {
+        adaptive_free();
+    }
+
     // pr_info("Valid address");
 
     // If the corresponding segment does not belong to the first segment, simply
@@ -458,36 +511,40 @@ void remove_segment(uint8_t *addr) {
     if (start->first_seg != old) {
 
         // Consider the previous tail as a variable and store it for managing
-        seg_tail_s *pred = old->prev_seg_tail;
+        seg_tail_s *pred = head_prev_tail(old);
+
+        // Both the gap in front of and the gap after the old segment are
+        // merged into one, withdraw them from the gap index before
+        gap_unlink(pred);
+        gap_unlink(head_next_tail(old));
 
         // For Nextfit, set the last allocated tail address to the tail of
-        // the previous segment. Only update if last_addr points to the end of
-        // the segment to be removed
-        if (old->next_seg_tail == get_last_addr()) {
-            set_last_addr(pred);
-        }
+        // the previous segment. Only update the last_addr values of threads
+        // pointing to the end of the segment to be removed
+        move_last_addr(head_next_tail(old), pred);
 
         // Since we remove the current segment, the number of free bytes gets
         // updated to the size of the old segment, plus the number of free bytes
         // after the old segment
-        pred->free_following +=
-            sizeof(struct seg_head_s) + round_up(old->seg_size, ALIGNMENT) +
-            sizeof(struct seg_tail_s) + old->next_seg_tail->free_following;
+        set_tail_free(pred, tail_free(pred) + sizeof(struct seg_head_s) +
+                                round_up(head_size(old), ALIGNMENT) +
+                                sizeof(struct seg_tail_s) +
+                                tail_free(head_next_tail(old)));
 
         // The next head of the previous tail is the next head of the old
         // segments tails next head
-        pred->next_seg_head = old->next_seg_tail->next_seg_head;
+        set_tail_next_head(pred, tail_next_head(head_next_tail(old)));
 
         // Similarly, the predecessor of the new successor of pred is pred
         // itself
-        pred->next_seg_head->prev_seg_tail = pred;
+        set_head_prev_tail(tail_next_head(pred), pred);
 
         // Now we updated all variables and can do some assertions
 
         // The number of free bytes after pred should not exceed the storage
         // table limits
         ASSERT((uint8_t *)pred + sizeof(struct seg_tail_s) +
-                   pred->free_following <=
+                   tail_free(pred) <=
                start->end_addr);
 
         // Either, we removed the last segment, and as such, the number of free
@@ -496,26 +553,26 @@ void remove_segment(uint8_t *addr) {
         // Or, we removed some previous segment, and we know there are more than
         // 1 segments in this case, so, the number of free bytes need to match
         // up with the beginning of the next segment's head
-        ASSERT((uint8_t *)pred + sizeof(*pred) + pred->free_following <=
+        ASSERT((uint8_t *)pred + sizeof(*pred) + tail_free(pred) <=
                    start->end_addr ||
-               (uint8_t *)pred + sizeof(*pred) + pred->free_following ==
-                   (uint8_t *)pred->next_seg_head);
+               (uint8_t *)pred + sizeof(*pred) + tail_free(pred) ==
+                   (uint8_t *)tail_next_head(pred));
 
         // If the now previous element is the last element, check if we can
         // shrink the allocated storage
-        if (pred == start->first_seg->prev_seg_tail) {
+        if (pred == head_prev_tail(start->first_seg)) {
 
             // Check if the free storage after the last segment is larger than a
             // page size
-            if ((int)pred->free_following - (int)PAGE_SIZE > 0) {
+            if ((int)tail_free(pred) - (int)PAGE_SIZE > 0) {
 
-                size_t old_free = pred->free_following;
+                size_t old_free = tail_free(pred);
 
                 // We want to shrink the allocated storage by the max multiple
                 // of PAGE_SIZE that is still smaller than the free following
                 // space.
                 int to_shrink =
-                    (int)(floor((double)pred->free_following / PAGE_SIZE)) *
+                    (int)(floor((double)tail_free(pred) / PAGE_SIZE)) *
                     PAGE_SIZE;
 
                 // to_shrink should be a positive number to avoid confusion
@@ -523,71 +580,74 @@ void remove_segment(uint8_t *addr) {
 
                 // Make sure the to be shrunken size is actually smaller than
                 // the free following size, otherwise expect heap corruption!
-                ASSERT((size_t)to_shrink <= pred->free_following);
-
-                if (sbrk(-to_shrink) == (void *)-1) {
-                    // If the returned value is -1, sbrk failed. This should not
-                    // really happen as we are shrinking the storage, so abort.
-
-                    pr_error("sbrk error: %s", strerror(errno));
-
-                    abort();
-                }
+                ASSERT((size_t)to_shrink <= tail_free(pred));
 
                 // Update free following of last segment
-                pred->free_following -= to_shrink;
+                set_tail_free(pred, tail_free(pred) - to_shrink);
 
                 // Update tail pointer
                 start->end_addr -= to_shrink;
 
-                ASSERT(pred->free_following == old_free - to_shrink);
-                ASSERT((uint8_t *)pred + sizeof(*pred) + pred->free_following ==
+                // The memory is kept for growing again. Whatever is too much
+                // is given back after the arena is unlocked, so no thread has
+                // to wait for the system call
+                arena_release(start->end_addr);
+
+                ASSERT(tail_free(pred) == old_free - to_shrink);
+                ASSERT((uint8_t *)pred + sizeof(*pred) + tail_free(pred) ==
                        start->end_addr);
             }
         }
 
+        // Announce the merged gap to the gap index
+        gap_link(pred);
+
+        // A large merged gap gives its pages back, except for those holding
+        // the bookkeeping of the gap index
+        purge_range((uint8_t *)pred + sizeof(*pred) + MIN_GAP_SIZE,
+                    (uint8_t *)pred + sizeof(*pred) + tail_free(pred));
+
         // pr_info("Successfully free entry");
     } else {
 
-        // In this case, old points to the first segment
+        // In this case, old points to the first segment. The gap after it
+        // either vanishes or becomes part of the start gap, which is not
+        // indexed
+        gap_unlink(head_next_tail(old));
 
         // If old is the only segment at all, we are lucky and only need to set
         // the first segment entry of the storage table header to nullptr
-        if (old->prev_seg_tail == old->next_seg_tail) {
+        if (head_prev_tail(old) == head_next_tail(old)) {
 
             // This means only one segment is allocated because the pointers are
             // circular. As such, for nextfit, we set the last_addr to nullptr.
-            // Only update if last_addr points to the tail of the to be removed
-            // segment
-            if (old->next_seg_tail == get_last_addr()) {
-                set_last_addr(nullptr);
-            }
+            // Only update the last_addr values of threads pointing to the tail
+            // of the to be removed segment
+            move_last_addr(head_next_tail(old), nullptr);
             // pr_info("Start equals head");
 
             // Simple sanity check: Make sure that the next head of the
             // current tail is the current head again
-            ASSERT(old->next_seg_tail->next_seg_head = old);
+            ASSERT(tail_next_head(head_next_tail(old)) == old);
 
             // Set start head to nullptr
             start->first_seg = nullptr;
 
-            // Since the only left element has been removed, we can safely reset
-            // the list.
-            if (reset_list(start)) {
-                pr_error("Failed to reset list");
-                abort();
-            }
+            // Since the only left element has been removed, we can safely
+            // empty the list. Its memory is released like a trailing gap
+            empty_list(start);
+            arena_release(start->end_addr);
         } else {
 
             // Since we are removing the very first segment, this means
             // pointers of the last segment need to be updated, too
 
             // Store the old segment user size
-            size_t seg_size = old->seg_size;
+            size_t seg_size = head_size(old);
 
             // Store the number of trailing free bytes after the current
             // segment
-            size_t trailing_free = old->next_seg_tail->free_following;
+            size_t trailing_free = tail_free(head_next_tail(old));
 
             // Calculate the distance between old segment start and the
             // beginning of the table
@@ -599,23 +659,25 @@ void remove_segment(uint8_t *addr) {
 
             // For Nextfit, set the last allocated tail address to the tail
             // of the previous segment
-            // Only update if last_addr points to the tail of the to be removed
-            // segment
-            if (old->next_seg_tail == get_last_addr()) {
-                set_last_addr(end);
-            }
+            // Only update the last_addr values of threads pointing to the tail
+            // of the to be removed segment
+            move_last_addr(head_next_tail(old), end);
+
+            // The segment after old becomes the first segment. Fetch it before
+            // any pointer is changed
+            seg_head_s *new_first = tail_next_head(head_next_tail(old));
 
             // Move the next header pointer of the last segment tail one up
             // because segment old is to be removed
-            end->next_seg_head = old->next_seg_tail->next_seg_head;
+            set_tail_next_head(end, new_first);
 
             // Point the previous tail pointer of the next segment header to
             // the last segment tail
-            end->next_seg_head->prev_seg_tail = end;
+            set_head_prev_tail(new_first, end);
 
             // Reassign the first segment pointer of the storage table
             // header since old was the first segment
-            start->first_seg = end->next_seg_head;
+            start->first_seg = new_first;
 
             // Check that the distances match up: The distance between first
             // segment and segment table beginning needs to be equal to the
@@ -627,6 +689,10 @@ void remove_segment(uint8_t *addr) {
                    (int)(offset + +sizeof(struct seg_head_s) +
                          round_up(seg_size, ALIGNMENT) +
                          sizeof(struct seg_tail_s) + trailing_free));
+
+            // The start gap holds no bookkeeping, all of it can be purged
+            purge_range((uint8_t *)start + sizeof(*start),
+                        (uint8_t *)start->first_seg);
         }
     }
 }
@@ -642,21 +708,24 @@ int shrink_segment(uint8_t *addr, size_t size) {
 
     // If we are trying to shrink more bytes than currently are assigned to
     // user data, this is not a valid operation and we need to abort
-    if (size > header->seg_size) {
+    if (size > head_size(header)) {
         pr_error("Sorry, invalid arguments");
         return ERROR;
     }
 
     // Store the old segment tail address
-    seg_tail_s *old_addr = header->next_seg_tail;
+    seg_tail_s *old_addr = head_next_tail(header);
 
     // Store the successor of the old segment tail
-    seg_head_s *next = header->next_seg_tail->next_seg_head;
+    seg_head_s *next = tail_next_head(head_next_tail(header));
 
     // Store the number of free bytes after the old segment tail
-    size_t free_size = header->next_seg_tail->free_following;
+    size_t free_size = tail_free(head_next_tail(header));
+
+    // The tail is moved, withdraw its gap from the gap index
+    gap_unlink(old_addr);
 
-    size_t effective_size = round_up(header->seg_size - size, ALIGNMENT);
+    size_t effective_size = round_up(head_size(header) - size, ALIGNMENT);
 
     // We "move" the tail size many bytes to the front relative to the old
     // address
@@ -664,49 +733,55 @@ int shrink_segment(uint8_t *addr, size_t size) {
         (seg_tail_s *)((uint8_t *)header + sizeof(*header) + effective_size);
 
     // The predecessor of the new tail is same as before, the current header
-    shifted->prev_seg_head = header;
+    set_tail_prev_head(shifted, header);
 
     // THe succcessor of the new tail is same as before, the next head
-    shifted->next_seg_head = next;
+    set_tail_next_head(shifted, next);
 
     // The number of free following bytes has increased by size many bytes
     // because we moved the tail size many bytes closer to the header!
-    shifted->free_following =
-        free_size + ((uint8_t *)old_addr - (uint8_t *)shifted);
+    set_tail_free(shifted,
+                  free_size + ((uint8_t *)old_addr - (uint8_t *)shifted));
 
     // Update the next segment tail of the segment header to the shifted
     // tail
-    header->next_seg_tail = shifted;
+    set_head_next_tail(header, shifted);
 
     // Since we shrunk the segment by size many bytes, it is only logically
     // to assume the usable user data shrinks by size many bytes, too
-    header->seg_size -= size;
+    set_head_size(header, head_size(header) - size);
 
     // Update the preceding segment tail of the next header to the new,
     // shifted tail
-    next->prev_seg_tail = shifted;
+    set_head_prev_tail(next, shifted);
 
     // If we add the header size and usable user size to the header address,
     // we need to obtain the tail address
     ASSERT((uint8_t *)header + sizeof(struct seg_head_s) +
-               round_up(header->seg_size, ALIGNMENT) ==
-           (uint8_t *)header->next_seg_tail);
+               round_up(head_size(header), ALIGNMENT) ==
+           (uint8_t *)head_next_tail(header));
 
     // If we add the tail size and number of subsequent free bytes to the
     // new table, we should obtain the same value as adding the old free
     // size of the old segment, plus the tail size, to the old tail address
-    ASSERT((uint8_t *)header->next_seg_tail + sizeof(struct seg_tail_s) +
-               header->next_seg_tail->free_following ==
+    ASSERT((uint8_t *)head_next_tail(header) + sizeof(struct seg_tail_s) +
+               tail_free(head_next_tail(header)) ==
            (uint8_t *)old_addr + sizeof(struct seg_tail_s) + free_size);
 
     // Since we are shrinking a segment, the free following segment size
     // needs to be the old free following segment size plus the desired size
     // to shrink by
-    ASSERT(header->next_seg_tail->free_following ==
+    ASSERT(tail_free(head_next_tail(header)) ==
            free_size + ((uint8_t *)old_addr - (uint8_t *)shifted));
-    if (old_addr == get_last_addr()) {
-        set_last_addr(header->next_seg_tail);
-    }
+
+    // Announce the grown gap to the gap index
+    gap_link(head_next_tail(header));
+
+    // Shrinking a large chunk may leave a gap large enough to be purged
+    purge_range((uint8_t *)shifted + sizeof(*shifted) + MIN_GAP_SIZE,
+                (uint8_t *)shifted + sizeof(*shifted) + tail_free(shifted));
+
+    move_last_addr(old_addr, head_next_tail(header));
 
     return SUCCESS;
 }
@@ -720,24 +795,28 @@ int expand_segment(uint8_t *addr, size_t size) {
     seg_head_s *header = (seg_head_s *)(addr - sizeof(struct seg_head_s));
 
     // Store the old free following size, we need that later
-    size_t free_size = header->next_seg_tail->free_following;
+    size_t free_size = tail_free(head_next_tail(header));
 
-    size_t effective_size = round_up(header->seg_size + size, ALIGNMENT);
+    size_t effective_size = round_up(head_size(header) + size, ALIGNMENT);
 
     // If we are trying to expand larger than there is space available, this
     // is an invalid operation
     if (effective_size > round_up(free_size, ALIGNMENT) +
-                             round_up(header->seg_size, ALIGNMENT)) {
+                             round_up(head_size(header), ALIGNMENT)) {
         pr_error("Sorry, invalid arguments. %zu is smaller than %zu", free_size,
                  size);
         return ERROR;
     }
 
     // Store the old current segment tail addres
-    seg_tail_s *old_addr = header->next_seg_tail;
+    seg_tail_s *old_addr = head_next_tail(header);
 
     // Store the old header address of the very next header
-    seg_head_s *next = header->next_seg_tail->next_seg_head;
+    seg_head_s *next = tail_next_head(head_next_tail(header));
+
+    // The new tail is written into the gap, withdraw the gap from the gap
+    // index before
+    gap_unlink(old_addr);
 
     // Add a new "shifted" header tail shifted by a size of, well, size
     // bytes away from the old header tail
@@ -747,56 +826,61 @@ int expand_segment(uint8_t *addr, size_t size) {
     // Fill the new shifted tail with the information of the old tail
 
     // The previous header obviously is the current segment header
-    shifted->prev_seg_head = header;
+    set_tail_prev_head(shifted, header);
 
     // The next header is the old next header we stored earlier
-    shifted->next_seg_head = next;
+    set_tail_next_head(shifted, next);
 
     // The number of free_following bytes is the old number of free
     // following bytes minus the size size we shrunk by!
-    shifted->free_following =
-        free_size - ((uint8_t *)shifted - (uint8_t *)old_addr);
+    set_tail_free(shifted,
+                  free_size - ((uint8_t *)shifted - (uint8_t *)old_addr));
 
     // Now, let's point the subsequent tail of the header to the next
     // segment
-    header->next_seg_tail = shifted;
+    set_head_next_tail(header, shifted);
 
     // The header segment size is the old size, plus the size we expanded by
     // Note the new segment bytes are left unmodified, if you want to have a
     // defined state call calloc... but this is of no relevance in this
     // low-level function here and up to the user, that is the calling
     // function
-    header->seg_size += size;
+    set_head_size(header, head_size(header) + size);
 
     // Point the preceding tail of the old next header to the new shifted
     // tail!
-    next->prev_seg_tail = shifted;
+    set_head_prev_tail(next, shifted);
 
     // It's assertion time yet again
 
     // The new tail address needs to be the old header address, plus the
     // segment header size, plus the user data size
     ASSERT((uint8_t *)header + sizeof(struct seg_head_s) +
-               round_up(header->seg_size, ALIGNMENT) ==
-           (uint8_t *)header->next_seg_tail);
+               round_up(head_size(header), ALIGNMENT) ==
+           (uint8_t *)head_next_tail(header));
 
     // If we add the new tail address, the tail size and the new subsequent
     // free_following bytes number, this should add up to the old tail
     // address, plus old tail size, plus old subsequent free size.
-    ASSERT((uint8_t *)header->next_seg_tail + sizeof(struct seg_tail_s) +
-               header->next_seg_tail->free_following ==
+    ASSERT((uint8_t *)head_next_tail(header) + sizeof(struct seg_tail_s) +
+               tail_free(head_next_tail(header)) ==
            (uint8_t *)old_addr + sizeof(struct seg_tail_s) + free_size);
 
     // Also, the number of free-following bytes now needs to match with the
     // old number of free following bytes minus the desired size we expanded
     // by. Quite important, otherwise the storage becomes really
     // inconsistent
-    ASSERT(header->next_seg_tail->free_following ==
+    ASSERT(tail_free(head_next_tail(header)) ==
            free_size - ((uint8_t *)shifted - (uint8_t *)old_addr));
 
-    if (old_addr == get_last_addr()) {
-        set_last_addr(header->next_seg_tail);
-    }
+    // The chunk grew into memory which may have been purged
+    purge_reuse((uint8_t *)old_addr,
+                (uint8_t *)shifted + sizeof(*shifted) + MIN_GAP_SIZE);
+
+    // Announce the rest of the gap to the gap index
+    gap_link(head_next_tail(header));
+
+    move_last_addr(old_addr, head_next_tail(header));
     // Now we are done
 
     return SUCCESS;
@@ -810,6 +894,8 @@ int expand_segment(uint8_t *addr, size_t size) {
 // denotes the user space size
 uint8_t *expand_list(size_t size) {
 
+    seg_list_head_s *start = g_arena->list;
+
     // If the list is not initialized yet, this is bad because at this point
     // this should never happen. Fix your implementation
     if (!start) {
@@ -827,6 +913,16 @@ uint8_t *expand_list(size_t size) {
     int totalsize = (int)(effective_size + sizeof(struct seg_head_s) +
                           sizeof(struct seg_tail_s));
 
+#ifdef COMPACT_CHUNKS
+    // Compact chunks store sizes and offsets within the table in 32 bits, so
+    // the table must not grow beyond 4 GiB
+    if ((size_t)(start->end_addr - (uint8_t *)start) + totalsize + PAGE_SIZE >
+        UINT32_MAX) {
+        pr_error("Storage table too large for compact chunks");
+        return nullptr;
+    }
+#endif
+
     // If the list is empty, expand list by the total size, minus the
     // current list size to obtain a fitting table
     if (!start->first_seg) {
@@ -855,15 +951,15 @@ uint8_t *expand_list(size_t size) {
         // frequent syscalls
         size_t num_pages = (size_t)ceil((double)to_expand / PAGE_SIZE);
 
-        // Now we actually ask the system for more storage of necessary size
-        if (sbrk(num_pages * PAGE_SIZE) == (void *)-1) {
-            // If the returned value is -1, sbrk failed, maybe storage is
-            // full and you should swap with mmap, who knows. We don't need
-            // to care at this point, the only thing we know is that in this
-            // implementation, we cannot proceed
+        // Now we actually ask for more storage of necessary size. Usually it
+        // has been reserved ahead, without holding the lock of the arena
+        if (arena_commit(start->end_addr, num_pages * PAGE_SIZE) == ERROR) {
+            // The range of the arena is exhausted, or the system is out of
+            // memory. The caller may continue in another arena, see
+            // arena_extend()
 
-            pr_error("sbrk error: %s", strerror(errno));
-            exit(EXIT_FAILURE);
+            pr_warning("Could not expand arena: %s", strerror(errno));
+            return nullptr;
         }
 
         // pr_info("Expanded list by %d", num_pages * PAGE_SIZE);
@@ -888,7 +984,7 @@ uint8_t *expand_list(size_t size) {
 
     // The number of subsequent free bytes is already stored in the tail
     // entry, fetch this value
-    size_t trailing_free = end->free_following;
+    size_t trailing_free = tail_free(end);
 
     // The trailing free bytes needs to be smaller than the total size,
     // otherwise the allocator function messed up somewhere by missing this
@@ -902,7 +998,7 @@ uint8_t *expand_list(size_t size) {
     // Very simple assertion: The number of bytes by which we want to expand
     // the table, plus the current number of free following bytes, needs to
     // match the total size of bytes we need for our new segment
-    ASSERT(to_expand + (int)end->free_following == totalsize);
+    ASSERT(to_expand + (int)tail_free(end) == totalsize);
 
     // We only want to expand by pages, not by some smaller values to avoid
     // frequent syscalls
@@ -910,11 +1006,11 @@ uint8_t *expand_list(size_t size) {
 
     // pr_info("Expanding by size %d", to_expand);
 
-    if (sbrk(num_pages * PAGE_SIZE) == (void *)-1) {
-        // In this case, sbrk failed to allocate and we need to abort
+    if (arena_commit(start->end_addr, num_pages * PAGE_SIZE) == ERROR) {
+        // Same as above, the table is left as it is
 
-        pr_error("sbrk error: %s", strerror(errno));
-        exit(EXIT_FAILURE);
+        pr_warning("Could not expand arena: %s", strerror(errno));
+        return nullptr;
     }
 
     // pr_info("Expanded list by %d", to_expand);
@@ -923,14 +1019,19 @@ uint8_t *expand_list(size_t size) {
     // by
     start->end_addr += num_pages * PAGE_SIZE;
 
+    // The trailing gap grows, so it has to be re-announced to the gap index
+    gap_unlink(end);
+
     // Update free following bytes counter of last tail by the number of
     // bytes we expanded the table with
-    end->free_following += num_pages * PAGE_SIZE;
+    set_tail_free(end, tail_free(end) + num_pages * PAGE_SIZE);
+
+    gap_link(end);
 
     // Check that the end_addr pointer is still valid: The address of the
     // last tail, plus the tail size, plus the number of free following
     // bytes matches the end address of the storage table
-    ASSERT((uint8_t *)end + sizeof(*end) + end->free_following ==
+    ASSERT((uint8_t *)end + sizeof(*end) + tail_free(end) ==
            start->end_addr);
 
     return (uint8_t *)end + sizeof(*end);
@@ -939,10 +1040,12 @@ uint8_t *expand_list(size_t size) {
 // Search for a gap or expand the table if no gap is found
 uint8_t *find_free_seg(size_t size) {
 
+    seg_list_head_s *start = g_arena->list;
+
     // If table is not initialized, set up table and expand it
     if (!start) {
 
-        start = create_list();
+        start = g_arena->list = create_list();
 
         // In the unlikely case sbrk failed, return nullptr
         if (!start) {
@@ -953,9 +1056,29 @@ uint8_t *find_free_seg(size_t size) {
 
     // pr_info("Start already initialized");
 
+    // The strategy only applies to the main arena, all other arenas use
+    // next-fit on their own gap array
+    bool is_main = g_arena == arena_main();
+
+    // The controller may switch the alloc function, which has to happen before
+    // the search
+    if (is_main && g_alloc_strat == ADAPTIVE) {
+        adaptive_alloc(start);
+    }
+
+    alloc_function fit = is_main ? g_alloc_function : &next_fit;
+
+    // With huge pages, next-fit would spread the chunks over all huge pages of
+    // the table. Address-ordered first-fit fills the gaps in the huge pages at
+    // the beginning first, so that those at the end are left empty and are
+    // purged or trimmed whole
+    if (fit == &next_fit && get_hugepage_enabled()) {
+        fit = &first_fit;
+    }
+
     // If table is initialized, search for a gap with one of the alloc
     // algorithms set previously
-    uint8_t *new_addr = g_alloc_function(start, size);
+    uint8_t *new_addr = fit(start, size);
 
     // If no gap has been found, the table needs to be expanded and the
     // beginning of the storage table will be returned
@@ -972,8 +1095,22 @@ uint8_t *find_free_seg(size_t size) {
 }
 
 // This function sets the allocation function pointer being used by
-// find_free_seg. Only really useful for debugging purposes
+// find_free_seg. With ADAPTIVE, the controller picks the alloc function from
+// now on, see adaptive.c
 void set_alloc_function(sched_strat_e strat) {
+    g_alloc_strat = strat;
+
+    if (strat == ADAPTIVE) {
+        adaptive_start();
+        return;
+    }
+
+    use_alloc_function(strat);
+}
+
+// This function switches the allocation function pointer and its gap index,
+// without changing the strategy returned by get_alloc_strat
+void use_alloc_function(sched_strat_e strat) {
     switch (strat) {
     case BEST_FIT:
         g_alloc_function = &best_fit;
@@ -987,21 +1124,61 @@ void set_alloc_function(sched_strat_e strat) {
     case WORST_FIT:
         g_alloc_function = &worst_fit;
         break;
+    case SEGREGATED_FIT:
+        g_alloc_function = &segregated_fit;
+        break;
+    case TLSF_FIT:
+        g_alloc_function = &tlsf_fit;
+        break;
+    case BUDDY:
+        // Only small requests are served by the buddy pools, see malloc().
+        // Everything else, including the pools themselves, is placed in the
+        // segment list with first-fit
+        g_alloc_function = &first_fit;
+        break;
+    case GOOD_FIT:
+        g_alloc_function = &good_fit;
+        break;
+    case ADAPTIVE:
+        // The controller only ever uses the strategies above
+        ASSERT(strat != ADAPTIVE);
+        break;
     }
+
+    // Only the gap index of the strategy in use is kept up to date, so it
+    // needs to be rebuilt on every switch
+    set_gap_index(strat, g_arena->list);
 }
 
+// This function returns the strategy set last with set_alloc_function
+sched_strat_e get_alloc_strat() { return g_alloc_strat; }
+
 // This function completely erases the storage table by clearing the last_addr
 // value for next fit, clearing the first segment pointer, by moving the tail of
-// the storage list to the beginning, and by resetting the program break. Only
+// the storage list to the beginning, and by resetting the break. Only
 // useful for debugging.
 void clear_alloc_storage() {
 
-    // Reset last_addr value used by next_fit
-    set_last_addr(nullptr);
+    // Reset the last_addr values used by next_fit
+    clear_last_addr();
+
+    // All gaps vanish together with the storage table, and so do the buddy
+    // pools, slab spans and cached or logged chunks which are chunks of it
+    gap_clear();
+    buddy_clear();
+    slab_clear();
+    tcache_clear();
+    cpucache_clear();
+    free_log_clear();
+
+    // All arenas but the main one simply give back their whole range
+    arena_clear();
+
+    g_arena->chunks = 0;
 
-    // Reset header, tail and program break of storage table header. If
-    // reset_list failed, brk failed and we abort.
-    if (reset_list(start)) {
+    // Reset header, tail and break of storage table header. If reset_list
+    // failed, the break could not be moved and we abort.
+    if (reset_list(g_arena->list)) {
 
         pr_error("Unusual sbreak error: %s", strerror(errno));
 
@@ -2,11 +2,20 @@
  * @brief Implementation of allocation functions
  */
 
+#include "alloc/arena.h"
+#include "alloc/buddy.h"
+#include "alloc/chunk.h"
+#include "alloc/cpucache.h"
 #include "alloc/defines.h"
+#include "alloc/free_log.h"
 #include "alloc/linked_list_mgmt.h"
+#include "alloc/mapped.h"
 #include "alloc/memory_mgmt.h"
+#include "alloc/methods.h"
+#include "alloc/slab.h"
 #include "alloc/storage.h"
 #include "alloc/strats.h"
+#include "alloc/tcache.h"
 #include "alloc/types.h"
 #include <errno.h>
 #include <pthread.h>
@@ -15,8 +24,61 @@
 #include <stdlib.h>
 #include <string.h>
 
-//! Lock for heap access so that threads don't interfere with each other
-pthread_mutex_t storage_lock = PTHREAD_MUTEX_INITIALIZER;
+// Blocks of the buddy pools and objects of the slabs have no chunk header, so
+// the per-thread and per-CPU caches cannot take them. Both are recognized by
+// their address in constant time, without the lock
+static bool is_block(const uint8_t *ptr) {
+    return slab_owns(ptr) || buddy_owns(ptr);
+}
+
+// Gives a pointer back to the locked arena it belongs to. Blocks of the buddy
+// pools and objects of the slabs are recognized by their address. This is
+// independent of the current settings, since they might have changed after the
+// block was allocated
+static void free_locked(arena_s *arena, uint8_t *ptr) {
+    if (arena == arena_main() && slab_owns(ptr)) {
+        slab_free(ptr);
+    } else if (arena == arena_main() && buddy_owns(ptr)) {
+        buddy_free(ptr);
+    } else {
+        remove_segment(ptr);
+    }
+}
+
+// Frees all pointers other threads queued for the locked arena while it was
+// locked, see free()
+static void drain_remote(arena_s *arena) {
+    uint8_t *ptr = arena_take_remote(arena);
+
+    while (ptr) {
+        uint8_t *next = *(uint8_t **)ptr;
+        free_locked(arena, ptr);
+        ptr = next;
+    }
+}
+
+// Searches a gap in the locked arena, like find_free_seg(). If the range of the
+// arena is exhausted, the arena is unlocked, and the search continues in its
+// extent, which is locked instead. Returns nullptr with no arena locked if no
+// extent can be reserved either
+static uint8_t *find_gap(arena_s **arena, size_t size) {
+    uint8_t *gap = find_free_seg(size);
+
+    while (!gap) {
+        arena_unlock(*arena);
+
+        *arena = arena_extend(*arena);
+        if (!*arena) {
+            return nullptr;
+        }
+
+        arena_lock(*arena);
+        drain_remote(*arena);
+        gap = find_free_seg(size);
+    }
+
+    return gap;
+}
 
 // A malloc implementation according to the C23 standard
 
@@ -40,21 +102,75 @@ void *malloc(size_t size) {
         pr_warning("malloc(): Size zero");
         return nullptr;
     }
+
+    // Pointers this thread logged before deferred frees were disabled
+    free_log_flush_disabled();
     // pr_info("Allocating with size %zu", size);
 
-    // Lock mutex
-    pthread_mutex_lock(&storage_lock);
+    // Large requests get a mapping of their own, which is given back to the
+    // system as a whole on free. If mapping fails, the storage table is tried
+    if (size >= get_mmap_threshold()) {
+        uint8_t *mapped = mapped_alloc(size);
+        if (mapped) {
+            pr_info("malloc(): Mapped storage of size %zu at %p", size,
+                    mapped);
+            return mapped;
+        }
+    }
+
+    // Small requests get an object of a slab if the slabs are enabled, or
+    // with the buddy strategy a power-of-two block of a buddy pool. Neither
+    // has a header or tail. Both belong to the main arena. If this fails, the
+    // segment list is tried below
+    bool slab = get_slab_enabled() && size <= SLAB_MAX_SIZE;
+    bool buddy = get_alloc_strat() == BUDDY && size <= BUDDY_MAX_SIZE;
+
+    // Requests the segment list would serve are looked up in the cache of the
+    // calling thread or of the current CPU first, which needs no lock
+    uint8_t *cached = nullptr;
+
+    if (get_tcache_enabled() && size <= TCACHE_MAX_SIZE && !slab && !buddy) {
+        cached = tcache_get(size);
+    } else if (get_cpucache_enabled() && size <= CPUCACHE_MAX_SIZE && !slab &&
+               !buddy) {
+        cached = cpucache_get(size);
+    }
+
+    if (cached) {
+        pr_info("malloc(): Allocated cached storage of size %zu at %p", size,
+                cached);
+        return cached;
+    }
+
+    if (slab || buddy) {
+        arena_lock(arena_main());
+        uint8_t *block = slab ? slab_alloc(size) : buddy_alloc(size);
+
+        if (block) {
+            arena_unlock(arena_main());
+
+            pr_info("malloc(): Allocated small block of size %zu at %p", size,
+                    block);
+            return block;
+        }
+        arena_unlock(arena_main());
+    }
+
+    // Lock the arena of the calling thread. Chunks freed while it was locked
+    // are given back first, so they can be placed again
+    arena_s *arena = arena_home();
+    arena_lock(arena);
+    drain_remote(arena);
 
     // First, we search for a new gap. Either a gap is found or the table is
-    // expanded.
-    uint8_t *new_a = find_free_seg(size);
+    // expanded, possibly into the extent of the arena, which is locked then
+    uint8_t *new_a = find_gap(&arena, size);
 
     // pr_info("Found a gap at address %p\n", new_a);
 
-    // If no gap has been found, this likely means heap storage is exhausted,
-    // that is sbrk failed. Return a nullptr in this case and unlock mutex
+    // If no gap has been found, this likely means storage is exhausted. Return
+    // a nullptr in this case, no arena is locked anymore
     if (!new_a) {
-        pthread_mutex_unlock(&storage_lock);
         pr_error("malloc(): Did not find gap and neither could expand");
         return nullptr;
     }
@@ -63,16 +179,18 @@ void *malloc(size_t size) {
     // found a gap above
     uint8_t *user_a = add_entry(new_a, size);
 
-    // This should always work since we found a gap of sufficient size above,
-    // but in the unlikely case adding an entry failed, we return a nullptr
+    // The gap is large enough, so this only fails if the gap index has no room
+    // for another chunk, see gap_reserve(). Return a nullptr in this case
     if (!user_a) {
-        pthread_mutex_unlock(&storage_lock);
+        arena_unlock(arena);
         pr_error("malloc(): Could not add map entry");
         return nullptr;
     }
 
-    // Unlock mutex
-    pthread_mutex_unlock(&storage_lock);
+    // Unlock mutex. If the table grew into the memory reserved ahead, more is
+    // reserved now, while other threads can use the arena again
+    arena_unlock(arena);
+    arena_maintain(arena);
     // pr_info("Successfully allocated segment of size %zu", size);
 
     pr_info("malloc(): Allocated storage of size %zu at %p", size, user_a);
@@ -118,12 +236,57 @@ void free(void *ptr) {
         return;
     }
 
+    free_log_flush_disabled();
+
+    // Mapped chunks belong to no arena and are unmapped right away
+    if (mapped_owns((uint8_t *)ptr)) {
+        mapped_free((uint8_t *)ptr);
+        pr_info("free(): Unmapped");
+        return;
+    }
+
+    // Chunks of the segment list are kept in the cache of the calling thread
+    // if possible, they are given back to the segment list later in batches
+    if (get_tcache_enabled() && !is_block((uint8_t *)ptr) &&
+        tcache_put((uint8_t *)ptr)) {
+        pr_info("free(): Cached");
+        return;
+    }
+
+    if (!get_tcache_enabled() && get_cpucache_enabled() &&
+        !is_block((uint8_t *)ptr) && cpucache_put((uint8_t *)ptr)) {
+        pr_info("free(): Cached on CPU");
+        return;
+    }
+
+    // With deferred frees, the pointer is only logged. The log is freed at
+    // once when full, sorted by address and under a single lock per arena
+    if (get_free_log_enabled()) {
+        free_log_put((uint8_t *)ptr);
+        pr_info("free(): Logged");
+        return;
+    }
+
     // We simply remove a segment by removing all references to it in the
-    // linked list and/or the storage table header. For that, we lock the mutex
-    // and unlock it afterwards.
-    pthread_mutex_lock(&storage_lock);
-    remove_segment((uint8_t *)ptr);
-    pthread_mutex_unlock(&storage_lock);
+    // linked list and/or the storage table header. For that, we lock the arena
+    // the pointer belongs to and unlock it afterwards.
+    arena_s *arena = arena_of((uint8_t *)ptr);
+
+    // If another thread holds the lock, typically the thread which allocated
+    // the pointer, we do not wait for it. The pointer is queued for the arena
+    // instead, and the next thread locking the arena frees it
+    if (!arena_trylock(arena)) {
+        arena_push_remote(arena, (uint8_t *)ptr);
+        pr_info("free(): Queued for arena");
+        return;
+    }
+
+    drain_remote(arena);
+    free_locked(arena, (uint8_t *)ptr);
+    arena_unlock(arena);
+
+    // Memory the table shrank by is given back without holding the lock
+    arena_maintain(arena);
 
     pr_info("free(): Success");
 }
@@ -144,8 +307,10 @@ void *calloc(size_t n_memb, size_t size) {
     }
 
     // pr_info("Valid pointer");
-    //  Set the entire storage to zeroes
-    set_mem_zero(new_a, n_memb * size);
+    //  Set the entire storage to zeroes. Fresh mappings are zeroed already
+    if (!mapped_owns(new_a)) {
+        set_mem_zero(new_a, n_memb * size);
+    }
 
     // pr_info("Set memory to zero");
 
@@ -204,6 +369,81 @@ void *realloc(void *ptr, size_t size) {
         return new_a;
     }
 
+    // Mapped chunks stay mapped as long as they are large enough, and the
+    // mapping is resized, possibly moving it without copying. Otherwise they
+    // are moved into a storage table like below
+    if (mapped_owns((uint8_t *)ptr)) {
+        size_t mapped = mapped_size((uint8_t *)ptr);
+
+        if (size >= get_mmap_threshold()) {
+            uint8_t *new_a = mapped_realloc((uint8_t *)ptr, size);
+            if (new_a) {
+                pr_info("realloc(): Remapped %p from %zu to %zu at %p", ptr,
+                        mapped, size, new_a);
+                return new_a;
+            }
+        }
+
+        uint8_t *new_a = malloc(size);
+        if (!new_a) {
+            pr_error("realloc(): malloc(): Could not allocate");
+            return nullptr;
+        }
+
+        if (copy_mem((uint8_t *)ptr, new_a, size < mapped ? size : mapped) ==
+            ERROR) {
+            pr_error("realloc(): Could not move memory");
+            return nullptr;
+        }
+
+        mapped_free((uint8_t *)ptr);
+        return (void *)new_a;
+    }
+
+    // Blocks of the buddy pools and objects of the slabs have no header,
+    // their size is given by the pool or slab. A block is kept if the new size
+    // needs a block of the same size, otherwise a new one is allocated like
+    // below. Both only exist in the main arena
+    arena_s *arena = arena_of((uint8_t *)ptr);
+    size_t block_size = 0;
+    bool same_block = false;
+
+    if (arena == arena_main()) {
+        arena_lock(arena);
+        if (slab_owns((uint8_t *)ptr)) {
+            block_size = slab_object_size((uint8_t *)ptr);
+            same_block =
+                size <= SLAB_MAX_SIZE && slab_round_size(size) == block_size;
+        } else if (buddy_owns((uint8_t *)ptr)) {
+            block_size = buddy_block_size((uint8_t *)ptr);
+            same_block = size <= BUDDY_MAX_SIZE &&
+                         buddy_round_size(size) == block_size;
+        }
+        arena_unlock(arena);
+    }
+
+    if (same_block) {
+        pr_info("realloc(): Same block size, do nothing");
+        return ptr;
+    }
+
+    if (block_size) {
+        uint8_t *new_a = malloc(size);
+        if (!new_a) {
+            pr_error("realloc(): malloc(): Could not allocate");
+            return nullptr;
+        }
+
+        if (copy_mem((uint8_t *)ptr, new_a,
+                     size < block_size ? size : block_size) == ERROR) {
+            pr_error("realloc(): Could not move memory");
+            return nullptr;
+        }
+
+        free(ptr);
+        return (void *)new_a;
+    }
+
     // Get the size of allocated storage the segment where ptr points to (if
     // possible. If ptr is an invalid pointer, expect undefined behaviour). This
     // is necessary for expanding to check if the following free size is
@@ -235,7 +475,7 @@ void *realloc(void *ptr, size_t size) {
     if (size < old_size) {
 
         // For shrinking, we need to lock the mutex
-        pthread_mutex_lock(&storage_lock);
+        arena_lock(arena);
 
         // If shrink_segment fails, return nullptr, the old pointer will not be
         // modified. shrink_segment can only fail if the parameters are invalid,
@@ -243,14 +483,14 @@ void *realloc(void *ptr, size_t size) {
         if (shrink_segment((uint8_t *)ptr, old_size - size)) {
 
             // Unlock mutex
-            pthread_mutex_unlock(&storage_lock);
+            arena_unlock(arena);
 
             // Return nullptr
             return nullptr;
         } else {
 
             // Unlock mutex
-            pthread_mutex_unlock(&storage_lock);
+            arena_unlock(arena);
 
             // Return same pointer as being passed to realloc
 
@@ -263,7 +503,7 @@ void *realloc(void *ptr, size_t size) {
     // pr_info("Could not shrink, trying to expand");
 
     // Lock mutex
-    pthread_mutex_lock(&storage_lock);
+    arena_lock(arena);
 
     // Try to expand the segment by the new size minus the existing size, if
     // the following gap size is larger than the to be expanded size.
@@ -284,13 +524,13 @@ void *realloc(void *ptr, size_t size) {
         if (expand_segment((uint8_t *)ptr, size - old_size)) {
 
             // Unlock mutex
-            pthread_mutex_unlock(&storage_lock);
+            arena_unlock(arena);
 
             return nullptr;
         } else {
 
             // Unlock mutex.
-            pthread_mutex_unlock(&storage_lock);
+            arena_unlock(arena);
 
             // pr_info("Successfully expanded");
 
@@ -303,7 +543,7 @@ void *realloc(void *ptr, size_t size) {
     }
 
     // Unlock mutex
-    pthread_mutex_unlock(&storage_lock);
+    arena_unlock(arena);
 
     // pr_info("Could neither shrink nor expand. Trying to aquire new storage "
     //"segment");
@@ -361,4 +601,169 @@ void *realloc(void *ptr, size_t size) {
 
     // Return new address
     return (void *)new_a;
-}
\ No newline at end of file
+}
+
+// Like malloc(), but the strategy is only asked once per gap. After a chunk is
+// added, the gap behind its tail is used for the next one if it is large
+// enough, which is where the strategy would mostly have found one anyway
+size_t julmalloc_alloc_batch(size_t size, size_t n, void **out) {
+
+    if (!size || !n) {
+        pr_warning("julmalloc_alloc_batch(): Size or count zero");
+        return 0;
+    }
+
+    size_t count = 0;
+
+    // Large requests get mappings of their own like in malloc(). Since each
+    // needs a system call anyway, there is nothing to batch
+    if (size >= get_mmap_threshold()) {
+        while (count < n) {
+            uint8_t *mapped = mapped_alloc(size);
+            if (!mapped) {
+                break;
+            }
+            out[count++] = mapped;
+        }
+    }
+
+    // Small requests are served by the slabs or buddy pools like in malloc()
+    bool slab = get_slab_enabled() && size <= SLAB_MAX_SIZE;
+    bool buddy = get_alloc_strat() == BUDDY && size <= BUDDY_MAX_SIZE;
+
+    if (slab || buddy) {
+        arena_lock(arena_main());
+        while (count < n) {
+            uint8_t *block = slab ? slab_alloc(size) : buddy_alloc(size);
+            if (!block) {
+                break;
+            }
+            out[count++] = block;
+        }
+        arena_unlock(arena_main());
+    }
+
+    size_t total_size =
+        sizeof(seg_head_s) + round_up(size, ALIGNMENT) + sizeof(seg_tail_s);
+
+    arena_s *arena = arena_home();
+    arena_lock(arena);
+    drain_remote(arena);
+
+    while (count < n) {
+
+        // If no gap has been found and the table could not be expanded,
+        // storage is exhausted. The spaces allocated so far are kept, and no
+        // arena is locked anymore
+        uint8_t *new_a = find_gap(&arena, size);
+        if (!new_a) {
+            pr_error("julmalloc_alloc_batch(): Did not find gap and neither "
+                     "could expand");
+            break;
+        }
+
+        // Carve chunks from the gap until it is too small
+        while (new_a && count < n) {
+            uint8_t *user_a = add_entry(new_a, size);
+
+            // The gap is large enough, so this only fails if the gap index
+            // has no room for another chunk
+            if (!user_a) {
+                pr_error("julmalloc_alloc_batch(): Could not add map entry");
+                break;
+            }
+            out[count++] = user_a;
+
+            seg_tail_s *tail =
+                head_next_tail((seg_head_s *)(user_a - sizeof(seg_head_s)));
+            new_a = tail_free(tail) >= total_size ?
+                        (uint8_t *)tail + sizeof(*tail) :
+                        nullptr;
+        }
+
+        if (new_a && count < n) {
+            break;
+        }
+    }
+
+    if (arena) {
+        arena_unlock(arena);
+        arena_maintain(arena);
+    }
+
+    pr_info("julmalloc_alloc_batch(): Allocated %zu of %zu spaces of size %zu",
+            count, n, size);
+
+    return count;
+}
+
+// Restores the heap order below index i of an array of n pointers, with the
+// largest address at the root
+static void sift_down(void **ptrs, size_t i, size_t n) {
+    while (2 * i + 1 < n) {
+        size_t child = 2 * i + 1;
+        if (child + 1 < n &&
+            (uintptr_t)ptrs[child + 1] > (uintptr_t)ptrs[child]) {
+            child++;
+        }
+        if ((uintptr_t)ptrs[i] >= (uintptr_t)ptrs[child]) {
+            return;
+        }
+        void *swap = ptrs[i];
+        ptrs[i] = ptrs[child];
+        ptrs[child] = swap;
+        i = child;
+    }
+}
+
+// Heapsort, since qsort() may allocate itself while an arena is locked
+static void sort_addresses(void **ptrs, size_t n) {
+    for (size_t i = n / 2; i-- > 0;) {
+        sift_down(ptrs, i, n);
+    }
+    for (size_t end = n; end-- > 1;) {
+        void *swap = ptrs[0];
+        ptrs[0] = ptrs[end];
+        ptrs[end] = swap;
+        sift_down(ptrs, 0, end);
+    }
+}
+
+// Like free(), but sorted by address. Pointers of an arena are then next to
+// each other, and each chunk is merged into the gap the previous one left
+void julmalloc_free_batch(void **ptrs, size_t n) {
+
+    sort_addresses(ptrs, n);
+
+    size_t i = 0;
+
+    // nullptr entries are sorted to the front
+    while (i < n && !ptrs[i]) {
+        i++;
+    }
+
+    while (i < n) {
+
+        // Mapped chunks need no lock
+        if (mapped_owns((uint8_t *)ptrs[i])) {
+            mapped_free((uint8_t *)ptrs[i]);
+            i++;
+            continue;
+        }
+
+        arena_s *arena = arena_of((uint8_t *)ptrs[i]);
+        arena_lock(arena);
+        drain_remote(arena);
+
+        while (i < n && !mapped_owns((uint8_t *)ptrs[i]) &&
+               arena_of((uint8_t *)ptrs[i]) == arena) {
+            free_locked(arena, (uint8_t *)ptrs[i]);
+            i++;
+        }
+
+        arena_unlock(arena);
+        arena_maintain(arena);
+    }
+
+    pr_info("julmalloc_free_batch(): Freed %zu spaces", n);
+}
@@ -0,0 +1,289 @@
+#include "alloc/purge.h"
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/heap_lock.h"
+#include "alloc/hugepage.h"
+
+#include <errno.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+#include <sys/mman.h>
+
+// Words of the bitmap of an arena, one bit per page of its reserved range
+#define PURGE_MAP_WORDS (ARENA_RESERVE / PAGE_SIZE / 64)
+
+#define PURGE_MAP_SIZE (PURGE_MAP_WORDS * sizeof(uint64_t))
+
+static atomic_int g_advice = PURGE_FREE;
+
+// Set once the kernel rejected MADV_FREE, which it only knows since 4.5
+static atomic_bool g_no_madv_free = false;
+
+static atomic_size_t g_purged = 0;
+static atomic_size_t g_advised = 0;
+
+void set_purge_advice(purge_advice_e advice) {
+    atomic_store(&g_advice, advice);
+}
+
+purge_advice_e get_purge_advice() {
+    return (purge_advice_e)atomic_load(&g_advice);
+}
+
+static bool is_purged(const uint64_t *map, size_t page) {
+    return map[page / 64] >> (page % 64) & 1;
+}
+
+// Sets or clears the bits of the pages [page, end) a word at a time and
+// returns the number of bits changed
+static size_t mark(uint64_t *map, size_t page, size_t end, bool purged) {
+    size_t changed = 0;
+
+    while (page < end) {
+        size_t bits = 64 - page % 64;
+        if (bits > end - page) {
+            bits = end - page;
+        }
+
+        uint64_t mask = bits == 64 ? ~(uint64_t)0 : ((uint64_t)1 << bits) - 1;
+        uint64_t *word = &map[page / 64];
+        uint64_t old = *word;
+
+        mask <<= page % 64;
+        *word = purged ? old | mask : old & ~mask;
+        changed += (size_t)__builtin_popcountll(old ^ *word);
+        page += bits;
+    }
+
+    return changed;
+}
+
+// Gives a run of whole pages back to the kernel
+static bool advise(uint8_t *addr, size_t size) {
+#ifdef MADV_FREE
+    if (get_purge_advice() == PURGE_FREE && !atomic_load(&g_no_madv_free)) {
+        if (!madvise(addr, size, MADV_FREE)) {
+            return true;
+        }
+        if (errno != EINVAL) {
+            pr_warning("madvise error: %s", strerror(errno));
+            return false;
+        }
+        atomic_store(&g_no_madv_free, true);
+    }
+#endif
+
+    if (madvise(addr, size, MADV_DONTNEED)) {
+        pr_warning("madvise error: %s", strerror(errno));
+        return false;
+    }
+    return true;
+}
+
+// The bitmap is only mapped on the first purge, so arenas whose gaps never
+// grow large enough do not pay for it. Its pages are only faulted in where
+// pages of the range are purged
+static uint64_t *purge_map(arena_s *arena) {
+    if (!arena->purged) {
+        uint64_t *map = mmap(nullptr, PURGE_MAP_SIZE, PROT_READ | PROT_WRITE,
+                             MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+        if (map == MAP_FAILED) {
+            pr_warning("mmap error: %s", strerror(errno));
+            return nullptr;
+        }
+        arena->purged = map;
+    }
+    return arena->purged;
+}
+
+// Queues a run to be advised once the arena is unlocked. If the queue is full,
+// the run is advised right away
+static void queue_run(arena_s *arena, uint8_t *addr, size_t size) {
+    heap_lock(&arena->purge_lock);
+
+    size_t runs = atomic_load_explicit(&arena->queued_runs,
+                                       memory_order_relaxed);
+    if (runs < PURGE_QUEUE) {
+        arena->queued[runs] = (purge_run_s){.addr = addr, .size = size};
+        atomic_store_explicit(&arena->queued_runs, runs + 1,
+                              memory_order_relaxed);
+        heap_unlock(&arena->purge_lock);
+        return;
+    }
+
+    heap_unlock(&arena->purge_lock);
+
+    if (advise(addr, size)) {
+        atomic_fetch_add(&g_advised, size);
+    }
+}
+
+void purge_range(uint8_t *from, uint8_t *to) {
+    arena_s *arena = g_arena;
+    size_t unit = get_hugepage_enabled() ? HUGE_PAGE_SIZE : PAGE_SIZE;
+
+    // Huge pages still holding chunks are not split up by purging a part
+    uint8_t *first = (uint8_t *)round_up((uintptr_t)from, unit);
+    uint8_t *last = (uint8_t *)((uintptr_t)to / unit * unit);
+
+    if (get_purge_advice() == PURGE_NONE || last < first + PURGE_MIN_SIZE) {
+        return;
+    }
+
+    ASSERT(first >= arena->base && last <= arena->limit);
+
+    uint64_t *map = purge_map(arena);
+    if (!map) {
+        return;
+    }
+
+    size_t page = (first - arena->base) / PAGE_SIZE;
+    size_t end = (last - arena->base) / PAGE_SIZE;
+
+    // Only runs of pages not purged before are queued. When a gap grows by
+    // its neighbor, this is just the memory of the neighbor
+    while (page < end) {
+        if (page % 64 == 0 && end - page >= 64 && !~map[page / 64]) {
+            page += 64;
+            continue;
+        }
+        if (is_purged(map, page)) {
+            page++;
+            continue;
+        }
+
+        size_t run = page;
+        while (run < end && !is_purged(map, run)) {
+            run++;
+        }
+
+        size_t bytes = mark(map, page, run, true) * PAGE_SIZE;
+        arena->purged_bytes += bytes;
+        atomic_fetch_add(&g_purged, bytes);
+
+        queue_run(arena, arena->base + page * PAGE_SIZE, bytes);
+
+        page = run;
+    }
+}
+
+// One thread advises the queue at a time, the others return right away. A run
+// is taken off the queue before advising it, so that the lock of the queue is
+// not held during madvise()
+void purge_flush(arena_s *arena) {
+    if (!atomic_load_explicit(&arena->queued_runs, memory_order_relaxed) ||
+        !heap_trylock(&arena->advise_lock)) {
+        return;
+    }
+
+    heap_lock(&arena->purge_lock);
+
+    size_t runs;
+    while ((runs = atomic_load_explicit(&arena->queued_runs,
+                                        memory_order_relaxed))) {
+        purge_run_s run = arena->queued[runs - 1];
+        arena->advising = run;
+        atomic_store_explicit(&arena->queued_runs, runs - 1,
+                              memory_order_relaxed);
+        heap_unlock(&arena->purge_lock);
+
+        // Pages which could not be advised stay marked, they are purged again
+        // once reused and freed
+        if (advise(run.addr, run.size)) {
+            atomic_fetch_add(&g_advised, run.size);
+        }
+
+        heap_lock(&arena->purge_lock);
+        arena->advising = (purge_run_s){};
+    }
+
+    heap_unlock(&arena->purge_lock);
+    heap_unlock(&arena->advise_lock);
+}
+
+static bool overlaps(const purge_run_s *run, uint8_t *from, uint8_t *to) {
+    return run->size && run->addr < to && from < run->addr + run->size;
+}
+
+// Queued runs overlapping the range are dropped, and their pages lose their
+// mark. A run being advised right now is waited for, since advising it after
+// a chunk is placed on its pages would drop the contents of the chunk
+static void drop_runs(arena_s *arena, uint8_t *from, uint8_t *to) {
+    heap_lock(&arena->purge_lock);
+
+    size_t runs = atomic_load_explicit(&arena->queued_runs,
+                                       memory_order_relaxed);
+    for (size_t i = runs; i-- > 0;) {
+        purge_run_s run = arena->queued[i];
+        if (!overlaps(&run, from, to)) {
+            continue;
+        }
+
+        arena->queued[i] = arena->queued[--runs];
+
+        size_t page = (run.addr - arena->base) / PAGE_SIZE;
+        size_t bytes = mark(arena->purged, page, page + run.size / PAGE_SIZE,
+                            false) *
+                       PAGE_SIZE;
+        arena->purged_bytes -= bytes;
+        atomic_fetch_sub(&g_purged, bytes);
+    }
+    atomic_store_explicit(&arena->queued_runs, runs, memory_order_relaxed);
+
+    while (overlaps(&arena->advising, from, to)) {
+        heap_unlock(&arena->purge_lock);
+        heap_lock(&arena->purge_lock);
+    }
+
+    heap_unlock(&arena->purge_lock);
+}
+
+// Called on every placement, so the common case of an arena without purged
+// pages returns right away
+void purge_reuse(uint8_t *from, uint8_t *to) {
+    arena_s *arena = g_arena;
+
+    if (!arena->purged_bytes) {
+        return;
+    }
+
+    if (to > arena->limit) {
+        to = arena->limit;
+    }
+
+    size_t page = ((uintptr_t)from - (uintptr_t)arena->base) / PAGE_SIZE;
+    size_t end = round_up((uintptr_t)to - (uintptr_t)arena->base, PAGE_SIZE) /
+                 PAGE_SIZE;
+
+    size_t bytes = mark(arena->purged, page, end, false) * PAGE_SIZE;
+    arena->purged_bytes -= bytes;
+    atomic_fetch_sub(&g_purged, bytes);
+
+    // Only pages which were marked can belong to a run not advised yet
+    if (bytes) {
+        drop_runs(arena, arena->base + page * PAGE_SIZE,
+                  arena->base + end * PAGE_SIZE);
+    }
+}
+
+// Dropping the pages of the bitmap clears it
+void purge_forget(arena_s *arena) {
+    if (!arena->purged_bytes) {
+        return;
+    }
+
+    if (madvise(arena->purged, PURGE_MAP_SIZE, MADV_DONTNEED)) {
+        memset(arena->purged, 0, PURGE_MAP_SIZE);
+    }
+
+    atomic_fetch_sub(&g_purged, arena->purged_bytes);
+    arena->purged_bytes = 0;
+    atomic_store(&arena->queued_runs, 0);
+}
+
+void get_purge_stats(purge_stats_s *stats) {
+    stats->purged = atomic_load(&g_purged);
+    stats->advised = atomic_load(&g_advised);
+}
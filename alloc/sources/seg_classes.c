@@ -0,0 +1,152 @@
+#include "alloc/seg_classes.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// List node of a gap. Since every indexed gap has at least MIN_GAP_SIZE free
+// bytes, the node is stored right at the beginning of the gap itself, that is
+// directly after the tail in front of the gap
+typedef struct seg_class_node_s {
+    seg_tail_s *prev; /**< Tail of the previous gap in the same class */
+    seg_tail_s *next; /**< Tail of the next gap in the same class */
+} seg_class_node_s;
+
+// First gap of each size class, nullptr if a class is empty
+static seg_tail_s *class_heads[NUM_SEG_CLASSES];
+
+// One bit per size class, set if the class is not empty. Allows to find the
+// next larger non-empty class without looking at every single class
+static uint64_t class_map[NUM_SEG_CLASSES / 64];
+
+static seg_class_node_s *node_of(seg_tail_s *tail) {
+    return (seg_class_node_s *)((uint8_t *)tail + sizeof(*tail));
+}
+
+// Maps a gap size to its size class. Small gaps are binned exactly in steps of
+// ALIGNMENT, larger ones by the position of their highest bit
+static size_t size_class(size_t size) {
+    if (size < SEG_CLASS_LINEAR_LIMIT) {
+        return size / ALIGNMENT;
+    }
+
+    size_t log = 63 - __builtin_clzll(size);
+
+    return SEG_CLASS_LINEAR_LIMIT / ALIGNMENT + log -
+           (63 - __builtin_clzll(SEG_CLASS_LINEAR_LIMIT));
+}
+
+// Returns the first non-empty class larger than or equal to class, or
+// NUM_SEG_CLASSES if there is none
+static size_t next_class(size_t class) {
+    for (size_t word = class / 64; word < NUM_SEG_CLASSES / 64; word++) {
+
+        uint64_t bits = class_map[word];
+
+        // Mask out the classes below class in the first word
+        if (word == class / 64) {
+            bits &= ~0ULL << (class % 64);
+        }
+
+        if (bits) {
+            return word * 64 + __builtin_ctzll(bits);
+        }
+    }
+    return NUM_SEG_CLASSES;
+}
+
+// Pushes the gap in front of its class list
+static void seg_class_insert(seg_tail_s *tail) {
+    size_t class = size_class(tail_free(tail));
+
+    ASSERT(class < NUM_SEG_CLASSES);
+
+    seg_class_node_s *node = node_of(tail);
+
+    node->prev = nullptr;
+    node->next = class_heads[class];
+
+    if (node->next) {
+        node_of(node->next)->prev = tail;
+    }
+
+    class_heads[class] = tail;
+    class_map[class / 64] |= 1ULL << (class % 64);
+}
+
+// Unlinks the gap from its class list
+static void seg_class_remove(seg_tail_s *tail) {
+    size_t class = size_class(tail_free(tail));
+    seg_class_node_s *node = node_of(tail);
+
+    if (node->prev) {
+        node_of(node->prev)->next = node->next;
+    } else {
+
+        // The gap is the first one of its class
+        ASSERT(class_heads[class] == tail);
+        class_heads[class] = node->next;
+    }
+
+    if (node->next) {
+        node_of(node->next)->prev = node->prev;
+    }
+
+    if (!class_heads[class]) {
+        class_map[class / 64] &= ~(1ULL << (class % 64));
+    }
+}
+
+static void seg_class_clear() {
+    for (size_t i = 0; i < NUM_SEG_CLASSES; i++) {
+        class_heads[i] = nullptr;
+    }
+    for (size_t i = 0; i < NUM_SEG_CLASSES / 64; i++) {
+        class_map[i] = 0;
+    }
+}
+
+const gap_index_s seg_class_index = {
+    .insert = &seg_class_insert,
+    .remove = &seg_class_remove,
+    .clear = &seg_class_clear,
+};
+
+// Any gap of a class larger than the class of total_size fits. Gaps of the
+// exact classes below SEG_CLASS_LINEAR_LIMIT fit as well, since total_size is a
+// multiple of ALIGNMENT. Only the power-of-two class of total_size itself can
+// hold gaps too small, which are skipped.
+seg_tail_s *seg_class_find(size_t total_size) {
+
+    size_t class = size_class(total_size);
+
+    if (class >= NUM_SEG_CLASSES) {
+        return nullptr;
+    }
+
+    seg_tail_s *iter = class_heads[class];
+
+    // Only look at a few gaps of the own class, as long as there is a larger
+    // class to fall back to. This keeps the search time independent of the
+    // number of gaps
+    size_t larger = next_class(class + 1);
+
+    for (size_t i = 0; iter && (i < SEG_CLASS_SCAN_LIMIT ||
+                                larger == NUM_SEG_CLASSES);
+         i++) {
+        if (tail_free(iter) >= total_size) {
+            return iter;
+        }
+        iter = node_of(iter)->next;
+    }
+
+    if (larger == NUM_SEG_CLASSES) {
+        return nullptr;
+    }
+
+    ASSERT(tail_free(class_heads[larger]) >= total_size);
+
+    return class_heads[larger];
+}
@@ -0,0 +1,415 @@
+#include "alloc/slab.h"
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/types.h"
+
+#include <errno.h>
+#include <signal.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <sys/syscall.h>
+#include <unistd.h>
+
+// A span of SLAB_SPAN_PAGES pages, allocated as a single chunk of the segment
+// list. The descriptor is right in front of the first page boundary of the
+// chunk, where the pages start
+typedef struct slab_span_s {
+    struct slab_span_s *prev; /**< Previous span with free pages */
+    struct slab_span_s *next; /**< Next span with free pages */
+    uint8_t *chunk;           /**< Chunk of the segment list holding it */
+    uint8_t *base;            /**< First page, aligned to PAGE_SIZE */
+    uint64_t free_pages;      /**< One bit per page, set if not used by a slab */
+} slab_span_s;
+
+// A slab is one page holding objects of a single size. The descriptor is at the
+// beginning of the page, so that the slab of an object is found by masking its
+// address with the page size. The objects themselves have no header at all
+typedef struct slab_s {
+    struct slab_s *prev; /**< Previous partially used slab of the same class */
+    struct slab_s *next; /**< Next partially used slab of the same class */
+    slab_span_s *span;   /**< Span the page belongs to */
+    uint8_t *objects;    /**< First object */
+    size_t size;         /**< Size of each object */
+    size_t slab_class;   /**< Size class of the objects */
+    size_t owner;        /**< Owner slot of the thread allocating from it */
+    size_t count;        /**< Number of objects in the slab */
+    size_t used;         /**< Number of allocated objects */
+    uint64_t free_map[4]; /**< One bit per object, set if the object is free */
+} slab_s;
+
+// Object sizes of the size classes. Steps of ALIGNMENT up to 128 bytes, then
+// four classes per power of two
+static const size_t slab_sizes[NUM_SLAB_CLASSES] = {
+    16, 32, 48, 64, 80, 96, 112, 128, 160, 192, 224, 256, 320, 384, 448, 512};
+
+// Partially used slabs of each owner slot and class. Only slabs in these lists
+// have free objects
+static slab_s *partial[SLAB_OWNERS][NUM_SLAB_CLASSES];
+
+// Thread ID holding each owner slot, 0 if the slot is free. Like all state of
+// the slabs, this is only accessed under the lock of the main arena
+static pid_t owner_tids[SLAB_OWNERS];
+
+// Owner slots handed out round-robin once all slots are held by live threads
+static size_t next_shared = 0;
+
+// Owner slot of the calling thread plus one, 0 if it has none yet. In the
+// static TLS block, so that looking it up never allocates
+static thread_local size_t thread_owner
+    __attribute__((tls_model("initial-exec"))) = 0;
+
+// Size of the pages of a span
+#define SLAB_SPAN_SIZE (SLAB_SPAN_PAGES * (size_t)PAGE_SIZE)
+
+// Number of slots of the range of the main arena, which spans are placed in
+#define SLAB_SLOTS (ARENA_RESERVE / SLAB_SPAN_SIZE)
+
+// First page of the span starting in each slot of SLAB_SPAN_SIZE bytes of the
+// range of the main arena, nullptr if none. The pages of a span are as large
+// as a slot, so an address belongs to the span starting in its own slot or in
+// the slot before. Read without the lock of the main arena by slab_owns(), so
+// stale entries only ever name spans which do not overlap the address
+static _Atomic(uint8_t *) span_bases[SLAB_SLOTS];
+
+// Spans with at least one free page
+static slab_span_s *free_spans = nullptr;
+
+static size_t span_count = 0;
+
+static bool slab_enabled = false;
+
+static size_t class_of(size_t size) {
+    if (size <= 128) {
+        return size ? (size - 1) / 16 : 0;
+    }
+    if (size <= 256) {
+        return 8 + (size - 129) / 32;
+    }
+    return 12 + (size - 257) / 64;
+}
+
+// Slots are not given back when a thread exits, since that would need a
+// destructor registered per thread, which may allocate. Instead, slots of
+// threads which have exited are taken over once all slots are held. Their
+// partially used slabs go along with them
+static bool thread_alive(pid_t tid) {
+    return syscall(SYS_tgkill, getpid(), tid, 0) == 0 || errno != ESRCH;
+}
+
+static size_t owner_of_thread() {
+    if (thread_owner) {
+        return thread_owner - 1;
+    }
+
+    pid_t tid = (pid_t)syscall(SYS_gettid);
+    size_t slot = SLAB_OWNERS;
+
+    for (size_t i = 0; i < SLAB_OWNERS && slot == SLAB_OWNERS; i++) {
+        if (!owner_tids[i]) {
+            slot = i;
+        }
+    }
+    for (size_t i = 0; i < SLAB_OWNERS && slot == SLAB_OWNERS; i++) {
+        if (!thread_alive(owner_tids[i])) {
+            slot = i;
+        }
+    }
+
+    // With more live threads than slots, some threads have to share
+    if (slot == SLAB_OWNERS) {
+        slot = next_shared++ % SLAB_OWNERS;
+    } else {
+        owner_tids[slot] = tid;
+    }
+
+    thread_owner = slot + 1;
+    return slot;
+}
+
+static size_t slot_of(const uint8_t *addr) {
+    return (size_t)(addr - arena_main()->base) / SLAB_SPAN_SIZE;
+}
+
+// The descriptor of a span lies right in front of its pages. Any slack the
+// alignment leaves is in front of the descriptor
+static slab_span_s *span_at(uint8_t *base) {
+    return (slab_span_s *)(base - sizeof(slab_span_s));
+}
+
+static void push_span(slab_span_s *span) {
+    span->prev = nullptr;
+    span->next = free_spans;
+
+    if (span->next) {
+        span->next->prev = span;
+    }
+
+    free_spans = span;
+}
+
+static void unlink_span(slab_span_s *span) {
+    if (span->prev) {
+        span->prev->next = span->next;
+    } else {
+        ASSERT(free_spans == span);
+        free_spans = span->next;
+    }
+
+    if (span->next) {
+        span->next->prev = span->prev;
+    }
+}
+
+static slab_s **partial_of(slab_s *slab) {
+    return &partial[slab->owner][slab->slab_class];
+}
+
+static void push_partial(slab_s *slab) {
+    slab_s **head = partial_of(slab);
+
+    slab->prev = nullptr;
+    slab->next = *head;
+
+    if (slab->next) {
+        slab->next->prev = slab;
+    }
+
+    *head = slab;
+}
+
+static void unlink_partial(slab_s *slab) {
+    if (slab->prev) {
+        slab->prev->next = slab->next;
+    } else {
+        ASSERT(*partial_of(slab) == slab);
+        *partial_of(slab) = slab->next;
+    }
+
+    if (slab->next) {
+        slab->next->prev = slab->prev;
+    }
+}
+
+// Allocates a new span as a chunk of the segment list. The chunk is one page
+// larger than the span, so that the pages can be aligned to PAGE_SIZE
+static slab_span_s *create_span() {
+    size_t size =
+        sizeof(slab_span_s) + PAGE_SIZE + SLAB_SPAN_PAGES * (size_t)PAGE_SIZE;
+
+    uint8_t *gap = find_free_seg(size);
+    if (!gap) {
+        return nullptr;
+    }
+
+    uint8_t *chunk = add_entry(gap, size);
+    if (!chunk) {
+        return nullptr;
+    }
+
+    uint8_t *base =
+        (uint8_t *)round_up((uintptr_t)chunk + sizeof(slab_span_s), PAGE_SIZE);
+    slab_span_s *span = span_at(base);
+
+    span->chunk = chunk;
+    span->base = base;
+    span->free_pages = ~0ULL >> (64 - SLAB_SPAN_PAGES);
+
+    push_span(span);
+    atomic_store_explicit(&span_bases[slot_of(base)], base,
+                          memory_order_relaxed);
+    span_count++;
+
+    return span;
+}
+
+// Sets up a slab for a size class and owner slot on a free page of any span.
+// Spans are shared by all owners, but pages are not. Only spans with free pages
+// are in free_spans, so the first one has a page
+static slab_s *create_slab(size_t owner, size_t slab_class) {
+    slab_span_s *span = free_spans;
+
+    if (!span) {
+        span = create_span();
+        if (!span) {
+            return nullptr;
+        }
+    }
+
+    size_t page = __builtin_ctzll(span->free_pages);
+    span->free_pages &= ~(1ULL << page);
+
+    if (!span->free_pages) {
+        unlink_span(span);
+    }
+
+    slab_s *slab = (slab_s *)(span->base + page * PAGE_SIZE);
+
+    slab->span = span;
+    slab->objects = (uint8_t *)slab + round_up(sizeof(*slab), ALIGNMENT);
+    slab->size = slab_sizes[slab_class];
+    slab->slab_class = slab_class;
+    slab->owner = owner;
+    slab->count = (PAGE_SIZE - round_up(sizeof(*slab), ALIGNMENT)) / slab->size;
+    slab->used = 0;
+
+    ASSERT(slab->count <= sizeof(slab->free_map) * 8);
+
+    for (size_t i = 0; i < sizeof(slab->free_map) / sizeof(uint64_t); i++) {
+        if (slab->count >= (i + 1) * 64) {
+            slab->free_map[i] = ~0ULL;
+        } else if (slab->count > i * 64) {
+            slab->free_map[i] = ~0ULL >> (64 - (slab->count - i * 64));
+        } else {
+            slab->free_map[i] = 0;
+        }
+    }
+
+    push_partial(slab);
+
+    return slab;
+}
+
+// Spans are chunks of the main arena, so only its range needs to be checked
+static slab_span_s *find_span(const uint8_t *addr) {
+    arena_s *arena = arena_main();
+
+    if (!arena->base || addr < arena->base || addr >= arena->limit) {
+        return nullptr;
+    }
+
+    size_t slot = slot_of(addr);
+    uint8_t *base =
+        atomic_load_explicit(&span_bases[slot], memory_order_relaxed);
+
+    if (base && addr >= base) {
+        return span_at(base);
+    }
+
+    base = slot ? atomic_load_explicit(&span_bases[slot - 1],
+                                       memory_order_relaxed) :
+                  nullptr;
+
+    if (base && addr < base + SLAB_SPAN_SIZE) {
+        return span_at(base);
+    }
+
+    return nullptr;
+}
+
+static slab_s *slab_of(const uint8_t *addr) {
+    return (slab_s *)((uintptr_t)addr & ~((uintptr_t)PAGE_SIZE - 1));
+}
+
+void set_slab_enabled(bool enabled) { slab_enabled = enabled; }
+
+bool get_slab_enabled() { return slab_enabled; }
+
+// Takes the first free object of the first partially used slab of the class
+// owned by the calling thread. Finding it is a scan over at most four bitmap
+// words
+uint8_t *slab_alloc(size_t size) {
+
+    ASSERT(size <= SLAB_MAX_SIZE);
+
+    size_t slab_class = class_of(size);
+    size_t owner = owner_of_thread();
+
+    slab_s *slab = partial[owner][slab_class];
+    if (!slab) {
+        slab = create_slab(owner, slab_class);
+        if (!slab) {
+            return nullptr;
+        }
+    }
+
+    size_t word = 0;
+    while (!slab->free_map[word]) {
+        word++;
+    }
+
+    size_t bit = __builtin_ctzll(slab->free_map[word]);
+    slab->free_map[word] &= ~(1ULL << bit);
+    slab->used++;
+
+    // Full slabs are not in any list, they are found again by free
+    if (slab->used == slab->count) {
+        unlink_partial(slab);
+    }
+
+    return slab->objects + (word * 64 + bit) * slab->size;
+}
+
+void slab_free(uint8_t *addr) {
+    slab_span_s *span = find_span(addr);
+
+    ASSERT(span);
+
+    slab_s *slab = slab_of(addr);
+
+    // addr has to point to the beginning of an object, and the object must
+    // not be free already
+    ASSERT(addr >= slab->objects);
+    ASSERT((size_t)(addr - slab->objects) % slab->size == 0);
+
+    size_t index = (addr - slab->objects) / slab->size;
+
+    ASSERT(index < slab->count);
+    ASSERT(!(slab->free_map[index / 64] & (1ULL << (index % 64))));
+
+    slab->free_map[index / 64] |= 1ULL << (index % 64);
+
+    if (slab->used == slab->count) {
+        push_partial(slab);
+    }
+    slab->used--;
+
+    // Give empty slabs back to their span, but keep the last partially used
+    // slab of a class and owner to avoid setting it up again on the next
+    // allocation. Objects freed by other threads go back to the slab of their
+    // owner as well
+    if (slab->used || (*partial_of(slab) == slab && !slab->next)) {
+        return;
+    }
+
+    unlink_partial(slab);
+
+    if (!span->free_pages) {
+        push_span(span);
+    }
+    span->free_pages |= 1ULL << (((uint8_t *)slab - span->base) / PAGE_SIZE);
+
+    // Same for spans, the last one is kept
+    if (span->free_pages != ~0ULL >> (64 - SLAB_SPAN_PAGES) ||
+        span_count == 1) {
+        return;
+    }
+
+    unlink_span(span);
+    atomic_store_explicit(&span_bases[slot_of(span->base)], nullptr,
+                          memory_order_relaxed);
+    span_count--;
+
+    remove_segment(span->chunk);
+}
+
+bool slab_owns(const uint8_t *addr) { return find_span(addr); }
+
+size_t slab_object_size(uint8_t *addr) { return slab_of(addr)->size; }
+
+size_t slab_round_size(size_t size) { return slab_sizes[class_of(size)]; }
+
+// The owner slots stay with their threads
+void slab_clear() {
+    for (size_t i = 0; i < SLAB_OWNERS; i++) {
+        for (size_t k = 0; k < NUM_SLAB_CLASSES; k++) {
+            partial[i][k] = nullptr;
+        }
+    }
+    for (size_t i = 0; i < SLAB_SLOTS; i++) {
+        atomic_store_explicit(&span_bases[i], nullptr, memory_order_relaxed);
+    }
+    free_spans = nullptr;
+    span_count = 0;
+}
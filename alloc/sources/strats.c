@@ -1,16 +1,26 @@
+#include "alloc/arena.h"
+#include "alloc/chunk.h"
 #include "alloc/defines.h"
+#include "alloc/gap_array.h"
+#include "alloc/gap_mgmt.h"
+#include "alloc/gap_tree.h"
 #include "alloc/linked_list_mgmt.h"
+#include "alloc/seg_classes.h"
+#include "alloc/strats.h"
+#include "alloc/tlsf.h"
 #include "alloc/types.h"
 
+#include <stdatomic.h>
 #include <stddef.h>
 
-// State variable for next_fit. Points to the last allocated chunk, or some
-// chunk before if the last allocated chunk is freed. If no chunk is allocated,
-// points to nullptr
-seg_tail_s *last_addr = nullptr;
+// Number of fitting gaps good_fit looks at before taking the smallest one. Set
+// without holding the lock of the main arena
+static atomic_size_t good_fit_candidates = GOOD_FIT_CANDIDATES;
 
-// An implementation according to the best-fit algorithm. Measures the gaps
-// between each allocated chunk, and tries to find the smallest fitting one. If
+// An implementation according to the best-fit algorithm. Tries to find the
+// smallest fitting gap between the allocated chunks. Instead of measuring every
+// gap, the gaps are kept in a balanced tree ordered by size and address (see
+// gap_tree.c), so finding the smallest fitting gap takes logarithmic time. If
 // no chunk is found, simply allocate at the beginning of storage table if
 // storage table is large enough. Otherwise return nullptr if no gap has been
 // found or storage table is too small.
@@ -52,26 +62,29 @@ uint8_t *best_fit(seg_list_head_s *list, size_t size) {
     } else {
         // pr_info("Start segment not large enough with size %d", startgapsize);
     }
-    seg_tail_s *iterator = list->first_seg->next_seg_tail;
 
-    do {
-        if (iterator->free_following >= total_size &&
-            (!best_gap_addr || iterator->free_following < best_gap_size)) {
-            // pr_info("Found smaller gap of size %zu",
-            // iterator->free_following);
-            best_gap_size = iterator->free_following;
-            best_gap_addr = (uint8_t *)iterator + sizeof(struct seg_tail_s);
-        }
-        iterator = iterator->next_seg_head->next_seg_tail;
+    // The tree holds every gap after a tail. Among gaps of equal size it
+    // returns the one with the lowest address, and the start gap wins ties,
+    // just like when walking the list from the beginning
+    seg_tail_s *smallest = size_tree_find(total_size);
+
+    if (smallest &&
+        (!best_gap_addr || tail_free(smallest) < best_gap_size)) {
+        // pr_info("Found smaller gap of size %zu",
+        // smallest->free_following);
+        best_gap_size = tail_free(smallest);
+        best_gap_addr = (uint8_t *)smallest + sizeof(struct seg_tail_s);
+    }
 
-    } while ((uint8_t *)iterator->prev_seg_head->prev_seg_tail <
-             (uint8_t *)iterator);
     return (uint8_t *)best_gap_addr;
 }
 
 // An implementation according to the worst-fit algorithm. Measures the gaps
-// between each allocated chunk, and tries to find the largest fitting one. If
-// no chunk is found, simply allocate at the beginning of storage table if
+// between each allocated chunk, and tries to find the largest fitting one.
+// While worst-fit is in use, the gaps are kept in a balanced tree ordered by
+// address, where every node knows the largest gap of its subtree (see
+// gap_tree.c). The largest gap is then simply found at the root. If no chunk
+// is found, simply allocate at the beginning of storage table if
 // storage table is large enough. Otherwise return nullptr if no gap has been
 // found or storage table is too small.
 
@@ -110,32 +123,48 @@ uint8_t *worst_fit(seg_list_head_s *list, size_t size) {
         largest_gap_size = startgapsize;
         largest_gap_addr = ((uint8_t *)list + sizeof(struct seg_list_head_s));
     }
+
+    // Among gaps of equal size, the tree returns the one with the lowest
+    // address, and the start gap wins ties, just like when walking the list
+    // from the beginning
+    if (get_gap_index() == &addr_tree_index) {
+        seg_tail_s *largest = addr_tree_largest();
+
+        if (largest && tail_free(largest) >= total_size &&
+            (!largest_gap_addr || tail_free(largest) > largest_gap_size)) {
+            largest_gap_addr = (uint8_t *)largest + sizeof(struct seg_tail_s);
+        }
+        return largest_gap_addr;
+    }
+
     int i = 1;
     seg_tail_s *temp = nullptr;
 
-    temp = list->first_seg->next_seg_tail;
+    temp = head_next_tail(list->first_seg);
 
     do {
-        if (temp->free_following >= total_size &&
-            (!largest_gap_addr || temp->free_following > largest_gap_size)) {
+        if (tail_free(temp) >= total_size &&
+            (!largest_gap_addr || tail_free(temp) > largest_gap_size)) {
             // pr_info("Segment is large enough with size %zu at gap num %d",
             //        largest_gap_size, i);
-            largest_gap_size = temp->free_following;
+            largest_gap_size = tail_free(temp);
             largest_gap_addr = (uint8_t *)temp + sizeof(struct seg_tail_s);
             i++;
         } else {
             // pr_info("Gap %zu too small or not larger", temp->free_following);
         }
-        temp = temp->next_seg_head->next_seg_tail;
+        temp = head_next_tail(tail_next_head(temp));
 
-    } while ((uint8_t *)temp->prev_seg_head->prev_seg_tail < (uint8_t *)temp);
+    } while ((uint8_t *)head_prev_tail(tail_prev_head(temp)) < (uint8_t *)temp);
     // pr_info("Reached end of list");
     return (uint8_t *)largest_gap_addr;
 }
 
 // An implementation according to the first-fit algorithm. Measures the gaps
-// between each allocated chunk, and tries to find the first fitting one. If
-// no chunk is found, simply allocate at the beginning of storage table if
+// between each allocated chunk, and tries to find the first fitting one. While
+// first-fit is in use, the same address-ordered tree as for worst-fit is used,
+// and the largest gap of each subtree leads straight to the first fitting gap.
+// If no chunk is found, simply allocate at the beginning of storage table if
 // storage table is large enough. Otherwise return nullptr if no gap has been
 // found or storage table is too small.
 
@@ -173,23 +202,41 @@ uint8_t *first_fit(seg_list_head_s *list, size_t size) {
         return (uint8_t *)list + sizeof(struct seg_list_head_s);
     }
     // pr_info("Start segment not large enough with size %d", startgapsize);
-    seg_tail_s *temp = list->first_seg->next_seg_tail;
+
+    // The tree is only up to date while first-fit, worst-fit or buddy is in
+    // use. next_fit also calls this function, in which case the gap array is
+    // scanned from the beginning
+    if (get_gap_index() == &addr_tree_index) {
+        seg_tail_s *first = addr_tree_first(total_size);
+
+        return first ? (uint8_t *)first + sizeof(*first) : nullptr;
+    }
+
+    if (get_gap_index() == &gap_array_index) {
+        seg_tail_s *first = gap_array_find(nullptr, nullptr, total_size);
+
+        return first ? (uint8_t *)first + sizeof(*first) : nullptr;
+    }
+
+    seg_tail_s *temp = head_next_tail(list->first_seg);
 
     do {
 
-        if (temp->free_following >= total_size) {
+        if (tail_free(temp) >= total_size) {
             // pr_info("Found a gap of size %zu", temp->free_following);
             return (uint8_t *)temp + sizeof(*temp);
         }
-        temp = temp->next_seg_head->next_seg_tail;
-    } while ((uint8_t *)temp->prev_seg_head->prev_seg_tail < (uint8_t *)temp);
+        temp = head_next_tail(tail_next_head(temp));
+    } while ((uint8_t *)head_prev_tail(tail_prev_head(temp)) < (uint8_t *)temp);
     // pr_info("No gap found");
     return nullptr;
 }
 
 // An implementation according to the next-fit algorithm. Measures the gaps
 // between each allocated chunk, and tries to find the first fitting one.
-// Unlike first-fit, the search is begun from the last allocated chunk. If
+// Unlike first-fit, the search is begun from the last allocated chunk. The
+// sizes of the gaps are looked up in the gap array instead of the tails, so
+// searching does not touch the pages of the storage table. If
 // last_addr, the next-fit pointer, is nullptr, a simple first-fit
 // algorithm is performed.
 
@@ -204,6 +251,9 @@ uint8_t *first_fit(seg_list_head_s *list, size_t size) {
 // found or storage table is too small.
 uint8_t *next_fit(seg_list_head_s *list, size_t size) {
 
+    // Each thread keeps a next-fit pointer of its own in each arena
+    seg_tail_s *last_addr = get_last_addr();
+
     size_t effective_size = round_up(size, ALIGNMENT);
 
     size_t total_size =
@@ -228,6 +278,26 @@ uint8_t *next_fit(seg_list_head_s *list, size_t size) {
     // nonsensical) behaviour
     ASSERT((uint8_t *)last_addr < list->end_addr);
 
+    // While next-fit is in use, the gaps are kept in the gap array outside of
+    // the storage table (see gap_array.c). The same order as below is
+    // searched: from last_addr to the end, then the gap at the beginning of
+    // the table, then up to last_addr. Only the start gap needs the table
+    if (get_gap_index() == &gap_array_index) {
+        seg_tail_s *tail = gap_array_find(last_addr, nullptr, total_size);
+
+        if (!tail) {
+            int header_offset =
+                (uint8_t *)list->first_seg - ((uint8_t *)list + sizeof(*list));
+            if (header_offset >= (int)total_size) {
+                return (uint8_t *)list + sizeof(*list);
+            }
+
+            tail = gap_array_find(nullptr, last_addr, total_size);
+        }
+
+        return tail ? (uint8_t *)tail + sizeof(*tail) : nullptr;
+    }
+
     // pr_info("List not empty");
 
     // Initialize an iterator variable which will be used throughout searching
@@ -240,7 +310,7 @@ uint8_t *next_fit(seg_list_head_s *list, size_t size) {
     do {
 
         // Check is space after tail is large enough
-        if (iter->free_following >= total_size) {
+        if (tail_free(iter) >= total_size) {
             // pr_info("Found a gap of size %zu", iter->free_following);
 
             // Iter points to the tail, we need to return the *beginning* of the
@@ -249,13 +319,13 @@ uint8_t *next_fit(seg_list_head_s *list, size_t size) {
         }
 
         // Otherwise, go to the next segment
-        iter = iter->next_seg_head->next_seg_tail;
+        iter = head_next_tail(tail_next_head(iter));
 
         // This condition states one single thing: After moving iter to the next
         // tail, the address of said tail is larger. If this condition is false,
         // it means we reached the beginning of the table, in which case we need
         // to abort. Another possibility is that only one segment exists at all.
-    } while ((uint8_t *)iter->prev_seg_head->prev_seg_tail < (uint8_t *)iter);
+    } while ((uint8_t *)head_prev_tail(tail_prev_head(iter)) < (uint8_t *)iter);
 
     // pr_info("No gap found from where we left off. Now searching from the "
     //        "beginning");
@@ -276,7 +346,7 @@ uint8_t *next_fit(seg_list_head_s *list, size_t size) {
 
     // Reset iterator variable to the first segment tail. We already
     // checked the initial gap size, as such nothing else is left to do
-    iter = list->first_seg->next_seg_tail;
+    iter = head_next_tail(list->first_seg);
 
     // Remember that assertion above? We can be sure that
     // last-addr<list->end_addr, as such we don't need to separately
@@ -293,13 +363,13 @@ uint8_t *next_fit(seg_list_head_s *list, size_t size) {
 
         // If the size of the following gap is large enough, we found a
         // gap of suitable size!
-        if (iter->free_following >= total_size) {
+        if (tail_free(iter) >= total_size) {
             // pr_info("Found a gap");
             return (uint8_t *)iter + sizeof(*iter);
         }
 
         // Move iter to the subsequent tail
-        iter = iter->next_seg_head->next_seg_tail;
+        iter = head_next_tail(tail_next_head(iter));
     }
 
     // pr_info("Did not find a gap");
@@ -308,10 +378,235 @@ uint8_t *next_fit(seg_list_head_s *list, size_t size) {
     return nullptr;
 }
 
+// An implementation according to the segregated-fit algorithm. Instead of
+// walking all chunks, the gaps are kept in lists per size class (see
+// seg_classes.c), which are kept up to date by add_entry, remove_segment,
+// shrink_segment and expand_segment. Finding a gap thus takes constant time
+// regardless of the number of chunks.
+
+// The gap at the beginning of the storage table has no tail in front of it and
+// is thus not part of any list. It is checked separately first.
+uint8_t *segregated_fit(seg_list_head_s *list, size_t size) {
+
+    size_t effective_size = round_up(size, ALIGNMENT);
+
+    size_t total_size =
+        sizeof(struct seg_head_s) + effective_size + sizeof(struct seg_tail_s);
+
+    if (!list->end_addr) {
+        pr_error("Sorry, list not initialized");
+        return nullptr;
+    }
+    if (!list->first_seg) {
+        // pr_info("List is empty, maybe there is storage left though");
+        int free_size =
+            (uint8_t *)list->end_addr - ((uint8_t *)list + sizeof(*list));
+        if (free_size >= (int)total_size) {
+            return (uint8_t *)list + sizeof(*list);
+        }
+
+        return nullptr;
+    }
+    int startgapsize = (uint8_t *)list->first_seg -
+                       ((uint8_t *)list + sizeof(struct seg_list_head_s));
+
+    if (startgapsize >= (int)total_size) {
+        // pr_info("Start segment is large enough with size %d", startgapsize);
+        return (uint8_t *)list + sizeof(struct seg_list_head_s);
+    }
+
+    seg_tail_s *tail = seg_class_find(total_size);
+
+    if (!tail) {
+        // pr_info("No gap found");
+        return nullptr;
+    }
+
+    // The size classes must only ever hand out tails within the storage table
+    ASSERT((uint8_t *)tail + sizeof(*tail) + total_size <= list->end_addr);
+
+    return (uint8_t *)tail + sizeof(*tail);
+}
+
+// An implementation according to the two-level segregated fit (TLSF) algorithm.
+// The gaps are kept in lists indexed by a first level (power of two) and a
+// second level (linear subdivision), and two bitmaps tell which lists are not
+// empty (see tlsf.c). The lists are kept up to date by add_entry,
+// remove_segment, shrink_segment and expand_segment in constant time, and a gap
+// is found with a constant number of bit operations. Together, malloc and free
+// are bounded regardless of the number of chunks.
+
+// Like for segregated-fit, the gap at the beginning of the storage table is
+// checked separately first.
+uint8_t *tlsf_fit(seg_list_head_s *list, size_t size) {
+
+    size_t effective_size = round_up(size, ALIGNMENT);
+
+    size_t total_size =
+        sizeof(struct seg_head_s) + effective_size + sizeof(struct seg_tail_s);
+
+    if (!list->end_addr) {
+        pr_error("Sorry, list not initialized");
+        return nullptr;
+    }
+    if (!list->first_seg) {
+        // pr_info("List is empty, maybe there is storage left though");
+        int free_size =
+            (uint8_t *)list->end_addr - ((uint8_t *)list + sizeof(*list));
+        if (free_size >= (int)total_size) {
+            return (uint8_t *)list + sizeof(*list);
+        }
+
+        return nullptr;
+    }
+    int startgapsize = (uint8_t *)list->first_seg -
+                       ((uint8_t *)list + sizeof(struct seg_list_head_s));
+
+    if (startgapsize >= (int)total_size) {
+        // pr_info("Start segment is large enough with size %d", startgapsize);
+        return (uint8_t *)list + sizeof(struct seg_list_head_s);
+    }
+
+    seg_tail_s *tail = tlsf_find(total_size);
+
+    if (!tail) {
+        // pr_info("No gap found");
+        return nullptr;
+    }
+
+    ASSERT((uint8_t *)tail + sizeof(*tail) + total_size <= list->end_addr);
+
+    return (uint8_t *)tail + sizeof(*tail);
+}
+
+// An implementation of good-fit, a compromise between next-fit and best-fit.
+// The gaps are visited in the same order as by next-fit: from last_addr to the
+// end of the table, then the gap at the beginning of the table, then from the
+// first chunk up to last_addr. Instead of the first fitting gap, the smallest
+// of the first good_fit_candidates fitting gaps is taken, and among gaps of the
+// same size the one visited first. The gaps are looked up in the gap array of
+// next-fit (see gap_array.c), so the search is as cheap as the one of next-fit
+// and the number of candidates bounds how far it goes.
+
+// !!IMPORTANT!!: Returns beginning of free space, which is !!NOT!! the
+// beginning of usable space which will be returned later. The returned address
+// merely indicated the beginning of a possible block.
+uint8_t *good_fit(seg_list_head_s *list, size_t size) {
+
+    // Same starting point as next-fit
+    seg_tail_s *last_addr = get_last_addr();
+
+    size_t effective_size = round_up(size, ALIGNMENT);
+
+    size_t total_size =
+        sizeof(struct seg_head_s) + effective_size + sizeof(struct seg_tail_s);
+
+    if (!list->end_addr) {
+        pr_error("Sorry, list not initialized");
+        return nullptr;
+    }
+    if (!list->first_seg) {
+        // pr_info("List is empty, maybe there is storage left though");
+        int free_size =
+            (uint8_t *)list->end_addr - ((uint8_t *)list + sizeof(*list));
+        if (free_size >= (int)total_size) {
+            return (uint8_t *)list + sizeof(*list);
+        }
+
+        return nullptr;
+    }
+
+    // The gap array is only up to date while next-fit or good-fit is in use.
+    // If it could not be mapped, next-fit walks the table instead
+    if (get_gap_index() != &gap_array_index) {
+        return next_fit(list, size);
+    }
+
+    size_t candidates = atomic_load(&good_fit_candidates);
+
+    uint8_t *best_gap_addr = nullptr;
+    size_t best_gap_size = 0;
+
+    // Without last_addr, the search begins at the start of the table, just
+    // like next-fit falls back to first-fit
+    if (last_addr) {
+        seg_tail_s *tail = gap_array_good(last_addr, nullptr, total_size,
+                                          &candidates);
+        if (tail) {
+            best_gap_addr = (uint8_t *)tail + sizeof(*tail);
+            best_gap_size = tail_free(tail);
+        }
+
+        // An exact fit can't be beaten by any gap visited later
+        if (best_gap_size == total_size) {
+            return best_gap_addr;
+        }
+    }
+
+    int startgapsize = (uint8_t *)list->first_seg -
+                       ((uint8_t *)list + sizeof(struct seg_list_head_s));
+
+    if (candidates && startgapsize >= (int)total_size) {
+        candidates--;
+        if (!best_gap_addr || (size_t)startgapsize < best_gap_size) {
+            best_gap_addr = (uint8_t *)list + sizeof(struct seg_list_head_s);
+            best_gap_size = startgapsize;
+        }
+    }
+
+    if (candidates) {
+        seg_tail_s *tail =
+            gap_array_good(nullptr, last_addr, total_size, &candidates);
+        if (tail && (!best_gap_addr || tail_free(tail) < best_gap_size)) {
+            best_gap_addr = (uint8_t *)tail + sizeof(*tail);
+        }
+    }
+
+    return best_gap_addr;
+}
+
+void set_good_fit_candidates(size_t candidates) {
+    atomic_store(&good_fit_candidates, candidates ? candidates : 1);
+}
+
+size_t get_good_fit_candidates() { return atomic_load(&good_fit_candidates); }
+
+// Threads are spread over the next-fit pointers of an arena round-robin, in
+// the order they first use one
+static atomic_size_t next_cursor = 0;
+
+static thread_local size_t cursor
+    __attribute__((tls_model("initial-exec"))) = ARENA_CURSORS;
+
+static seg_tail_s **own_cursor() {
+    if (cursor == ARENA_CURSORS) {
+        cursor = atomic_fetch_add(&next_cursor, 1) % ARENA_CURSORS;
+    }
+    return &g_arena->cursors[cursor].addr;
+}
+
 // This function sets the last_addr pointer used for next-fit to some chunk
-// tail, or to nullptr, depending on the input.
-void set_last_addr(seg_tail_s *addr) { last_addr = addr; }
+// tail, or to nullptr, depending on the input. Only the pointer of the calling
+// thread is set
+void set_last_addr(seg_tail_s *addr) { *own_cursor() = addr; }
+
+// This function simply retrieves the value of last_addr, used by next-fit. Each
+// thread has a pointer of its own in each arena.
+seg_tail_s *get_last_addr() { return *own_cursor(); }
+
+// Pointers of other threads may point to a tail which vanishes or moves, so all
+// of them are checked. That is rare, and unlike setting the own pointer, it
+// writes to the cache lines of other threads only if they point to the tail
+void move_last_addr(seg_tail_s *from, seg_tail_s *to) {
+    for (size_t i = 0; i < ARENA_CURSORS; i++) {
+        if (g_arena->cursors[i].addr == from) {
+            g_arena->cursors[i].addr = to;
+        }
+    }
+}
 
-// This function simply retrieves the value of last_addr, used by next-fit, to
-// avoid having to define a global variable.
-seg_tail_s *get_last_addr() { return last_addr; }
\ No newline at end of file
+void clear_last_addr() {
+    for (size_t i = 0; i < ARENA_CURSORS; i++) {
+        g_arena->cursors[i].addr = nullptr;
+    }
+}
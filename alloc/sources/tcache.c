@@ -0,0 +1,178 @@
+#include "alloc/tcache.h"
+#include "alloc/arena.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/types.h"
+
+#include <pthread.h>
+#include <stdatomic.h>
+#include <stddef.h>
+#include <stdint.h>
+
+// A cached chunk stays allocated in the segment list, so neither the gap
+// indices nor other threads notice it. While cached, its user memory holds the
+// link to the next chunk of the same bin
+typedef struct tcache_entry_s {
+    struct tcache_entry_s *next;
+} tcache_entry_s;
+
+// The cache of a thread. All chunks of a bin have the same size rounded up to
+// ALIGNMENT, so any of them can serve any request of that bin
+typedef struct tcache_s {
+    tcache_entry_s *bins[TCACHE_BINS]; /**< Stack of chunks per bin */
+    uint8_t counts[TCACHE_BINS];       /**< Number of chunks per bin */
+    size_t bytes;                      /**< Bytes held by all bins */
+    size_t generation;                 /**< g_generation the chunks belong to */
+    bool registered;                   /**< Flushed on thread exit */
+} tcache_s;
+
+static atomic_bool g_tcache_enabled = false;
+
+// Bumped whenever the storage table is reset. Caches of an older generation
+// hold chunks which do not exist anymore
+static atomic_size_t g_generation = 0;
+
+static pthread_key_t tcache_key;
+static pthread_once_t tcache_key_once = PTHREAD_ONCE_INIT;
+
+// The library may be preloaded in front of the C library's malloc. With the
+// initial-exec model, the cache lives in the static TLS block of the thread, so
+// accessing it never allocates itself
+static thread_local tcache_s tcache __attribute__((tls_model("initial-exec")));
+
+static size_t bin_of(size_t size) {
+    return round_up(size, ALIGNMENT) / ALIGNMENT - 1;
+}
+
+// Give the chunks of a bin back to the segment list, up to keep many are left
+// in the bin. The chunks of a thread mostly belong to the same arena, whose
+// lock is then taken only once for all of them
+static void flush_bin(tcache_s *cache, size_t bin, size_t keep) {
+    arena_s *locked = nullptr;
+
+    while (cache->counts[bin] > keep) {
+        tcache_entry_s *entry = cache->bins[bin];
+        cache->bins[bin] = entry->next;
+        cache->counts[bin]--;
+        cache->bytes -= (bin + 1) * ALIGNMENT;
+
+        arena_s *arena = arena_of((uint8_t *)entry);
+        if (arena != locked) {
+            if (locked) {
+                arena_unlock(locked);
+            }
+            arena_lock(arena);
+            locked = arena;
+        }
+
+        remove_segment((uint8_t *)entry);
+    }
+
+    if (locked) {
+        arena_unlock(locked);
+    }
+}
+
+// Drop all chunks of a cache if the storage table has been reset since they
+// were cached. They are gone together with the table
+static void check_generation(tcache_s *cache) {
+    size_t generation = atomic_load(&g_generation);
+
+    if (cache->generation != generation) {
+        for (size_t i = 0; i < TCACHE_BINS; i++) {
+            cache->bins[i] = nullptr;
+            cache->counts[i] = 0;
+        }
+        cache->bytes = 0;
+        cache->generation = generation;
+    }
+}
+
+static void flush_cache(tcache_s *cache) {
+    check_generation(cache);
+
+    for (size_t i = 0; i < TCACHE_BINS; i++) {
+        flush_bin(cache, i, 0);
+    }
+}
+
+// Destructor of tcache_key, called on thread exit with the cache of the thread
+static void flush_on_exit(void *cache) { flush_cache((tcache_s *)cache); }
+
+static void create_key() { pthread_key_create(&tcache_key, &flush_on_exit); }
+
+void set_tcache_enabled(bool enabled) {
+    atomic_store(&g_tcache_enabled, enabled);
+
+    if (!enabled) {
+        tcache_flush();
+    }
+}
+
+bool get_tcache_enabled() { return atomic_load(&g_tcache_enabled); }
+
+uint8_t *tcache_get(size_t size) {
+    check_generation(&tcache);
+
+    size_t bin = bin_of(size);
+    tcache_entry_s *entry = tcache.bins[bin];
+
+    if (!entry) {
+        return nullptr;
+    }
+
+    tcache.bins[bin] = entry->next;
+    tcache.counts[bin]--;
+    tcache.bytes -= (bin + 1) * ALIGNMENT;
+
+    // The size stays within the same multiple of ALIGNMENT, so the tail of
+    // the chunk does not move
+    set_head_size((seg_head_s *)((uint8_t *)entry - sizeof(seg_head_s)), size);
+
+    return (uint8_t *)entry;
+}
+
+bool tcache_put(uint8_t *addr) {
+    size_t size = head_size((seg_head_s *)(addr - sizeof(seg_head_s)));
+
+    if (size > TCACHE_MAX_SIZE) {
+        return false;
+    }
+
+    check_generation(&tcache);
+
+    size_t bin = bin_of(size);
+    size_t bytes = (bin + 1) * ALIGNMENT;
+
+    if (tcache.bytes + bytes > TCACHE_MAX_BYTES) {
+        return false;
+    }
+
+    // The cache is flushed on thread exit by the destructor of tcache_key,
+    // which is only called for threads which have set a value for it
+    if (!tcache.registered) {
+        pthread_once(&tcache_key_once, &create_key);
+        pthread_setspecific(tcache_key, &tcache);
+        tcache.registered = true;
+    }
+
+    if (tcache.counts[bin] >= TCACHE_BIN_LIMIT) {
+        flush_bin(&tcache, bin, TCACHE_BIN_LIMIT / 2);
+    }
+
+    tcache_entry_s *entry = (tcache_entry_s *)addr;
+    entry->next = tcache.bins[bin];
+    tcache.bins[bin] = entry;
+    tcache.counts[bin]++;
+    tcache.bytes += bytes;
+
+    return true;
+}
+
+void tcache_flush() { flush_cache(&tcache); }
+
+void tcache_clear() {
+    atomic_fetch_add(&g_generation, 1);
+    check_generation(&tcache);
+}
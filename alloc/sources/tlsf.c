@@ -0,0 +1,167 @@
+#include "alloc/tlsf.h"
+#include "alloc/chunk.h"
+#include "alloc/defines.h"
+#include "alloc/types.h"
+
+#include <stddef.h>
+#include <stdint.h>
+
+// List node of a gap, stored right at the beginning of the gap itself. Every
+// indexed gap has at least MIN_GAP_SIZE free bytes, which is plenty
+typedef struct tlsf_node_s {
+    seg_tail_s *prev; /**< Tail of the previous gap in the same list */
+    seg_tail_s *next; /**< Tail of the next gap in the same list */
+} tlsf_node_s;
+
+// First gap of every list, nullptr if a list is empty
+static seg_tail_s *tlsf_heads[TLSF_FL_COUNT][TLSF_SL_COUNT];
+
+// One bit per first-level class, set if any of its lists is not empty
+static uint64_t fl_bitmap = 0;
+
+// One bit per second-level list of each first-level class, set if the list is
+// not empty
+static uint32_t sl_bitmap[TLSF_FL_COUNT];
+
+static tlsf_node_s *node_of(seg_tail_s *tail) {
+    return (tlsf_node_s *)((uint8_t *)tail + sizeof(*tail));
+}
+
+static size_t floor_log2(size_t size) { return 63 - __builtin_clzll(size); }
+
+// Maps a size to its first- and second-level list. The first level is the
+// position of the highest bit, the second level splits each power of two range
+// linearly into TLSF_SL_COUNT lists. Sizes below TLSF_SMALL_SIZE are all in the
+// first class, split in steps of ALIGNMENT.
+static void mapping(size_t size, size_t *fl, size_t *sl) {
+    if (size < TLSF_SMALL_SIZE) {
+        *fl = 0;
+        *sl = size / ALIGNMENT;
+        return;
+    }
+
+    size_t log = floor_log2(size);
+
+    *fl = log - floor_log2(TLSF_SMALL_SIZE) + 1;
+    *sl = (size >> (log - TLSF_SL_LOG2)) ^ TLSF_SL_COUNT;
+
+    ASSERT(*fl < TLSF_FL_COUNT && *sl < TLSF_SL_COUNT);
+}
+
+static void tlsf_insert(seg_tail_s *tail) {
+    size_t fl;
+    size_t sl;
+    mapping(tail_free(tail), &fl, &sl);
+
+    tlsf_node_s *node = node_of(tail);
+
+    node->prev = nullptr;
+    node->next = tlsf_heads[fl][sl];
+
+    if (node->next) {
+        node_of(node->next)->prev = tail;
+    }
+
+    tlsf_heads[fl][sl] = tail;
+    fl_bitmap |= 1ULL << fl;
+    sl_bitmap[fl] |= 1U << sl;
+}
+
+static void tlsf_remove(seg_tail_s *tail) {
+    size_t fl;
+    size_t sl;
+    mapping(tail_free(tail), &fl, &sl);
+
+    tlsf_node_s *node = node_of(tail);
+
+    if (node->prev) {
+        node_of(node->prev)->next = node->next;
+    } else {
+
+        // The gap is the first one of its list
+        ASSERT(tlsf_heads[fl][sl] == tail);
+        tlsf_heads[fl][sl] = node->next;
+    }
+
+    if (node->next) {
+        node_of(node->next)->prev = node->prev;
+    }
+
+    // Clear the bits of empty lists and empty first-level classes
+    if (!tlsf_heads[fl][sl]) {
+        sl_bitmap[fl] &= ~(1U << sl);
+        if (!sl_bitmap[fl]) {
+            fl_bitmap &= ~(1ULL << fl);
+        }
+    }
+}
+
+static void tlsf_clear() {
+    for (size_t fl = 0; fl < TLSF_FL_COUNT; fl++) {
+        for (size_t sl = 0; sl < TLSF_SL_COUNT; sl++) {
+            tlsf_heads[fl][sl] = nullptr;
+        }
+        sl_bitmap[fl] = 0;
+    }
+    fl_bitmap = 0;
+}
+
+const gap_index_s tlsf_index = {
+    .insert = &tlsf_insert,
+    .remove = &tlsf_remove,
+    .clear = &tlsf_clear,
+};
+
+// Searching is done with the size rounded up to the next list boundary. This
+// way, the first gap of any non-empty list at or above the rounded size fits,
+// and no list ever has to be walked.
+seg_tail_s *tlsf_find(size_t total_size) {
+
+    // Sizes this large can't be mapped anyways
+    if (total_size > SIZE_MAX / 2) {
+        return nullptr;
+    }
+
+    size_t rounded = total_size;
+    if (total_size >= TLSF_SMALL_SIZE) {
+        rounded += (1ULL << (floor_log2(total_size) - TLSF_SL_LOG2)) - 1;
+    }
+
+    size_t fl;
+    size_t sl;
+    mapping(rounded, &fl, &sl);
+
+    // First look for a non-empty list in the same first-level class...
+    uint32_t sl_map = sl_bitmap[fl] & (~0U << sl);
+
+    if (!sl_map) {
+
+        // ...then for the next non-empty first-level class
+        uint64_t fl_map =
+            fl + 1 < TLSF_FL_COUNT ? fl_bitmap & (~0ULL << (fl + 1)) : 0;
+
+        if (!fl_map) {
+
+            // Rounding up skips the list total_size itself belongs to. Before
+            // giving up, check the first gap of that list, which might still
+            // be large enough. This is a single check and keeps the bound.
+            mapping(total_size, &fl, &sl);
+
+            seg_tail_s *head = tlsf_heads[fl][sl];
+            if (head && tail_free(head) >= total_size) {
+                return head;
+            }
+            return nullptr;
+        }
+
+        fl = __builtin_ctzll(fl_map);
+        sl_map = sl_bitmap[fl];
+    }
+
+    sl = __builtin_ctz(sl_map);
+
+    ASSERT(tlsf_heads[fl][sl]);
+    ASSERT(tail_free(tlsf_heads[fl][sl]) >= total_size);
+
+    return tlsf_heads[fl][sl];
+}
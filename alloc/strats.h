@@ -7,11 +7,14 @@
 
 #include "alloc/types.h"
 
+//! Number of fitting gaps good_fit() looks at by default
+#define GOOD_FIT_CANDIDATES 8
+
 /**
  * @brief A best-fit implementation
  *
- * Performs a best-fit search. For more details see the comments in the
- * function.
+ * Performs a best-fit search on the size-ordered gap tree of gap_tree.h in
+ * logarithmic time. For more details see the comments in the function.
  *
  * @param[in] list A pointer to a storage list header
  * @param[in] size A gap size to search for (size means user space size
@@ -75,11 +78,83 @@ uint8_t *first_fit(seg_list_head_s *list, size_t size);
  */
 uint8_t *next_fit(seg_list_head_s *list, size_t size);
 
+/**
+ * @brief A segregated-fit implementation
+ *
+ * Performs a segregated-fit search on the size-class lists of seg_classes.h.
+ * For more details see the comments in the function.
+ *
+ * @param[in] list A pointer to a storage list header
+ * @param[in] size A gap size to search for (size means user space size
+ * excluding chunk header and chunk tail size. This will be considered in the
+ * function)
+ *
+ * @return Address where a valid chunk of size @p size can be placed (not the
+ * address where user storage begins), nullptr if no gap has been found or some
+ * other error occured.
+ */
+uint8_t *segregated_fit(seg_list_head_s *list, size_t size);
+
+/**
+ * @brief A two-level segregated fit (TLSF) implementation
+ *
+ * Performs a TLSF search on the bitmap index of tlsf.h, which takes a constant
+ * number of bit operations. For more details see the comments in the function.
+ *
+ * @param[in] list A pointer to a storage list header
+ * @param[in] size A gap size to search for (size means user space size
+ * excluding chunk header and chunk tail size. This will be considered in the
+ * function)
+ *
+ * @return Address where a valid chunk of size @p size can be placed (not the
+ * address where user storage begins), nullptr if no gap has been found or some
+ * other error occured.
+ */
+uint8_t *tlsf_fit(seg_list_head_s *list, size_t size);
+
+/**
+ * @brief A good-fit implementation
+ *
+ * Searches like next-fit, beginning at the last allocated chunk, but instead of
+ * taking the first fitting gap, the smallest of the first few fitting gaps is
+ * taken (see set_good_fit_candidates()). For more details see the comments in
+ * the function.
+ *
+ * @param[in] list A pointer to a storage list header
+ * @param[in] size A gap size to search for (size means user space size
+ * excluding chunk header and chunk tail size. This will be considered in the
+ * function)
+ *
+ * @return Address where a valid chunk of size @p size can be placed (not the
+ * address where user storage begins), nullptr if no gap has been found or some
+ * other error occured.
+ */
+uint8_t *good_fit(seg_list_head_s *list, size_t size);
+
+/**
+ * @brief Set the number of fitting gaps good-fit looks at
+ *
+ * With 1, good-fit behaves exactly like next-fit. The larger the number, the
+ * closer it gets to best-fit, at the cost of a longer search.
+ *
+ * @param[in] candidates Number of fitting gaps, 0 is treated as 1. Defaults to
+ * GOOD_FIT_CANDIDATES
+ */
+void set_good_fit_candidates(size_t candidates);
+
+/**
+ * @brief Get the number of fitting gaps good-fit looks at
+ *
+ * @return The number set with set_good_fit_candidates()
+ */
+size_t get_good_fit_candidates();
+
 /**
  * @brief Set the address of last addr pointer
  *
  * This function updates the last_addr pointer in case of new allocation or
- * freeing of blocks. Will be called by said functions
+ * freeing of blocks. Will be called by said functions. Each thread has a
+ * pointer of its own in each arena, see ARENA_CURSORS
  *
  * @param[in] addr Some tail address, or nullptr if no segment is left anymore
  */
@@ -94,4 +169,20 @@ void set_last_addr(seg_tail_s *addr);
  */
 seg_tail_s *get_last_addr();
 
+/**
+ * @brief Redirect the last addr pointers of all threads
+ *
+ * Called when a tail vanishes or moves, so that no thread keeps pointing to
+ * it. Affects the bound arena only.
+ *
+ * @param[in] from Tail which vanishes or moves
+ * @param[in] to Tail to point to instead, or nullptr
+ */
+void move_last_addr(seg_tail_s *from, seg_tail_s *to);
+
+/**
+ * @brief Reset the last addr pointers of all threads in the bound arena
+ */
+void clear_last_addr();
+
 #endif
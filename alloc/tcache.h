@@ -0,0 +1,89 @@
+/**
+ * @file
+ * @brief Per-thread caches of freed chunks
+ */
+#ifndef ALLOC_TCACHE_H
+#define ALLOC_TCACHE_H
+
+#include "alloc/defines.h"
+#include <stddef.h>
+#include <stdint.h>
+
+//! Largest chunk size kept in the caches. Larger chunks are always given back
+//! to the segment list
+#define TCACHE_MAX_SIZE 1024
+
+//! Number of bins of a cache, one per multiple of ALIGNMENT
+#define TCACHE_BINS (TCACHE_MAX_SIZE / ALIGNMENT)
+
+//! Number of chunks a bin holds at most. Once a bin is full, half of it is
+//! given back to the segment list at once
+#define TCACHE_BIN_LIMIT 32
+
+//! Number of bytes the cache of a thread holds at most. Freed chunks beyond
+//! this limit are given back to the segment list right away
+#define TCACHE_MAX_BYTES (64 * 1024)
+
+/**
+ * @brief Enable or disable the per-thread caches
+ *
+ * While enabled, free() keeps chunks of up to TCACHE_MAX_SIZE bytes in a cache
+ * of the calling thread, and malloc() takes chunks from that cache, both
+ * without taking the lock of an arena. Disabling flushes the cache of the
+ * calling thread, the caches of other threads are flushed when they exit.
+ *
+ * @param[in] enabled true to enable, false to disable (the default)
+ */
+void set_tcache_enabled(bool enabled);
+
+/**
+ * @brief Check whether the per-thread caches are enabled
+ *
+ * @return true if enabled, false otherwise
+ */
+bool get_tcache_enabled();
+
+/**
+ * @brief Take a chunk from the cache of the calling thread
+ *
+ * The size of the chunk is set to @p size, which is within the same multiple of
+ * ALIGNMENT as before, so the layout of the segment list does not change.
+ *
+ * @param[in] size Requested size, at most TCACHE_MAX_SIZE
+ *
+ * @return User address of a cached chunk, nullptr if the bin is empty
+ */
+uint8_t *tcache_get(size_t size);
+
+/**
+ * @brief Put a freed chunk into the cache of the calling thread
+ *
+ * If the bin of the chunk is full, half of the bin is given back to the segment
+ * list under the lock of their arena.
+ *
+ * @warning @p addr must be a chunk of the segment list, not a block of the
+ * slabs or buddy pools
+ *
+ * @param[in] addr User address of a chunk of the segment list
+ *
+ * @return true if the chunk is cached, false if it is too large or the cache
+ * is full, in which case the caller frees it as usual
+ */
+bool tcache_put(uint8_t *addr);
+
+/**
+ * @brief Give all chunks of the calling thread's cache back
+ *
+ * Called when a thread exits, and when the caches are disabled.
+ */
+void tcache_flush();
+
+/**
+ * @brief Forget about the chunks of all caches
+ *
+ * Called when the whole storage table is reset, which frees the cached chunks
+ * along with it. The caches of other threads are dropped on their next use.
+ */
+void tcache_clear();
+
+#endif
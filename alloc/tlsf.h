@@ -0,0 +1,39 @@
+/**
+ * @file
+ * @brief Two-level segregated fit (TLSF) index of gaps
+ */
+#ifndef ALLOC_TLSF_H
+#define ALLOC_TLSF_H
+
+#include "alloc/types.h"
+
+//! Log2 of the number of second-level lists per first-level class
+#define TLSF_SL_LOG2 4
+
+//! Number of second-level lists per first-level class
+#define TLSF_SL_COUNT (1 << TLSF_SL_LOG2)
+
+//! Gaps below this size all belong to the first first-level class, which is
+//! split linearly in steps of ALIGNMENT
+#define TLSF_SMALL_SIZE (TLSF_SL_COUNT * ALIGNMENT)
+
+//! Number of first-level classes
+#define TLSF_FL_COUNT 64
+
+//! Gap index hooks of the TLSF lists
+extern const gap_index_s tlsf_index;
+
+/**
+ * @brief Search the TLSF lists for a gap
+ *
+ * This function rounds @p total_size up to the next list boundary, so that
+ * every gap of the list found is guaranteed to fit. Finding the list takes two
+ * bitmap lookups, independent of the number of gaps.
+ *
+ * @param[in] total_size Size of the chunk including header and tail
+ *
+ * @return Tail in front of a fitting gap, nullptr if no gap is large enough
+ */
+seg_tail_s *tlsf_find(size_t total_size);
+
+#endif
@@ -10,6 +10,8 @@
 #include <stddef.h>
 #include <stdint.h>
 
+#ifndef COMPACT_CHUNKS
+
 typedef struct seg_list_head_s {
     struct seg_head_s
         *first_seg;    /**< Pointer to first allocated segment header. */
@@ -35,14 +37,61 @@ typedef struct seg_head_s {
     char pad[8];
 } seg_head_s;
 
+#else
+
+// Compact chunks have a head and tail of 8 bytes each. The user space of a
+// chunk still needs to be aligned to ALIGNMENT, so heads are placed at 8 bytes
+// past a multiple of ALIGNMENT. The storage table header is padded accordingly.
+// Links which are not stored are derived from the position, see chunk.h
+
+typedef struct seg_list_head_s {
+    struct seg_head_s
+        *first_seg;    /**< Pointer to first allocated segment header. */
+    uint8_t *end_addr; /**< Pointer to end of storage table (not segment, just
+                          an address). Any address up to this address is valid
+                          to read*/
+    char pad[8];
+} seg_list_head_s;
+
+typedef struct seg_tail_s {
+    uint32_t free_following; /**< Number of free bytes till next segment header
+                                or end of storage table (end_addr) */
+    uint32_t head_dist; /**< Distance back to the head of current segment */
+} seg_tail_s;
+
+typedef struct seg_head_s {
+    uint32_t seg_size;      /**< Number of actually usable bytes between header
+                               and tail for user */
+    uint32_t prev_seg_tail; /**< Offset of tail of previous segment from the
+                               storage table header */
+} seg_head_s;
+
+#endif
+
 typedef enum sched_strat_e {
     FIRST_FIT, /**< First-Fit strategs */
     NEXT_FIT,  /**< Next-Fit strategy */
     BEST_FIT,  /**< Best-Fit strategy */
-    WORST_FIT  /**< Worst-Fit strategx */
+    WORST_FIT, /**< Worst-Fit strategx */
+    SEGREGATED_FIT, /**< Segregated-Fit strategy on size-class free lists */
+    TLSF_FIT,       /**< Two-level segregated fit strategy */
+    BUDDY, /**< Binary buddy pools for small requests, first-fit otherwise */
+    GOOD_FIT, /**< Smallest of the first fitting gaps in next-fit order */
+    ADAPTIVE  /**< Chosen at runtime from the measured fragmentation */
 } sched_strat_e;
 
 //! Function pointer to allocator function being used
 typedef uint8_t *(*alloc_function)(seg_list_head_s *, size_t);
 
+//! Set of hooks of a free gap index. The index is informed about every gap
+//! (identified by the tail in front of it) that appears or disappears
+typedef struct gap_index_s {
+    void (*insert)(seg_tail_s *); /**< Adds the gap following a tail */
+    void (*remove)(seg_tail_s *); /**< Removes the gap following a tail */
+    void (*clear)();              /**< Forgets about all gaps at once */
+    bool (*reserve)(size_t);      /**< Makes room for a number of gaps, false
+                                     if it failed. nullptr for indices kept
+                                     inside of the gaps themselves */
+} gap_index_s;
+
 #endif
\ No newline at end of file
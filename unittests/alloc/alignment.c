@@ -12,6 +12,7 @@ int main() {
         }
     }
 
+#ifndef COMPACT_CHUNKS
     if ((sizeof(seg_head_s) % ALIGNMENT)) {
         pr_error("Invalid size, not aligned");
         return EXIT_FAILURE;
@@ -24,6 +25,18 @@ int main() {
         pr_error("Invalid size, not aligned");
         return EXIT_FAILURE;
     }
+#else
+    // Compact heads and tails are smaller than ALIGNMENT, only a whole chunk
+    // and the storage table header together with a head keep the alignment
+    if (((sizeof(seg_head_s) + sizeof(seg_tail_s)) % ALIGNMENT)) {
+        pr_error("Invalid size, not aligned");
+        return EXIT_FAILURE;
+    }
+    if (((sizeof(seg_list_head_s) + sizeof(seg_head_s)) % ALIGNMENT)) {
+        pr_error("Invalid size, not aligned");
+        return EXIT_FAILURE;
+    }
+#endif
 
     return EXIT_SUCCESS;
 }
\ No newline at end of file
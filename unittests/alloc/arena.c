@@ -0,0 +1,135 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+#define NUM_ARENAS 4
+#define NUM_THREADS 8
+#define NUM_CHUNKS 256
+
+static uint8_t *chunks[NUM_THREADS][NUM_CHUNKS];
+
+static void *assign_thread(void *arg) {
+    uint8_t **own = arg;
+
+    for (size_t i = 0; i < NUM_CHUNKS; i++) {
+        own[i] = malloc(100 + i);
+        if (!own[i] || !is_aligned(own[i]) ||
+            arena_of(own[i]) != arena_home()) {
+            pr_error("Chunk not placed in the arena of the thread");
+            return (void *)1;
+        }
+    }
+
+    return nullptr;
+}
+
+// Threads are spread over the arenas round-robin and place their chunks in
+// their own arena. The chunks are freed by another thread, after which every
+// arena is empty again
+int assign_test() {
+    set_arena_count(NUM_ARENAS);
+
+    if (arena_home() != arena_main()) {
+        pr_error("The first thread should stay in the main arena");
+        return EXIT_FAILURE;
+    }
+
+    pthread_t threads[NUM_ARENAS - 1];
+
+    for (size_t i = 0; i < NUM_ARENAS - 1; i++) {
+        pthread_create(&threads[i], nullptr, &assign_thread, chunks[i]);
+    }
+
+    for (size_t i = 0; i < NUM_ARENAS - 1; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (size_t i = 0; i < NUM_ARENAS - 1; i++) {
+        arena_s *arena = arena_of(chunks[i][0]);
+
+        for (size_t k = 0; k < i; k++) {
+            if (arena == arena_main() || arena == arena_of(chunks[k][0])) {
+                pr_error("Threads %zu and %zu share an arena", i, k);
+                return EXIT_FAILURE;
+            }
+        }
+
+        for (size_t k = 0; k < NUM_CHUNKS; k++) {
+            free(chunks[i][k]);
+        }
+
+        if (arena->list->first_seg) {
+            pr_error("Arena of thread %zu not empty", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void *stress_thread(void *arg) {
+    uint8_t **own = arg;
+    stress_s stress = {.slots = NUM_CHUNKS,
+                       .rounds = 30000,
+                       .seed = (uint32_t)(uintptr_t)own,
+                       .max_size = 5000,
+                       .frees = 2};
+
+    return stress_run(&stress, own) ? (void *)1 : nullptr;
+}
+
+// Several threads per arena allocate, reallocate and free concurrently, and
+// no chunk may overwrite another one. The chunks left over are freed by the
+// main thread
+int stress_test() {
+    pthread_t threads[NUM_THREADS];
+
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        for (size_t k = 0; k < NUM_CHUNKS; k++) {
+            chunks[i][k] = nullptr;
+        }
+        pthread_create(&threads[i], nullptr, &stress_thread, chunks[i]);
+    }
+
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        for (size_t k = 0; k < NUM_CHUNKS; k++) {
+            free(chunks[i][k]);
+        }
+    }
+
+    return status;
+}
+
+int main() {
+
+    if (assign_test()) {
+        return EXIT_FAILURE;
+    }
+
+    // The storage is not cleared in between, the C library keeps allocations
+    // of its own for the threads created so far
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
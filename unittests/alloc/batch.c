@@ -0,0 +1,144 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/methods.h"
+#include "alloc/slab.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+#define NUM_SPACES 500
+
+static void *spaces[NUM_SPACES];
+
+// On an empty table, all spaces are carved from the same gap one after another
+// and can be used like spaces of malloc()
+int alloc_test() {
+    set_alloc_function(FIRST_FIT);
+
+    size_t count = julmalloc_alloc_batch(40, NUM_SPACES, spaces);
+    if (count != NUM_SPACES) {
+        pr_error("Allocated %zu of %d spaces", count, NUM_SPACES);
+        return EXIT_FAILURE;
+    }
+
+    size_t stride =
+        sizeof(seg_head_s) + round_up(40, ALIGNMENT) + sizeof(seg_tail_s);
+
+    for (size_t i = 0; i < NUM_SPACES; i++) {
+        if (!is_aligned(spaces[i]) || get_segment_size(spaces[i]) != 40) {
+            pr_error("Invalid space %zu", i);
+            return EXIT_FAILURE;
+        }
+        if (i && (uint8_t *)spaces[i] != (uint8_t *)spaces[i - 1] + stride) {
+            pr_error("Space %zu not next to the previous one", i);
+            return EXIT_FAILURE;
+        }
+        stress_fill(spaces[i], 40, i);
+    }
+
+    // Single spaces can be freed as usual
+    free(spaces[0]);
+    spaces[0] = nullptr;
+
+    for (size_t i = 1; i < NUM_SPACES; i++) {
+        if (!stress_intact(spaces[i], 40, i)) {
+            pr_error("Space %zu got overwritten", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Spaces are freed in any order, nullptr entries included, and the table is
+// empty afterwards
+int free_test() {
+    uint32_t seed = 42;
+
+    for (size_t i = NUM_SPACES - 1; i > 0; i--) {
+        seed = seed * 1103515245 + 12345;
+        size_t k = (seed >> 8) % (i + 1);
+        void *swap = spaces[i];
+        spaces[i] = spaces[k];
+        spaces[k] = swap;
+    }
+
+    julmalloc_free_batch(spaces, NUM_SPACES);
+
+    for (size_t i = 1; i < NUM_SPACES; i++) {
+        if ((uintptr_t)spaces[i - 1] > (uintptr_t)spaces[i]) {
+            pr_error("Pointers not sorted");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (arena_main()->list->first_seg) {
+        pr_error("Table not empty");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Small spaces come from the slabs if enabled, larger ones from gaps between
+// existing chunks and the end of the table
+int mixed_test() {
+    set_slab_enabled(true);
+
+    size_t count = julmalloc_alloc_batch(24, NUM_SPACES / 2, spaces);
+    ASSERT(count == NUM_SPACES / 2);
+    for (size_t i = 0; i < count; i++) {
+        ASSERT(slab_owns(spaces[i]));
+    }
+
+    set_slab_enabled(false);
+
+    // Leave gaps of different sizes in between
+    uint8_t *guards[10];
+    for (size_t i = 0; i < 10; i++) {
+        uint8_t *gap = malloc(100 * (i + 1));
+        guards[i] = malloc(1);
+        free(gap);
+    }
+
+    count = julmalloc_alloc_batch(100, NUM_SPACES / 2, spaces + NUM_SPACES / 2);
+    ASSERT(count == NUM_SPACES / 2);
+
+    for (size_t i = 0; i < NUM_SPACES; i++) {
+        ASSERT(spaces[i] && is_aligned(spaces[i]));
+        for (size_t k = 0; k < i; k++) {
+            ASSERT(spaces[i] != spaces[k]);
+        }
+    }
+
+    // Slab objects and chunks of the table are freed alike. The slabs keep
+    // their last span, so the table is not empty afterwards
+    julmalloc_free_batch(spaces, NUM_SPACES);
+    julmalloc_free_batch((void **)guards, 10);
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+
+    if (alloc_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (free_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (mixed_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
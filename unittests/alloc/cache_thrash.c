@@ -0,0 +1,155 @@
+#include "alloc/defines.h"
+#include "alloc/slab.h"
+
+#include "unittests/defines.h"
+#include <pthread.h>
+#include <stdlib.h>
+#include <time.h>
+
+#define NUM_THREADS 4
+#define NUM_OBJECTS 64
+#define NUM_ROUNDS 20000
+#define CACHE_LINE 64
+
+// Objects of each thread, handed over by the main thread
+static uint8_t *objects[NUM_THREADS][NUM_OBJECTS];
+
+// Whether the threads replace the objects of the main thread by their own
+static bool replace;
+
+static pthread_barrier_t barrier;
+
+static uint64_t now_ns() {
+    struct timespec ts;
+    clock_gettime(CLOCK_MONOTONIC, &ts);
+    return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+// Each thread increments its own objects over and over. If objects of
+// different threads shared a cache line, the line would move between the
+// cores on every increment
+static void *thrash_thread(void *arg) {
+    uint8_t **own = arg;
+
+    // Like in cache-scratch, objects handed over by the main thread are freed
+    // and allocated again. They go back to the slab of the main thread, and
+    // the new ones come from a slab of this thread
+    for (size_t i = 0; replace && i < NUM_OBJECTS; i++) {
+        free(own[i]);
+        own[i] = malloc(8);
+    }
+    for (size_t i = 0; i < NUM_OBJECTS; i++) {
+        *own[i] = 0;
+    }
+
+    pthread_barrier_wait(&barrier);
+
+    for (size_t round = 0; round < NUM_ROUNDS; round++) {
+        for (size_t i = 0; i < NUM_OBJECTS; i++) {
+            volatile uint8_t *object = own[i];
+            (*object)++;
+        }
+    }
+
+    pthread_barrier_wait(&barrier);
+
+    return nullptr;
+}
+
+// Runs the threads with objects the main thread allocated in one go, so that
+// neighboring objects belong to different threads, and returns the time the
+// threads spent incrementing
+static uint64_t run_threads() {
+    for (size_t i = 0; i < NUM_OBJECTS; i++) {
+        for (size_t t = 0; t < NUM_THREADS; t++) {
+            objects[t][i] = malloc(8);
+        }
+    }
+
+    pthread_t threads[NUM_THREADS];
+    pthread_barrier_init(&barrier, nullptr, NUM_THREADS + 1);
+
+    for (size_t t = 0; t < NUM_THREADS; t++) {
+        pthread_create(&threads[t], nullptr, &thrash_thread, objects[t]);
+    }
+
+    pthread_barrier_wait(&barrier);
+    uint64_t start = now_ns();
+    pthread_barrier_wait(&barrier);
+    uint64_t time = now_ns() - start;
+
+    for (size_t t = 0; t < NUM_THREADS; t++) {
+        pthread_join(threads[t], nullptr);
+    }
+    pthread_barrier_destroy(&barrier);
+
+    return time;
+}
+
+static void free_objects() {
+    for (size_t t = 0; t < NUM_THREADS; t++) {
+        for (size_t i = 0; i < NUM_OBJECTS; i++) {
+            free(objects[t][i]);
+        }
+    }
+}
+
+// Objects of small slab classes allocated by different threads never share a
+// cache line, even if the threads start with objects allocated by another
+// thread. The time is compared to threads working on the interleaved objects
+// of the main thread, which share cache lines
+int thrash_test() {
+    set_slab_enabled(true);
+
+    replace = false;
+    uint64_t shared_time = run_threads();
+    free_objects();
+
+    replace = true;
+    uint64_t time = run_threads();
+
+    for (size_t t = 0; t < NUM_THREADS; t++) {
+        for (size_t i = 0; i < NUM_OBJECTS; i++) {
+            uintptr_t line = (uintptr_t)objects[t][i] / CACHE_LINE;
+
+            if (!slab_owns(objects[t][i]) ||
+                *objects[t][i] != (uint8_t)NUM_ROUNDS) {
+                pr_error("Invalid object %p of thread %zu", objects[t][i], t);
+                return EXIT_FAILURE;
+            }
+
+            for (size_t u = 0; u < t; u++) {
+                for (size_t k = 0; k < NUM_OBJECTS; k++) {
+                    if ((uintptr_t)objects[u][k] / CACHE_LINE == line) {
+                        pr_error("Threads %zu and %zu share a cache line", u,
+                                 t);
+                        return EXIT_FAILURE;
+                    }
+                }
+            }
+        }
+    }
+
+    pr_info("%d threads, %d increments each: %llu us on shared cache lines, "
+            "%llu us on own slabs",
+            NUM_THREADS, NUM_OBJECTS * NUM_ROUNDS,
+            (unsigned long long)shared_time / 1000,
+            (unsigned long long)time / 1000);
+
+    free_objects();
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+
+    // Threads are created anew, and the slots of the exited ones are taken
+    // over, so the second run behaves like the first
+    for (size_t run = 0; run < 2; run++) {
+        if (thrash_test()) {
+            return EXIT_FAILURE;
+        }
+    }
+
+    return EXIT_SUCCESS;
+}
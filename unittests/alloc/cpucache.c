@@ -0,0 +1,279 @@
+// sched_setaffinity() is a GNU extension
+#define _GNU_SOURCE
+
+#include "alloc/cpucache.h"
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/slab.h"
+#include "alloc/strats.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <pthread.h>
+#include <sched.h>
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+#define NUM_THREADS 8
+
+// A freed chunk is kept by the CPU and handed out again for any request of the
+// same size rounded up to ALIGNMENT. The test runs on a single CPU, so that
+// malloc() and free() see the same cache
+int reuse_test() {
+    cpu_set_t allowed;
+    cpu_set_t single;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        pr_error("sched_getaffinity() failed");
+        return EXIT_FAILURE;
+    }
+    CPU_ZERO(&single);
+    CPU_SET(sched_getcpu(), &single);
+    if (sched_setaffinity(0, sizeof(single), &single)) {
+        pr_error("sched_setaffinity() failed");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *first = malloc(100);
+    uint8_t *guard = malloc(100);
+    ASSERT(is_aligned(first) && is_aligned(guard));
+
+    free(first);
+
+    uint8_t *addr = malloc(97);
+    if (addr != first || get_segment_size(addr) != 97) {
+        pr_error("Expected cached chunk %p, got %p", first, addr);
+        return EXIT_FAILURE;
+    }
+
+    // Other sizes are not served by the bin
+    free(guard);
+    uint8_t *other = malloc(200);
+    if (other == guard) {
+        pr_error("Chunk of 100 bytes handed out for 200 bytes");
+        return EXIT_FAILURE;
+    }
+
+    free(other);
+    free(addr);
+
+    if (sched_setaffinity(0, sizeof(allowed), &allowed)) {
+        pr_error("sched_setaffinity() failed");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Pins the calling thread to a single CPU, returns 0 on success
+static int pin(int cpu) {
+    cpu_set_t single;
+
+    CPU_ZERO(&single);
+    CPU_SET(cpu, &single);
+    return sched_setaffinity(0, sizeof(single), &single);
+}
+
+// Live objects of the slabs do not keep chunks of the segment list out of the
+// cache of the CPU. With first-fit, a chunk given back to the segment list
+// would be taken by the next request of any size, a cached one is not
+int slab_test() {
+    cpu_set_t allowed;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        pr_error("sched_getaffinity() failed");
+        return EXIT_FAILURE;
+    }
+    if (pin(sched_getcpu())) {
+        pr_error("sched_setaffinity() failed");
+        return EXIT_FAILURE;
+    }
+
+    set_alloc_function(FIRST_FIT);
+    set_slab_enabled(true);
+
+    uint8_t *object = malloc(16);
+    uint8_t *chunk = malloc(1000);
+    uint8_t *guard = malloc(1000);
+    ASSERT(slab_owns(object) && !slab_owns(chunk));
+
+    free(chunk);
+
+    uint8_t *other = malloc(600);
+    if (other == chunk) {
+        pr_error("Chunk %p not cached while a slab object is live", chunk);
+        return EXIT_FAILURE;
+    }
+
+    // The object goes back to its slab, not to the cache
+    free(object);
+    uint8_t *addr = malloc(16);
+    if (addr != object) {
+        pr_error("Expected object %p again, got %p", object, addr);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+    free(other);
+    free(guard);
+    set_slab_enabled(false);
+    set_alloc_function(NEXT_FIT);
+
+    if (sched_setaffinity(0, sizeof(allowed), &allowed)) {
+        pr_error("sched_setaffinity() failed");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Disabling the caches gives their chunks back, so they can be placed again
+// by the strategy. This includes the caches of CPUs the disabling thread may
+// not run on, and the thread stays where it is
+int disable_test() {
+    set_alloc_function(FIRST_FIT);
+
+    cpu_set_t allowed;
+    cpu_set_t after;
+    int first = -1;
+    int last = -1;
+
+    if (sched_getaffinity(0, sizeof(allowed), &allowed)) {
+        pr_error("sched_getaffinity() failed");
+        return EXIT_FAILURE;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &allowed)) {
+            first = first < 0 ? cpu : first;
+            last = cpu;
+        }
+    }
+
+    // The chunk is cached by the last CPU, and the caches are disabled from
+    // the first one, which differ unless there is only one CPU
+    if (pin(last)) {
+        pr_error("sched_setaffinity() failed");
+        return EXIT_FAILURE;
+    }
+    uint8_t *chunk = malloc(512);
+    free(chunk);
+
+    if (pin(first)) {
+        pr_error("sched_setaffinity() failed");
+        return EXIT_FAILURE;
+    }
+    set_cpucache_enabled(false);
+
+    if (sched_getaffinity(0, sizeof(after), &after)) {
+        pr_error("sched_getaffinity() failed");
+        return EXIT_FAILURE;
+    }
+    if (CPU_COUNT(&after) != 1 || !CPU_ISSET(first, &after)) {
+        pr_error("Disabling changed the affinity of the calling thread");
+        return EXIT_FAILURE;
+    }
+    if (sched_setaffinity(0, sizeof(allowed), &allowed)) {
+        pr_error("sched_setaffinity() failed");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *addr = malloc(500);
+    if (addr != chunk) {
+        pr_error("Expected flushed chunk %p, got %p", chunk, addr);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+
+    return EXIT_SUCCESS;
+}
+
+static void *stress_thread(void *arg) {
+    uint8_t *chunks[128] = {};
+
+    // Mostly small chunks which are cached, some larger ones which are not.
+    // Chunks are only ever freed, never reallocated
+    stress_s stress = {.slots = 128,
+                       .rounds = 50000,
+                       .seed = (uint32_t)(uintptr_t)arg,
+                       .max_size = CPUCACHE_MAX_SIZE,
+                       .large_every = 8,
+                       .large_size = 4000,
+                       .frees = 3};
+
+    int status = stress_run(&stress, chunks);
+
+    for (size_t i = 0; i < 128; i++) {
+        free(chunks[i]);
+    }
+
+    return status ? (void *)1 : nullptr;
+}
+
+// More threads than CPUs allocate and free concurrently, so threads are
+// preempted in the middle of the restartable sequences, and no chunk may be
+// handed out twice
+int stress_test() {
+    set_cpucache_enabled(true);
+    set_alloc_function(NEXT_FIT);
+
+    pthread_t threads[NUM_THREADS];
+
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], nullptr, &stress_thread,
+                       (void *)(uintptr_t)(i + 1));
+    }
+
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    set_cpucache_enabled(false);
+
+    return status;
+}
+
+int main() {
+
+    // Without restartable sequences, enabling fails and everything goes
+    // through the locked path
+    if (set_cpucache_enabled(true) == ERROR) {
+        ASSERT(!get_cpucache_enabled());
+
+        uint8_t *addr = malloc(100);
+        ASSERT(is_aligned(addr));
+        free(addr);
+
+        pr_info("Restartable sequences not available, skipping");
+        return EXIT_SUCCESS;
+    }
+
+    if (reuse_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (slab_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (disable_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
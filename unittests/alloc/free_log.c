@@ -0,0 +1,172 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/free_log.h"
+#include "alloc/memory_mgmt.h"
+
+#include "unittests/defines.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+static uint8_t *chunks[FREE_LOG_SIZE];
+
+// Logged chunks stay allocated until the log is full. The whole log is then
+// freed under a single lock, and the table is empty afterwards
+int flush_test() {
+    set_alloc_function(FIRST_FIT);
+    set_free_log_enabled(true);
+
+    for (size_t i = 0; i < FREE_LOG_SIZE; i++) {
+        chunks[i] = malloc(50 + 10 * i);
+        ASSERT(chunks[i] && is_aligned(chunks[i]));
+    }
+
+    heap_lock_stats_s before = {};
+    heap_lock_stats_s after = {};
+    get_lock_stats(&before);
+
+    // Free in an order which merges with neither neighbor if done one by one
+    for (size_t i = 0; i < FREE_LOG_SIZE - 1; i++) {
+        free(chunks[(i * 7) % FREE_LOG_SIZE]);
+    }
+
+    get_lock_stats(&after);
+    if (after.acquisitions != before.acquisitions) {
+        pr_error("Arena locked before the log was full");
+        return EXIT_FAILURE;
+    }
+    if (!arena_main()->list->first_seg) {
+        pr_error("Logged chunks freed before the log was full");
+        return EXIT_FAILURE;
+    }
+
+    free(chunks[((FREE_LOG_SIZE - 1) * 7) % FREE_LOG_SIZE]);
+
+    get_lock_stats(&after);
+    if (after.acquisitions != before.acquisitions + 1) {
+        pr_error("Expected one lock for the whole log, got %zu",
+                 after.acquisitions - before.acquisitions);
+        return EXIT_FAILURE;
+    }
+    if (arena_main()->list->first_seg) {
+        pr_error("Table not empty");
+        return EXIT_FAILURE;
+    }
+
+    // Disabling frees what is left in the log
+    uint8_t *chunk = malloc(100);
+    free(chunk);
+    ASSERT(arena_main()->list->first_seg);
+
+    set_free_log_enabled(false);
+    if (arena_main()->list->first_seg) {
+        pr_error("Log not flushed when disabled");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void *exit_thread(void *arg) {
+    uint8_t **chunk = arg;
+
+    *chunk = malloc(5000);
+    free(*chunk);
+
+    return nullptr;
+}
+
+// The log of a thread is freed when the thread exits, so its chunks can be
+// placed again
+int exit_test() {
+    set_free_log_enabled(true);
+
+    uint8_t *chunk = nullptr;
+    pthread_t thread;
+
+    pthread_create(&thread, nullptr, &exit_thread, &chunk);
+    pthread_join(thread, nullptr);
+
+    set_free_log_enabled(false);
+
+    // The thread allocated in the main arena, since there is only one
+    uint8_t *addr = malloc(5000);
+    if (addr != chunk) {
+        pr_error("Expected chunk %p of the exited thread, got %p", chunk, addr);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+
+    return EXIT_SUCCESS;
+}
+
+static pthread_barrier_t barrier;
+
+static void *disable_thread(void *arg) {
+    uint8_t **chunk = arg;
+
+    *chunk = malloc(5000);
+    free(*chunk);
+
+    // Deferred frees are disabled in between
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+
+    free(malloc(100));
+
+    pthread_barrier_wait(&barrier);
+
+    return nullptr;
+}
+
+// Disabling deferred frees only flushes the log of the calling thread. Every
+// other thread flushes its log on its next call of malloc() or free(), even
+// though it keeps running
+int disable_test() {
+    set_free_log_enabled(true);
+    pthread_barrier_init(&barrier, nullptr, 2);
+
+    uint8_t *chunk = nullptr;
+    pthread_t thread;
+
+    pthread_create(&thread, nullptr, &disable_thread, &chunk);
+    pthread_barrier_wait(&barrier);
+    set_free_log_enabled(false);
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+
+    uint8_t *addr = malloc(5000);
+    if (addr != chunk) {
+        pr_error("Expected chunk %p logged by the thread, got %p", chunk, addr);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+    pthread_join(thread, nullptr);
+    pthread_barrier_destroy(&barrier);
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+
+    if (flush_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (exit_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (disable_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,151 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/hugepage.h"
+#include "alloc/mapped.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/purge.h"
+
+#include "unittests/defines.h"
+#include <stdlib.h>
+
+#define LARGE_SIZE ((size_t)5 * 1024 * 1024)
+
+bool is_huge_aligned(const void *ptr) {
+    return (uintptr_t)ptr % HUGE_PAGE_SIZE == 0;
+}
+
+// The range of the table starts on a huge page boundary, and the memory kept
+// ahead of the table ends on one
+int layout_test() {
+    set_alloc_function(FIRST_FIT);
+    set_mmap_threshold(SIZE_MAX);
+    set_hugepage_enabled(true);
+    ASSERT(get_hugepage_enabled());
+
+    uint8_t *small = malloc(100);
+    ASSERT(small);
+
+    arena_s *arena = arena_main();
+    if (!is_huge_aligned(arena->base) || !is_huge_aligned(arena->committed)) {
+        pr_error("Range at %p or committed end at %p not aligned", arena->base,
+                 arena->committed);
+        return EXIT_FAILURE;
+    }
+
+    free(small);
+
+    return EXIT_SUCCESS;
+}
+
+// Interior gaps are purged in whole huge pages only. The coverage reported
+// never exceeds the memory committed
+int purge_test() {
+    set_purge_advice(PURGE_DONTNEED);
+
+    uint8_t *a = malloc(100);
+    uint8_t *large = malloc(LARGE_SIZE);
+    uint8_t *b = malloc(100);
+    ASSERT(a && large && b);
+
+    for (size_t k = 0; k < LARGE_SIZE; k++) {
+        large[k] = 1;
+    }
+
+    hugepage_stats_s stats = {};
+    get_hugepage_stats(&stats);
+
+    if (stats.committed < LARGE_SIZE || stats.huge > stats.committed) {
+        pr_error("Invalid coverage: %zu of %zu bytes", stats.huge,
+                 stats.committed);
+        return EXIT_FAILURE;
+    }
+    pr_info("%zu of %zu bytes backed by huge pages", stats.huge,
+            stats.committed);
+
+    purge_stats_s before = {};
+    purge_stats_s after = {};
+
+    get_purge_stats(&before);
+    free(large);
+    get_purge_stats(&after);
+
+    // A 5 MiB gap holds at least one aligned huge page
+    size_t advised = after.advised - before.advised;
+    if (!advised || advised % HUGE_PAGE_SIZE) {
+        pr_error("Expected whole huge pages purged, got %zu bytes", advised);
+        return EXIT_FAILURE;
+    }
+
+    free(a);
+    free(b);
+
+    return EXIT_SUCCESS;
+}
+
+// The memory retained after shrinking ends on a huge page boundary as well
+int trim_test() {
+    set_decay_time(0);
+
+    uint8_t *large = malloc(LARGE_SIZE);
+    ASSERT(large);
+    free(large);
+
+    arena_s *arena = arena_main();
+    arena_maintain(arena);
+
+    if (!is_huge_aligned(arena->committed) ||
+        arena->committed > arena->base + 2 * HUGE_PAGE_SIZE) {
+        pr_error("Committed end at %p not trimmed to a huge page",
+                 arena->committed);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Next-fit places chunks with first-fit while huge pages are enabled, so a
+// gap at the beginning of the table is filled before the memory after the
+// last chunk placed
+int placement_test() {
+    set_alloc_function(NEXT_FIT);
+
+    uint8_t *first = malloc(100);
+    uint8_t *middle = malloc(100);
+    uint8_t *last = malloc(100);
+    ASSERT(first && middle && last);
+
+    free(first);
+
+    uint8_t *reused = malloc(100);
+    if (reused != first) {
+        pr_error("Expected %p reused, got %p", first, reused);
+        return EXIT_FAILURE;
+    }
+
+    free(reused);
+    free(middle);
+    free(last);
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+
+    if (layout_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (purge_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (trim_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (placement_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/mapped.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/utils.h"
+
+#include "unittests/defines.h"
+#include <stdlib.h>
+#include <string.h>
+#include <sys/mman.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+#define LARGE_SIZE ((size_t)1024 * 1024)
+
+// Checks whether the page of an address is mapped
+bool is_mapped(void *ptr) {
+    unsigned char vec;
+    void *page = (void *)((uintptr_t)ptr & ~((uintptr_t)PAGE_SIZE - 1));
+
+    return !mincore(page, PAGE_SIZE, &vec);
+}
+
+// Freeing a mapped chunk raises the threshold to the size of its mapping, so
+// that the next chunk of that size is placed in the storage table. Chunks
+// beyond MAPPED_THRESHOLD_MAX never raise it
+int threshold_test() {
+    set_alloc_function(FIRST_FIT);
+    ASSERT(get_mmap_threshold() == MAPPED_THRESHOLD_MIN);
+
+    uint8_t *large = malloc(LARGE_SIZE);
+    ASSERT(mapped_owns(large));
+    free(large);
+
+    if (get_mmap_threshold() <= LARGE_SIZE) {
+        pr_error("Threshold not raised, still %zu", get_mmap_threshold());
+        return EXIT_FAILURE;
+    }
+
+    large = malloc(LARGE_SIZE);
+    if (mapped_owns(large) || get_segment_size(large) != LARGE_SIZE) {
+        pr_error("Chunk below the raised threshold mapped");
+        return EXIT_FAILURE;
+    }
+    free(large);
+
+    size_t threshold = get_mmap_threshold();
+    uint8_t *huge = malloc(2 * MAPPED_THRESHOLD_MAX);
+    ASSERT(mapped_owns(huge));
+    free(huge);
+
+    if (get_mmap_threshold() != threshold) {
+        pr_error("Threshold raised beyond MAPPED_THRESHOLD_MAX");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Large chunks get a mapping of their own, leave the break alone and are
+// unmapped on free. A threshold set explicitly stays as it is, but is never
+// lower than MAPPED_THRESHOLD_MIN
+int map_test() {
+    set_mmap_threshold(0);
+    if (get_mmap_threshold() != MAPPED_THRESHOLD_MIN) {
+        pr_error("Threshold not clamped, got %zu", get_mmap_threshold());
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *small = malloc(100);
+    uint8_t *brk = arena_main()->brk;
+
+    uint8_t *large = malloc(LARGE_SIZE);
+    if (!large || !is_aligned(large) || !mapped_owns(large) ||
+        mapped_size(large) != LARGE_SIZE) {
+        pr_error("Large chunk not mapped");
+        return EXIT_FAILURE;
+    }
+    if (mapped_owns(small) || arena_main()->brk != brk) {
+        pr_error("Small chunk mapped or break moved");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t k = 0; k < LARGE_SIZE; k++) {
+        large[k] = (uint8_t)k;
+    }
+
+    // calloc() relies on fresh mappings being zeroed
+    uint8_t *zeroed = calloc(LARGE_SIZE, 1);
+    ASSERT(mapped_owns(zeroed));
+    for (size_t k = 0; k < LARGE_SIZE; k++) {
+        if (zeroed[k]) {
+            pr_error("calloc() not zeroed at %zu", k);
+            return EXIT_FAILURE;
+        }
+    }
+    free(zeroed);
+
+    // Both ends of the chunk are given back
+    free(large);
+
+    if (is_mapped(large) || is_mapped(large + LARGE_SIZE - 1)) {
+        pr_error("Large chunk still mapped");
+        return EXIT_FAILURE;
+    }
+    if (get_mmap_threshold() != MAPPED_THRESHOLD_MIN) {
+        pr_error("Threshold set explicitly has been raised");
+        return EXIT_FAILURE;
+    }
+
+    free(small);
+
+    return EXIT_SUCCESS;
+}
+
+// Growing a mapped chunk keeps it mapped with its contents, shrinking it below
+// the threshold moves it into the storage table
+int realloc_test() {
+    uint8_t *large = malloc(LARGE_SIZE);
+    ASSERT(mapped_owns(large));
+
+    for (size_t k = 0; k < LARGE_SIZE; k++) {
+        large[k] = (uint8_t)k;
+    }
+
+    large = realloc(large, 4 * LARGE_SIZE);
+    if (!mapped_owns(large) || mapped_size(large) != 4 * LARGE_SIZE) {
+        pr_error("Grown chunk not mapped");
+        return EXIT_FAILURE;
+    }
+    for (size_t k = 0; k < LARGE_SIZE; k++) {
+        if (large[k] != (uint8_t)k) {
+            pr_error("Lost content when growing");
+            return EXIT_FAILURE;
+        }
+    }
+
+    uint8_t *small = realloc(large, 1000);
+    if (mapped_owns(small) || get_segment_size(small) != 1000) {
+        pr_error("Shrunk chunk not moved into the table");
+        return EXIT_FAILURE;
+    }
+    for (size_t k = 0; k < 1000; k++) {
+        if (small[k] != (uint8_t)k) {
+            pr_error("Lost content when shrinking");
+            return EXIT_FAILURE;
+        }
+    }
+
+    free(small);
+
+    return EXIT_SUCCESS;
+}
+
+// A chunk of the storage table is never taken for a mapped one, even if the
+// user stores a copy of the header of a mapping in front of it
+int forge_test() {
+    uint8_t *large = malloc(LARGE_SIZE);
+    ASSERT(mapped_owns(large));
+
+    size_t offset = (uintptr_t)large % PAGE_SIZE;
+
+    uint8_t *chunk = malloc(3 * PAGE_SIZE);
+    ASSERT(chunk && !mapped_owns(chunk));
+
+    // An address inside of the chunk at the same offset into its page, with
+    // the header copied in front of it. Its third word mixes in the address
+    uint8_t *addr = (uint8_t *)round_up((uintptr_t)chunk, PAGE_SIZE) + offset;
+    uintptr_t *header = (uintptr_t *)(addr - offset);
+
+    memcpy(header, large - offset, offset);
+    header[2] ^= (uintptr_t)large ^ (uintptr_t)addr;
+
+    if (mapped_owns(addr)) {
+        pr_error("Forged header at %p taken for a mapping", addr);
+        return EXIT_FAILURE;
+    }
+
+    free(chunk);
+    free(large);
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+
+    if (threshold_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (map_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (realloc_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (forge_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
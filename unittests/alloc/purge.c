@@ -0,0 +1,176 @@
+#include "alloc/defines.h"
+#include "alloc/mapped.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/purge.h"
+#include "alloc/utils.h"
+
+#include "unittests/defines.h"
+#include <stdlib.h>
+#include <sys/mman.h>
+
+#define LARGE_SIZE ((size_t)1024 * 1024)
+
+// Counts the resident whole pages of a range, all of them if unknown
+size_t resident_pages(uint8_t *from, size_t size) {
+    static unsigned char vec[LARGE_SIZE / PAGE_SIZE];
+    uint8_t *page = (uint8_t *)round_up((uintptr_t)from, PAGE_SIZE);
+    size_t pages = (from + size - page) / PAGE_SIZE;
+    size_t resident = 0;
+
+    if (mincore(page, pages * PAGE_SIZE, vec)) {
+        pr_error("mincore() failed");
+        return pages;
+    }
+    for (size_t i = 0; i < pages; i++) {
+        resident += vec[i] & 1;
+    }
+
+    return resident;
+}
+
+// Freeing a large chunk between two others purges its pages. Freeing its
+// neighbor merges the gaps, but only the pages of the neighbor are advised
+int purge_test() {
+    set_alloc_function(FIRST_FIT);
+    set_mmap_threshold(SIZE_MAX);
+    set_purge_advice(PURGE_DONTNEED);
+
+    purge_stats_s before = {};
+    purge_stats_s after = {};
+
+    uint8_t *a = malloc(100);
+    uint8_t *large = malloc(LARGE_SIZE);
+    uint8_t *neighbor = malloc(LARGE_SIZE / 4);
+    uint8_t *b = malloc(100);
+    ASSERT(a && large && neighbor && b);
+
+    for (size_t k = 0; k < LARGE_SIZE; k++) {
+        large[k] = 1;
+    }
+    for (size_t k = 0; k < LARGE_SIZE / 4; k++) {
+        neighbor[k] = 1;
+    }
+
+    get_purge_stats(&before);
+    free(large);
+    get_purge_stats(&after);
+
+    // Up to two pages at either end hold chunk metadata and gap bookkeeping
+    size_t purged = after.purged - before.purged;
+    if (purged < LARGE_SIZE - 2 * PAGE_SIZE || purged > LARGE_SIZE) {
+        pr_error("Expected the pages of the chunk purged, got %zu", purged);
+        return EXIT_FAILURE;
+    }
+    if (resident_pages(large + PAGE_SIZE, LARGE_SIZE - 2 * PAGE_SIZE)) {
+        pr_error("Purged pages still resident");
+        return EXIT_FAILURE;
+    }
+
+    get_purge_stats(&before);
+    free(neighbor);
+    get_purge_stats(&after);
+
+    size_t advised = after.advised - before.advised;
+    if (advised > LARGE_SIZE / 4 + PAGE_SIZE) {
+        pr_error("Pages purged twice, advised %zu bytes", advised);
+        return EXIT_FAILURE;
+    }
+    if (after.purged != before.purged + advised) {
+        pr_error("Purged bytes not counted");
+        return EXIT_FAILURE;
+    }
+
+    // Pages of a new chunk are no longer counted as purged, and are purged
+    // again once it is freed
+    uint8_t *reused = malloc(LARGE_SIZE / 2);
+    ASSERT(reused == large);
+
+    get_purge_stats(&before);
+    if (before.purged > after.purged - LARGE_SIZE / 2 + PAGE_SIZE) {
+        pr_error("Reused pages still counted as purged");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t k = 0; k < LARGE_SIZE / 2; k++) {
+        reused[k] = 1;
+    }
+    free(reused);
+
+    get_purge_stats(&after);
+    if (after.advised - before.advised < LARGE_SIZE / 2 - PAGE_SIZE) {
+        pr_error("Reused pages not purged again");
+        return EXIT_FAILURE;
+    }
+
+    free(a);
+    free(b);
+
+    return EXIT_SUCCESS;
+}
+
+// Gaps below PURGE_MIN_SIZE keep their pages, as do all gaps with purging
+// disabled
+int keep_test() {
+    purge_stats_s before = {};
+    purge_stats_s after = {};
+
+    uint8_t *a = malloc(100);
+    uint8_t *small = malloc(PURGE_MIN_SIZE / 2);
+    uint8_t *large = malloc(LARGE_SIZE);
+    uint8_t *b = malloc(100);
+    ASSERT(a && small && large && b);
+
+    set_purge_advice(PURGE_NONE);
+
+    get_purge_stats(&before);
+    free(large);
+    get_purge_stats(&after);
+
+    if (after.advised != before.advised) {
+        pr_error("Purged although disabled");
+        return EXIT_FAILURE;
+    }
+
+    set_purge_advice(PURGE_FREE);
+
+    // Placed where the large chunk was, so the gap after it stays small
+    uint8_t *c = malloc(LARGE_SIZE - PURGE_MIN_SIZE / 2);
+    ASSERT(c == large);
+
+    get_purge_stats(&before);
+    free(small);
+    get_purge_stats(&after);
+
+    if (after.advised != before.advised) {
+        pr_error("Small gap purged");
+        return EXIT_FAILURE;
+    }
+
+    free(a);
+    free(b);
+    free(c);
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+
+    if (purge_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    purge_stats_s stats = {};
+    get_purge_stats(&stats);
+    if (stats.purged) {
+        pr_error("Purged pages not forgotten when cleared");
+        return EXIT_FAILURE;
+    }
+
+    if (keep_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,176 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/memory_mgmt.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+#define NUM_PAIRS 4
+#define RING_SIZE 64
+#define NUM_CHUNKS 20000
+
+static pthread_barrier_t barrier;
+
+static void *queue_thread(void *arg) {
+    pthread_barrier_wait(&barrier);
+
+    // The main thread holds the lock of the arena here
+    free(arg);
+
+    pthread_barrier_wait(&barrier);
+
+    return nullptr;
+}
+
+// A free() from another thread does not wait while the arena is locked. The
+// chunk is queued instead, and freed when the arena is locked next
+int queue_test() {
+    set_alloc_function(FIRST_FIT);
+
+    uint8_t *chunk = malloc(300);
+    uint8_t *guard = malloc(300);
+    ASSERT(is_aligned(chunk) && is_aligned(guard));
+
+    pthread_t thread;
+    pthread_barrier_init(&barrier, nullptr, 2);
+    pthread_create(&thread, nullptr, &queue_thread, chunk);
+
+    arena_lock(arena_main());
+    pthread_barrier_wait(&barrier);
+    pthread_barrier_wait(&barrier);
+    size_t size = get_segment_size(chunk);
+    arena_unlock(arena_main());
+
+    pthread_join(thread, nullptr);
+    pthread_barrier_destroy(&barrier);
+
+    if (size != 300) {
+        pr_error("Queued chunk freed before the arena was locked again");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *addr = malloc(300);
+    if (addr != chunk) {
+        pr_error("Expected queued chunk %p, got %p", chunk, addr);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+    free(guard);
+
+    return EXIT_SUCCESS;
+}
+
+// A ring of chunks handed from a producer to a consumer
+typedef struct ring_s {
+    pthread_mutex_t lock;
+    pthread_cond_t cond;
+    uint8_t *chunks[RING_SIZE];
+    size_t sizes[RING_SIZE];
+    size_t head;
+    size_t tail;
+} ring_s;
+
+static ring_s rings[NUM_PAIRS];
+
+static void *producer(void *arg) {
+    ring_s *ring = arg;
+    uint32_t seed = (uint32_t)(uintptr_t)ring;
+
+    for (size_t i = 0; i < NUM_CHUNKS; i++) {
+        seed = seed * 1103515245 + 12345;
+        size_t size = 1 + (seed >> 4) % 2000;
+
+        uint8_t *chunk = malloc(size);
+        if (!chunk || !is_aligned(chunk)) {
+            pr_error("Invalid alloc");
+            return (void *)1;
+        }
+        stress_fill(chunk, size, size);
+
+        pthread_mutex_lock(&ring->lock);
+        while (ring->head - ring->tail == RING_SIZE) {
+            pthread_cond_wait(&ring->cond, &ring->lock);
+        }
+        ring->chunks[ring->head % RING_SIZE] = chunk;
+        ring->sizes[ring->head % RING_SIZE] = size;
+        ring->head++;
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+    }
+
+    return nullptr;
+}
+
+static void *consumer(void *arg) {
+    ring_s *ring = arg;
+
+    for (size_t i = 0; i < NUM_CHUNKS; i++) {
+        pthread_mutex_lock(&ring->lock);
+        while (ring->head == ring->tail) {
+            pthread_cond_wait(&ring->cond, &ring->lock);
+        }
+        uint8_t *chunk = ring->chunks[ring->tail % RING_SIZE];
+        size_t size = ring->sizes[ring->tail % RING_SIZE];
+        ring->tail++;
+        pthread_cond_broadcast(&ring->cond);
+        pthread_mutex_unlock(&ring->lock);
+
+        if (!stress_intact(chunk, size, size)) {
+            pr_error("Chunk %p got overwritten", chunk);
+            return (void *)1;
+        }
+
+        free(chunk);
+    }
+
+    return nullptr;
+}
+
+// Producers allocate chunks which consumers free, so most frees happen in
+// another thread than the allocation, often while the producer holds the lock
+int pipeline_test() {
+    set_alloc_function(NEXT_FIT);
+
+    pthread_t threads[2 * NUM_PAIRS];
+
+    for (size_t i = 0; i < NUM_PAIRS; i++) {
+        pthread_mutex_init(&rings[i].lock, nullptr);
+        pthread_cond_init(&rings[i].cond, nullptr);
+        rings[i].head = rings[i].tail = 0;
+
+        pthread_create(&threads[2 * i], nullptr, &producer, &rings[i]);
+        pthread_create(&threads[2 * i + 1], nullptr, &consumer, &rings[i]);
+    }
+
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < 2 * NUM_PAIRS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    return status;
+}
+
+int main() {
+
+    if (queue_test()) {
+        return EXIT_FAILURE;
+    }
+
+    // The storage is not cleared in between, the C library keeps allocations
+    // of its own for the threads created so far
+    if (pipeline_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
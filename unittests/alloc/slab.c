@@ -0,0 +1,112 @@
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/slab.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+// Small objects are packed into slabs without any header, so objects of the
+// same class directly follow each other within a page
+int packing_test() {
+    set_slab_enabled(true);
+
+    uint8_t *first = malloc(1);
+    ASSERT(is_aligned(first));
+
+    for (size_t i = 1; i < 64; i++) {
+        uint8_t *addr = malloc(1);
+        if (addr != first + i * 16) {
+            pr_error("Expected %p, got %p", first + i * 16, addr);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Sizes are rounded up to the size classes
+    uint8_t *medium = malloc(100);
+    if (slab_object_size(medium) != 112 || !slab_owns(medium) ||
+        (uintptr_t)medium / PAGE_SIZE == (uintptr_t)first / PAGE_SIZE) {
+        pr_error("100 bytes should be an object of its own slab of 112 bytes");
+        return EXIT_FAILURE;
+    }
+
+    // Requests above SLAB_MAX_SIZE are chunks of the segment list
+    uint8_t *large = malloc(SLAB_MAX_SIZE + 1);
+    if (slab_owns(large) || get_segment_size(large) != SLAB_MAX_SIZE + 1) {
+        pr_error("Large request not served by the segment list");
+        return EXIT_FAILURE;
+    }
+    free(large);
+
+    // A freed object is handed out again right away
+    free(first + 5 * 16);
+    uint8_t *addr = malloc(16);
+    if (addr != first + 5 * 16) {
+        pr_error("Expected %p, got %p", first + 5 * 16, addr);
+        return EXIT_FAILURE;
+    }
+
+    // Reallocating within the same class keeps the object, other sizes move
+    if (realloc(medium, 97) != medium) {
+        pr_error("Object of the same class moved");
+        return EXIT_FAILURE;
+    }
+    for (size_t k = 0; k < 97; k++) {
+        medium[k] = (uint8_t)k;
+    }
+
+    uint8_t *moved = realloc(medium, 300);
+    if (slab_object_size(moved) != 320) {
+        pr_error("Expected an object of 320 bytes");
+        return EXIT_FAILURE;
+    }
+    for (size_t k = 0; k < 97; k++) {
+        if (moved[k] != (uint8_t)k) {
+            pr_error("Content not copied");
+            return EXIT_FAILURE;
+        }
+    }
+
+    set_slab_enabled(false);
+
+    return EXIT_SUCCESS;
+}
+
+// Turns the slabs on and off
+static void switch_slabs(size_t phase) { set_slab_enabled(phase % 2 == 0); }
+
+// Sizes of up to 600 bytes straddle SLAB_MAX_SIZE, and every 10000 rounds the
+// slabs are turned off or on. Objects are thus reallocated from slabs into
+// chunks of the table and back, and freed wherever they ended up
+int stress_test() {
+    uint8_t *chunks[512] = {};
+    stress_s stress = {.slots = 512,
+                       .rounds = 40000,
+                       .seed = 13,
+                       .max_size = 600,
+                       .large_every = 5,
+                       .large_size = 5000,
+                       .frees = 2,
+                       .phase_rounds = 10000,
+                       .phase = &switch_slabs};
+
+    return stress_run(&stress, chunks);
+}
+
+int main() {
+
+    if (packing_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,207 @@
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/slab.h"
+#include "alloc/strats.h"
+#include "alloc/tcache.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+#define NUM_THREADS 4
+
+// A freed chunk is kept by the thread and handed out again for any request of
+// the same size rounded up to ALIGNMENT
+int reuse_test() {
+    set_tcache_enabled(true);
+
+    uint8_t *first = malloc(100);
+    uint8_t *guard = malloc(100);
+    ASSERT(is_aligned(first) && is_aligned(guard));
+
+    free(first);
+
+    uint8_t *addr = malloc(97);
+    if (addr != first || get_segment_size(addr) != 97) {
+        pr_error("Expected cached chunk %p, got %p", first, addr);
+        return EXIT_FAILURE;
+    }
+
+    // The chunk keeps its place in the segment list, so it can be reallocated
+    // like any other chunk
+    for (size_t k = 0; k < 97; k++) {
+        addr[k] = (uint8_t)k;
+    }
+
+    uint8_t *moved = realloc(addr, 3000);
+    for (size_t k = 0; k < 97; k++) {
+        if (moved[k] != (uint8_t)k) {
+            pr_error("Lost content on realloc");
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Other sizes are not served by the bin
+    free(guard);
+    addr = malloc(200);
+    if (addr == guard) {
+        pr_error("Chunk of 100 bytes handed out for 200 bytes");
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+    free(moved);
+    set_tcache_enabled(false);
+
+    return EXIT_SUCCESS;
+}
+
+// Live objects of the slabs do not keep chunks of the segment list out of the
+// cache. With first-fit, a chunk given back to the segment list would be taken
+// by the next request of any size, a cached one is not
+int slab_test() {
+    set_alloc_function(FIRST_FIT);
+    set_slab_enabled(true);
+    set_tcache_enabled(true);
+
+    uint8_t *object = malloc(16);
+    uint8_t *chunk = malloc(1000);
+    uint8_t *guard = malloc(1000);
+    ASSERT(slab_owns(object) && !slab_owns(chunk));
+
+    free(chunk);
+
+    uint8_t *other = malloc(600);
+    if (other == chunk) {
+        pr_error("Chunk %p not cached while a slab object is live", chunk);
+        return EXIT_FAILURE;
+    }
+
+    // The object goes back to its slab, not to the cache
+    free(object);
+    uint8_t *addr = malloc(16);
+    if (addr != object) {
+        pr_error("Expected object %p again, got %p", object, addr);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+    free(other);
+    free(guard);
+    set_tcache_enabled(false);
+    set_slab_enabled(false);
+    set_alloc_function(NEXT_FIT);
+
+    return EXIT_SUCCESS;
+}
+
+static void *exit_thread(void *arg) {
+    uint8_t **chunk = arg;
+
+    *chunk = malloc(512);
+    free(*chunk);
+
+    return nullptr;
+}
+
+// The cache of a thread is given back when the thread exits, so its chunks can
+// be placed again by the strategy
+int exit_test() {
+    set_tcache_enabled(true);
+    set_alloc_function(FIRST_FIT);
+
+    uint8_t *chunk = nullptr;
+    pthread_t thread;
+
+    pthread_create(&thread, nullptr, &exit_thread, &chunk);
+    pthread_join(thread, nullptr);
+
+    uint8_t *addr = malloc(500);
+    if (addr != chunk) {
+        pr_error("Expected flushed chunk %p, got %p", chunk, addr);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+    set_tcache_enabled(false);
+
+    return EXIT_SUCCESS;
+}
+
+static void *stress_thread(void *arg) {
+    uint8_t *chunks[128] = {};
+
+    // Mostly small chunks which are cached, some larger ones which are not.
+    // Chunks are only ever freed, never reallocated
+    stress_s stress = {.slots = 128,
+                       .rounds = 50000,
+                       .seed = (uint32_t)(uintptr_t)arg,
+                       .max_size = TCACHE_MAX_SIZE,
+                       .large_every = 8,
+                       .large_size = 4000,
+                       .frees = 3};
+
+    int status = stress_run(&stress, chunks);
+
+    for (size_t i = 0; i < 128; i++) {
+        free(chunks[i]);
+    }
+
+    return status ? (void *)1 : nullptr;
+}
+
+// Several threads allocate and free concurrently, and no chunk may be handed
+// out twice
+int stress_test() {
+    set_tcache_enabled(true);
+    set_alloc_function(NEXT_FIT);
+
+    pthread_t threads[NUM_THREADS];
+
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], nullptr, &stress_thread,
+                       (void *)(uintptr_t)(i + 1));
+    }
+
+    int status = EXIT_SUCCESS;
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        void *ret;
+        pthread_join(threads[i], &ret);
+        if (ret) {
+            status = EXIT_FAILURE;
+        }
+    }
+
+    set_tcache_enabled(false);
+
+    return status;
+}
+
+int main() {
+
+    if (reuse_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (slab_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (exit_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,13 @@
+#include "alloc/arena.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/mapped.h"
 #include "alloc/memory_mgmt.h"
 #include "unittests/defines.h"
 #include <alloc/defines.h>
 
 #include <stdlib.h>
+#include <time.h>
+#include <unistd.h>
 
 int expand_empty_list() {
     pr_info("Testing expanding of empty list");
@@ -87,6 +92,151 @@ int expand_free_existing_list() {
     return EXIT_SUCCESS;
 }
 
+int expand_ahead_list() {
+    pr_info("Testing expanding into memory reserved ahead");
+
+    uint8_t *addr = malloc(100);
+    if (!addr) {
+        pr_error("Invalid alloc");
+        return EXIT_FAILURE;
+    }
+
+    // Growing the list by less than half of the memory reserved ahead needs no
+    // system call
+    uint8_t *brk = arena_main()->brk;
+    for (size_t i = 0; i < ARENA_GROW_AHEAD / 2 / 2048; i++) {
+        if (!malloc(1000)) {
+            pr_error("Invalid alloc");
+            return EXIT_FAILURE;
+        }
+    }
+
+    if (arena_main()->brk != brk) {
+        pr_error("Break moved from %p to %p", brk, arena_main()->brk);
+        return EXIT_FAILURE;
+    }
+
+    // A large chunk allocated and freed over and over keeps its memory, so
+    // the break only moves the first time. The large chunk has to be placed in
+    // the list for that, not mapped
+    set_mmap_threshold(SIZE_MAX);
+    set_decay_time(10000);
+
+    for (size_t i = 0; i < 100; i++) {
+        uint8_t *large = malloc(1024 * 1024);
+        if (!large) {
+            pr_error("Invalid alloc");
+            return EXIT_FAILURE;
+        }
+        large[1024 * 1024 - 1] = 1;
+        free(large);
+
+        if (!i) {
+            brk = arena_main()->brk;
+        } else if (arena_main()->brk != brk) {
+            pr_error("Break moved in iteration %zu", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    // Once the decay time has passed, no more than twice the memory reserved
+    // ahead is kept
+    set_decay_time(10);
+    struct timespec pause = {.tv_nsec = 20000000};
+    nanosleep(&pause, nullptr);
+    free(malloc(100));
+
+    if (arena_main()->brk >
+        arena_main()->list->end_addr + 2 * ARENA_GROW_AHEAD) {
+        pr_error("Kept %zu bytes after the list",
+                 (size_t)(arena_main()->brk - arena_main()->list->end_addr));
+        return EXIT_FAILURE;
+    }
+
+    set_decay_time(ARENA_DEFAULT_DECAY_MS);
+
+    return EXIT_SUCCESS;
+}
+
+// The list lives in a range of its own, so moving the program break does not
+// split it
+int expand_foreign_break() {
+    pr_info("Testing expanding while the program break moves");
+
+    uint8_t *addrs[64];
+
+    for (size_t i = 0; i < 64; i++) {
+        addrs[i] = malloc(4000);
+        if (!addrs[i]) {
+            pr_error("Invalid alloc");
+            return EXIT_FAILURE;
+        }
+
+        // Other code in the process takes memory from the program break
+        if (i % 8 == 0 && sbrk(PAGE_SIZE) == (void *)-1) {
+            pr_error("sbrk failed");
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (size_t i = 1; i < 64; i++) {
+        if (addrs[i] != addrs[i - 1] + get_segment_size(addrs[i - 1]) +
+                            sizeof(seg_tail_s) + sizeof(seg_head_s)) {
+            pr_error("Chunk %zu not next to the previous one", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    for (size_t i = 0; i < 64; i++) {
+        free(addrs[i]);
+    }
+
+    if (arena_main()->list->first_seg) {
+        pr_error("List not empty");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Once the range of an arena is exhausted, the table continues in an extent,
+// and the thread allocates from the extent from then on
+int expand_exhausted_list() {
+    pr_info("Testing expanding beyond the range of the arena");
+
+    size_t size = ARENA_RESERVE / 2 + ARENA_RESERVE / 8;
+
+    uint8_t *first = malloc(size);
+    uint8_t *second = malloc(size);
+
+    if (!first || !second || arena_of(first) != arena_main() ||
+        arena_of(second) == arena_main()) {
+        pr_error("Expected the second chunk in an extent");
+        return EXIT_FAILURE;
+    }
+
+    // Both are usable up to their end
+    first[size - 1] = 1;
+    second[size - 1] = 2;
+
+    uint8_t *small = malloc(100);
+    if (arena_of(small) != arena_of(second)) {
+        pr_error("Thread did not move on to the extent");
+        return EXIT_FAILURE;
+    }
+
+    free(small);
+    free(second);
+    free(first);
+
+    if (arena_main()->list->first_seg || arena_of(second)->list->first_seg) {
+        pr_error("Lists not empty");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
 // Whitebox-testing of expand-list function
 int main() {
     set_alloc_function(FIRST_FIT);
@@ -113,5 +263,25 @@ int main() {
         return EXIT_FAILURE;
     }
 
+    clear_alloc_storage();
+
+    if (expand_ahead_list()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (expand_foreign_break()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    // The thread keeps allocating from the extent afterwards, so this comes
+    // last
+    if (expand_exhausted_list()) {
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
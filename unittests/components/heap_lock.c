@@ -0,0 +1,113 @@
+#include "alloc/arena.h"
+#include "alloc/defines.h"
+#include "alloc/heap_lock.h"
+
+#include "unittests/defines.h"
+#include <pthread.h>
+#include <stdlib.h>
+
+#define NUM_THREADS 8
+#define NUM_ROUNDS 100000
+
+static heap_lock_s lock = HEAP_LOCK_INITIALIZER;
+static size_t counter = 0;
+
+// Acquisitions are counted, and a held lock cannot be taken again
+int count_test() {
+    heap_lock(&lock);
+    if (heap_trylock(&lock)) {
+        pr_error("Took a held lock");
+        return EXIT_FAILURE;
+    }
+    heap_unlock(&lock);
+
+    if (!heap_trylock(&lock)) {
+        pr_error("Could not take a free lock");
+        return EXIT_FAILURE;
+    }
+    heap_unlock(&lock);
+
+    heap_lock_stats_s stats = {};
+    heap_lock_stats(&lock, &stats);
+    if (stats.acquisitions != 2 || stats.contended != 0) {
+        pr_error("Expected 2 uncontended acquisitions, got %zu, %zu contended",
+                 stats.acquisitions, stats.contended);
+        return EXIT_FAILURE;
+    }
+
+    // The locks of the arenas count as well
+    heap_lock_stats_s before;
+    heap_lock_stats_s after;
+
+    get_lock_stats(&before);
+    free(malloc(100));
+    get_lock_stats(&after);
+
+    if (after.acquisitions < before.acquisitions + 2) {
+        pr_error("Arena locks not counted");
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+static void *increment_thread([[maybe_unused]] void *arg) {
+    for (size_t i = 0; i < NUM_ROUNDS; i++) {
+        heap_lock(&lock);
+        counter++;
+        heap_unlock(&lock);
+    }
+
+    return nullptr;
+}
+
+// Increments under the lock from several threads are never lost, and every
+// acquisition is counted once
+int exclusion_test() {
+    heap_lock_stats_s before = {};
+    heap_lock_stats(&lock, &before);
+
+    pthread_t threads[NUM_THREADS];
+
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        pthread_create(&threads[i], nullptr, &increment_thread, nullptr);
+    }
+    for (size_t i = 0; i < NUM_THREADS; i++) {
+        pthread_join(threads[i], nullptr);
+    }
+
+    if (counter != NUM_THREADS * NUM_ROUNDS) {
+        pr_error("Expected %d increments, got %zu", NUM_THREADS * NUM_ROUNDS,
+                 counter);
+        return EXIT_FAILURE;
+    }
+
+    heap_lock_stats_s after = {};
+    heap_lock_stats(&lock, &after);
+
+    if (after.acquisitions - before.acquisitions != counter ||
+        after.contended > after.acquisitions ||
+        (after.contended > before.contended && after.wait_ns == 0)) {
+        pr_error("Inconsistent counters");
+        return EXIT_FAILURE;
+    }
+
+    pr_info("%zu acquisitions, %zu contended, %llu ns waited",
+            after.acquisitions, after.contended,
+            (unsigned long long)after.wait_ns);
+
+    return EXIT_SUCCESS;
+}
+
+int main() {
+
+    if (count_test()) {
+        return EXIT_FAILURE;
+    }
+
+    if (exclusion_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,105 @@
+#include "alloc/adaptive.h"
+#include "alloc/defines.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/strats.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+#define NUM_CHUNKS 4096
+
+// Allocate one chunk and free it again, for ADAPTIVE_WINDOW many times. Such
+// windows are no allocation bursts
+void churn(size_t windows) {
+    for (size_t i = 0; i < windows * ADAPTIVE_WINDOW; i++) {
+        uint8_t *addr = malloc(1000);
+        ASSERT(is_aligned(addr));
+        free(addr);
+    }
+}
+
+// Go through the phases the controller is made for: An allocation burst, in
+// which next-fit is kept, then many freed chunks in the middle of the table,
+// which make the controller switch to best-fit, and once these gaps are filled
+// up again, back to next-fit
+int phase_test() {
+    set_alloc_function(ADAPTIVE);
+
+    static uint8_t *chunks[NUM_CHUNKS];
+
+    for (size_t i = 0; i < NUM_CHUNKS; i++) {
+        chunks[i] = malloc(256);
+        ASSERT(is_aligned(chunks[i]));
+    }
+
+    if (adaptive_strat() != NEXT_FIT || adaptive_switches()) {
+        pr_error("Allocation burst should have been served by next-fit");
+        return EXIT_FAILURE;
+    }
+
+    // Every other chunk is freed, which leaves half of the table in gaps
+    for (size_t i = 0; i < NUM_CHUNKS; i += 2) {
+        free(chunks[i]);
+        chunks[i] = nullptr;
+    }
+
+    churn(3);
+
+    if (adaptive_strat() != BEST_FIT || get_alloc_strat() != ADAPTIVE) {
+        pr_error("Expected best-fit, got %d", adaptive_strat());
+        return EXIT_FAILURE;
+    }
+
+    // The gaps fit the chunks exactly, so best-fit fills them up completely
+    for (size_t i = 0; i < NUM_CHUNKS; i += 2) {
+        chunks[i] = malloc(256);
+        ASSERT(is_aligned(chunks[i]));
+    }
+
+    churn(3);
+
+    if (adaptive_strat() != NEXT_FIT) {
+        pr_error("Expected next-fit, got %d", adaptive_strat());
+        return EXIT_FAILURE;
+    }
+
+    for (size_t i = 0; i < NUM_CHUNKS; i++) {
+        free(chunks[i]);
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// The controller measures the random allocations, reallocations and frees and
+// may switch strategies, rebuilding the gap index each time, while chunks stay
+// live across the switches
+int stress_test() {
+    set_alloc_function(ADAPTIVE);
+
+    uint8_t *chunks[256] = {};
+    stress_s stress = {.slots = 256,
+                       .rounds = 40000,
+                       .seed = 17,
+                       .max_size = 3000,
+                       .frees = 2};
+
+    return stress_run(&stress, chunks);
+}
+
+int main() {
+
+    if (phase_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -3,6 +3,7 @@
 #include "alloc/strats.h"
 
 #include "unittests/defines.h"
+#include "unittests/stress.h"
 #include <stdlib.h>
 
 bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
@@ -101,4 +102,33 @@ int inverse_grid_test() {
     return EXIT_SUCCESS;
 }
 
-int main() { return (inverse_grid_test()); }
\ No newline at end of file
+// Random frees and reallocations keep inserting, removing and resizing gaps in
+// the size-ordered tree, which has to stay balanced and sorted so that no gap
+// is handed out twice
+int stress_test() {
+    set_alloc_function(BEST_FIT);
+
+    uint8_t *chunks[256] = {};
+    stress_s stress = {.slots = 256,
+                       .rounds = 20000,
+                       .seed = 3,
+                       .max_size = 3000,
+                       .frees = 2};
+
+    return stress_run(&stress, chunks);
+}
+
+int main() {
+
+    if (inverse_grid_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
\ No newline at end of file
@@ -0,0 +1,143 @@
+#include "alloc/buddy.h"
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/strats.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+// Split a fresh pool into a few blocks and check that blocks are placed next to
+// their buddies, and merged with them again when freed
+// Like this:
+// a(16) b(16) c(32) [free 64] d(128) ...
+int split_merge_test() {
+    set_alloc_function(BUDDY);
+
+    // The first block of a fresh pool is its lowest block, all upper halves
+    // are put into the free lists
+    uint8_t *a = malloc(1);
+    uint8_t *b = malloc(16);
+    uint8_t *c = malloc(17);
+    uint8_t *d = malloc(128);
+    ASSERT(is_aligned(a) && is_aligned(b) && is_aligned(c) && is_aligned(d));
+
+    if (b != a + 16 || c != a + 32 || d != a + 128) {
+        pr_error("Unexpected placement %p %p %p %p", a, b, c, d);
+        return EXIT_FAILURE;
+    }
+
+    if (buddy_block_size(a) != 16 || buddy_block_size(c) != 32 ||
+        buddy_block_size(d) != 128) {
+        pr_error("Unexpected block sizes");
+        return EXIT_FAILURE;
+    }
+
+    // a and b are merged into a block of 32 bytes, but not any further since
+    // c is still allocated. Free blocks of 32 bytes are taken before the free
+    // block of 64 bytes is split
+    free(a);
+    free(b);
+
+    uint8_t *addr = malloc(32);
+    if (addr != a) {
+        pr_error("Expected %p, got %p", a, addr);
+        return EXIT_FAILURE;
+    }
+
+    // Now a + 64 is the only free block smaller than 128 bytes
+    if ((addr = malloc(64)) != a + 64) {
+        pr_error("Expected %p, got %p", a + 64, addr);
+        return EXIT_FAILURE;
+    }
+
+    // Requests larger than BUDDY_MAX_SIZE are chunks of the segment list
+    uint8_t *large = malloc(BUDDY_MAX_SIZE + 1);
+    if (buddy_owns(large) || get_segment_size(large) != BUDDY_MAX_SIZE + 1) {
+        pr_error("Large request not served by the segment list");
+        return EXIT_FAILURE;
+    }
+    free(large);
+
+    return EXIT_SUCCESS;
+}
+
+// Reallocate buddy blocks within the same and into different block sizes
+int realloc_test() {
+    set_alloc_function(BUDDY);
+
+    uint8_t *addr = malloc(100);
+    for (size_t k = 0; k < 100; k++) {
+        addr[k] = (uint8_t)k;
+    }
+
+    // 100 and 128 bytes both need a block of 128 bytes
+    if (realloc(addr, 128) != addr) {
+        pr_error("Block of the same size moved");
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *moved = realloc(addr, 1000);
+    if (buddy_block_size(moved) != 1024) {
+        pr_error("Expected a block of 1024 bytes");
+        return EXIT_FAILURE;
+    }
+
+    for (size_t k = 0; k < 100; k++) {
+        if (moved[k] != (uint8_t)k) {
+            pr_error("Content not copied");
+            return EXIT_FAILURE;
+        }
+    }
+
+    free(moved);
+
+    return EXIT_SUCCESS;
+}
+
+// Switches away from buddy and back
+static void switch_strat(size_t phase) {
+    set_alloc_function(phase % 2 ? FIRST_FIT : BUDDY);
+}
+
+// One chunk in seven is too large for the pools and goes to first-fit, so pools
+// are split, merged, added and given back while the table around them keeps
+// changing
+int stress_test() {
+    uint8_t *chunks[256] = {};
+    stress_s stress = {.slots = 256,
+                       .rounds = 20000,
+                       .seed = 11,
+                       .max_size = 2048,
+                       .large_every = 7,
+                       .large_size = 80000,
+                       .frees = 2,
+                       .phase_rounds = 5000,
+                       .phase = &switch_strat};
+
+    return stress_run(&stress, chunks);
+}
+
+int main() {
+
+    if (split_merge_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (realloc_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,115 @@
+#include "alloc/defines.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/strats.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+// Create four gaps of different sizes, separated by allocated memory of size 1
+// Like this:
+// 256 * 64 * 128 * 48 * [rest of the table]
+// where the number denotes the user size of the freed chunk and * denotes
+// allocated storage of size 1.
+// Searching from the beginning, all four gaps fit 48 bytes. Good-fit has to
+// take the smallest of as many of them as it is allowed to look at
+int candidate_test() {
+    set_alloc_function(FIRST_FIT);
+
+    uint8_t *a = malloc(256);
+    uint8_t *barrier1 = malloc(1);
+    uint8_t *b = malloc(64);
+    uint8_t *barrier2 = malloc(1);
+    uint8_t *c = malloc(128);
+    uint8_t *barrier3 = malloc(1);
+    uint8_t *d = malloc(48);
+    uint8_t *barrier4 = malloc(1);
+    ASSERT(is_aligned(a) && is_aligned(b) && is_aligned(c) && is_aligned(d));
+
+    free(a);
+    free(b);
+    free(c);
+    free(d);
+
+    set_alloc_function(GOOD_FIT);
+
+    size_t candidates[] = {1, 2, 3, 8};
+    uint8_t *expected[] = {a, b, b, d};
+
+    for (size_t i = 0; i < 4; i++) {
+        set_good_fit_candidates(candidates[i]);
+        set_last_addr(nullptr);
+
+        uint8_t *addr = malloc(48);
+        if (addr != expected[i]) {
+            pr_error("%zu candidates: expected %p, got %p", candidates[i],
+                     expected[i], addr);
+            return EXIT_FAILURE;
+        }
+        free(addr);
+    }
+
+    // Beginning at the last allocated chunk, the gaps in front of it are only
+    // looked at after the rest of the table
+    set_good_fit_candidates(2);
+    set_last_addr(nullptr);
+
+    uint8_t *addr = malloc(64);
+    if (addr != b) {
+        pr_error("Expected %p, got %p", b, addr);
+        return EXIT_FAILURE;
+    }
+
+    addr = malloc(48);
+    if (addr != d) {
+        pr_error("Expected %p, got %p", d, addr);
+        return EXIT_FAILURE;
+    }
+
+    set_good_fit_candidates(GOOD_FIT_CANDIDATES);
+
+    return EXIT_SUCCESS;
+}
+
+// Switches between different numbers of candidates, to next-fit, which shares
+// the gap array, and to best-fit, which doesn't
+static void switch_strat(size_t phase) {
+    sched_strat_e strats[] = {GOOD_FIT, NEXT_FIT, GOOD_FIT, BEST_FIT};
+    size_t candidates[] = {4, 4, 1, 1};
+
+    set_alloc_function(strats[phase % 4]);
+    set_good_fit_candidates(candidates[phase % 4]);
+}
+
+// Good-fit takes the smallest of the first fitting gaps from the gap array.
+// Switching the number of candidates and the strategy in between leaves gaps
+// behind that good-fit did not choose itself
+int stress_test() {
+    uint8_t *chunks[256] = {};
+    stress_s stress = {.slots = 256,
+                       .rounds = 20000,
+                       .seed = 9,
+                       .max_size = 3000,
+                       .frees = 2,
+                       .phase_rounds = 5000,
+                       .phase = &switch_strat};
+
+    return stress_run(&stress, chunks);
+}
+
+int main() {
+
+    if (candidate_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -1,8 +1,13 @@
+#include "alloc/arena.h"
+#include "alloc/chunk.h"
 #include "alloc/defines.h"
+#include "alloc/gap_array.h"
 #include "alloc/memory_mgmt.h"
 #include "alloc/strats.h"
 
 #include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <pthread.h>
 #include <stdlib.h>
 
 bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
@@ -223,6 +228,139 @@ int next_fit_after_last_first() {
     return EXIT_SUCCESS;
 }
 
+// The gaps are spread over several blocks of the gap array. A search starting
+// at the beginning skips the blocks without a large enough gap, and still
+// finds the first fitting one
+int blocks_test() {
+    static uint8_t *chunks[4 * GAP_BLOCK];
+    size_t n = 4 * GAP_BLOCK;
+
+    set_alloc_function(NEXT_FIT);
+
+    for (size_t i = 0; i < n; i++) {
+        chunks[i] = malloc(100);
+        ASSERT(chunks[i]);
+    }
+
+    for (size_t i = 0; i < n; i += 2) {
+        free(chunks[i]);
+    }
+
+    if (arena_main()->gaps.used < 2) {
+        pr_error("Expected the gaps spread over several blocks");
+        return EXIT_FAILURE;
+    }
+
+    // Merges the gaps of chunks n - 4 and n - 2 with the chunk between them
+    free(chunks[n - 3]);
+    set_last_addr(nullptr);
+
+    uint8_t *addr = malloc(250);
+    if (addr != chunks[n - 4]) {
+        pr_error("Expected %p, got %p", chunks[n - 4], addr);
+        return EXIT_FAILURE;
+    }
+
+    set_last_addr(nullptr);
+
+    uint8_t *first = malloc(100);
+    if (first != chunks[0]) {
+        pr_error("Expected %p, got %p", chunks[0], first);
+        return EXIT_FAILURE;
+    }
+
+    free(addr);
+    free(first);
+    for (size_t i = 1; i < n; i += 2) {
+        if (i != n - 3) {
+            free(chunks[i]);
+        }
+    }
+
+    if (arena_main()->gaps.used > 1) {
+        pr_error("Expected the blocks merged, %zu left",
+                 arena_main()->gaps.used);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Switches to best-fit and back, which rebuilds the gap array
+static void switch_strat(size_t phase) {
+    set_alloc_function(phase % 2 ? BEST_FIT : NEXT_FIT);
+}
+
+// Allocate, reallocate and free many small chunks of pseudo-random sizes. Most
+// chunks are reallocated rather than freed, which leaves thousands of gaps, so
+// the gap array has to grow. Check that no chunk overwrites another one
+int stress_test() {
+    static uint8_t *chunks[4096];
+    stress_s stress = {.slots = 4096,
+                       .rounds = 60000,
+                       .seed = 3,
+                       .max_size = 400,
+                       .frees = 1,
+                       .phase_rounds = 15000,
+                       .phase = &switch_strat};
+
+    return stress_run(&stress, chunks);
+}
+
+static uint8_t *thread_chunk;
+
+static void *cursor_thread([[maybe_unused]] void *arg) {
+    thread_chunk = malloc(100);
+    return nullptr;
+}
+
+// Each thread has a next-fit pointer of its own. A thread starting without one
+// takes the first gap, while the pointer of the main thread stays behind its
+// last chunk. Pointers of other threads follow their tail when it vanishes
+int thread_cursor_test() {
+    set_alloc_function(NEXT_FIT);
+
+    uint8_t *first = malloc(100);
+    uint8_t *second = malloc(100);
+    uint8_t *third = malloc(100);
+    ASSERT(is_aligned(first) && is_aligned(second) && is_aligned(third));
+
+    free(second);
+
+    pthread_t thread;
+    pthread_create(&thread, nullptr, &cursor_thread, nullptr);
+    pthread_join(thread, nullptr);
+
+    if (thread_chunk != second) {
+        pr_error("Expected %p for the new thread, got %p", second,
+                 thread_chunk);
+        return EXIT_FAILURE;
+    }
+
+    uint8_t *fourth = malloc(100);
+    if (fourth < third) {
+        pr_error("Main thread did not continue after its last chunk");
+        return EXIT_FAILURE;
+    }
+
+    seg_tail_s *tail =
+        head_next_tail((seg_head_s *)(thread_chunk - sizeof(seg_head_s)));
+    free(thread_chunk);
+
+    for (size_t i = 0; i < ARENA_CURSORS; i++) {
+        if (arena_main()->cursors[i].addr == tail) {
+            pr_error("Pointer %zu still points to a removed tail", i);
+            return EXIT_FAILURE;
+        }
+    }
+
+    free(first);
+    free(third);
+    free(fourth);
+
+    return EXIT_SUCCESS;
+}
+
 int main() {
 
     if (grid_test_simple()) {
@@ -249,9 +387,27 @@ int main() {
 
     clear_alloc_storage();
 
+    if (blocks_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
     if (grid_test_complex()) {
         return EXIT_FAILURE;
     }
 
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (thread_cursor_test()) {
+        return EXIT_FAILURE;
+    }
+
     return EXIT_SUCCESS;
 }
\ No newline at end of file
@@ -0,0 +1,101 @@
+#include "alloc/defines.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/strats.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+// Create three gaps of different size classes, separated by barriers of size 1
+// Like this:
+// 16 * 256 * 64 * [rest of the page]
+// where the number denotes the user size of the freed chunk and * denotes
+// allocated storage of size 1.
+// Each allocation has to land in the smallest non-empty size class it fits in,
+// and not in the first or the largest gap.
+int class_test() {
+    set_alloc_function(FIRST_FIT);
+
+    uint8_t *small = malloc(16);
+    uint8_t *barrier1 = malloc(1);
+    uint8_t *large = malloc(256);
+    uint8_t *barrier2 = malloc(1);
+    uint8_t *medium = malloc(64);
+    uint8_t *barrier3 = malloc(1);
+    ASSERT(is_aligned(small) && is_aligned(large) && is_aligned(medium));
+
+    free(small);
+    free(large);
+    free(medium);
+
+    // The lists are built from the existing gaps on switching
+    set_alloc_function(SEGREGATED_FIT);
+
+    // 200 bytes need a gap of 272 bytes. There is no such class, so the next
+    // larger non-empty class has to be taken, which is the gap of the 256 byte
+    // chunk
+    uint8_t *addr = malloc(200);
+    if (addr != large) {
+        pr_error("Expected %p, got %p", large, addr);
+        return EXIT_FAILURE;
+    }
+
+    if ((addr = malloc(64)) != medium) {
+        pr_error("Expected %p, got %p", medium, addr);
+        return EXIT_FAILURE;
+    }
+
+    if ((addr = malloc(16)) != small) {
+        pr_error("Expected %p, got %p", small, addr);
+        return EXIT_FAILURE;
+    }
+
+    // All gaps are used up, the rest of the 256 byte gap is too small for 48
+    // bytes, so the next chunk has to go behind the last barrier
+    addr = malloc(48);
+    if (addr <= barrier3) {
+        pr_error("Expected an address after %p, got %p", barrier3, addr);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Switches between segregated-fit and first-fit, so that the lists have to be
+// rebuilt from the existing gaps
+static void switch_strat(size_t phase) {
+    set_alloc_function(phase % 2 ? FIRST_FIT : SEGREGATED_FIT);
+}
+
+// Random frees and reallocations move gaps between the size-class lists all the
+// time. Every 2500 rounds the strategy changes, so the lists are rebuilt from
+// whatever gaps are left
+int stress_test() {
+    uint8_t *chunks[256] = {};
+    stress_s stress = {.slots = 256,
+                       .rounds = 20000,
+                       .seed = 42,
+                       .max_size = 3000,
+                       .frees = 2,
+                       .phase_rounds = 2500,
+                       .phase = &switch_strat};
+
+    return stress_run(&stress, chunks);
+}
+
+int main() {
+
+    if (class_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
@@ -0,0 +1,125 @@
+#include "alloc/defines.h"
+#include "alloc/linked_list_mgmt.h"
+#include "alloc/memory_mgmt.h"
+#include "alloc/strats.h"
+
+#include "unittests/defines.h"
+#include "unittests/stress.h"
+#include <stdlib.h>
+
+bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
+
+// Size of the head and tail of a chunk. The gap sizes of the grid below are
+// given including this overhead, so that they hit the same lists regardless of
+// the chunk format
+#define OVERHEAD (sizeof(struct seg_head_s) + sizeof(struct seg_tail_s))
+
+// Create a grid of gaps of different sizes, separated by allocated memory of
+// size 1, with the rest of the storage table filled up
+// Like this:
+// 16 * 496 * 1008 * 304 * [filler]
+// where the number denotes the user size of the freed chunk (with 64 bytes of
+// overhead per chunk) and * denotes allocated storage of size 1.
+// TLSF rounds each request up to the next list boundary, so an allocation only
+// lands in a gap of a list which guarantees a fit, even if a smaller gap would
+// have fit, too
+int grid_test() {
+    set_alloc_function(FIRST_FIT);
+
+    uint8_t *tiny = malloc(16);
+    uint8_t *barrier1 = malloc(1);
+    uint8_t *small = malloc(560 - OVERHEAD);
+    uint8_t *barrier2 = malloc(1);
+    uint8_t *large = malloc(1072 - OVERHEAD);
+    uint8_t *barrier3 = malloc(1);
+    uint8_t *medium = malloc(368 - OVERHEAD);
+    uint8_t *barrier4 = malloc(1);
+    ASSERT(is_aligned(tiny) && is_aligned(small) && is_aligned(large) &&
+           is_aligned(medium));
+
+    // Fill up the rest of the storage table, so that the only gaps left are
+    // the ones of the grid
+    size_t rest = get_following_gap_size(barrier4);
+    if (rest >= MIN_GAP_SIZE) {
+        uint8_t *filler = malloc(rest - (sizeof(struct seg_head_s) +
+                                         sizeof(struct seg_tail_s)));
+        ASSERT(filler == barrier4 + ALIGNMENT + sizeof(struct seg_tail_s) +
+                             sizeof(struct seg_head_s));
+    }
+
+    free(tiny);
+    free(small);
+    free(large);
+    free(medium);
+
+    set_alloc_function(TLSF_FIT);
+
+    // 490 bytes need a gap of 560 bytes, which is not a list boundary. The gap
+    // of the 496 byte chunk has exactly 560 bytes, but its list also holds gaps
+    // up to 575 bytes, so the 1008 byte gap has to be used
+    uint8_t *addr = malloc(554 - OVERHEAD);
+    if (addr != large) {
+        pr_error("Expected %p, got %p", large, addr);
+        return EXIT_FAILURE;
+    }
+
+    // 304 bytes need a gap of 368 bytes, which is a list boundary, so the gap
+    // of exactly that size is used
+    if ((addr = malloc(368 - OVERHEAD)) != medium) {
+        pr_error("Expected %p, got %p", medium, addr);
+        return EXIT_FAILURE;
+    }
+
+    // No list at or above the rounded size holds a gap anymore, so the first
+    // gap of the own list is checked
+    if ((addr = malloc(554 - OVERHEAD)) != small) {
+        pr_error("Expected %p, got %p", small, addr);
+        return EXIT_FAILURE;
+    }
+
+    if ((addr = malloc(1)) != tiny) {
+        pr_error("Expected %p, got %p", tiny, addr);
+        return EXIT_FAILURE;
+    }
+
+    // The only gap left is the rest of the 1008 byte gap
+    uint8_t *rest_gap = large + round_up(554 - OVERHEAD, ALIGNMENT) +
+                        sizeof(struct seg_tail_s) + sizeof(struct seg_head_s);
+    if ((addr = malloc(1)) != rest_gap) {
+        pr_error("Expected %p, got %p", rest_gap, addr);
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
+
+// Sizes of up to 5000 bytes spread the gaps over many first- and second-level
+// lists, and every free and reallocation splits or merges gaps across them,
+// which has to keep both bitmaps in sync with the lists
+int stress_test() {
+    set_alloc_function(TLSF_FIT);
+
+    uint8_t *chunks[256] = {};
+    stress_s stress = {.slots = 256,
+                       .rounds = 20000,
+                       .seed = 7,
+                       .max_size = 5000,
+                       .frees = 2};
+
+    return stress_run(&stress, chunks);
+}
+
+int main() {
+
+    if (grid_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
+}
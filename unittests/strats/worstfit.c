@@ -3,6 +3,7 @@
 #include "alloc/strats.h"
 
 #include "unittests/defines.h"
+#include "unittests/stress.h"
 #include <stdlib.h>
 
 bool is_aligned(void *ptr) { return (uintptr_t)ptr % ALIGNMENT == 0; }
@@ -106,7 +107,42 @@ int grid_test() {
     return EXIT_SUCCESS;
 }
 
+// Switches between worst-fit and first-fit, which share the address-ordered
+// gap tree, and next-fit, which doesn't
+static void switch_strat(size_t phase) {
+    sched_strat_e strats[] = {WORST_FIT, FIRST_FIT, NEXT_FIT, WORST_FIT};
+
+    set_alloc_function(strats[phase % 4]);
+}
+
+// Worst-fit splits the largest gap, so the largest size kept in the nodes of
+// the tree changes on almost every round. First-fit and next-fit run in between
+// on the same chunks
+int stress_test() {
+    uint8_t *chunks[256] = {};
+    stress_s stress = {.slots = 256,
+                       .rounds = 20000,
+                       .seed = 5,
+                       .max_size = 3000,
+                       .frees = 2,
+                       .phase_rounds = 5000,
+                       .phase = &switch_strat};
+
+    return stress_run(&stress, chunks);
+}
+
 int main() {
     set_alloc_function(WORST_FIT);
-    return (grid_test());
+
+    if (grid_test()) {
+        return EXIT_FAILURE;
+    }
+
+    clear_alloc_storage();
+
+    if (stress_test()) {
+        return EXIT_FAILURE;
+    }
+
+    return EXIT_SUCCESS;
 }
\ No newline at end of file
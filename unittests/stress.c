@@ -0,0 +1,78 @@
+#include "unittests/stress.h"
+#include "alloc/defines.h"
+
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+void stress_fill(uint8_t *chunk, size_t size, size_t tag) {
+    for (size_t k = 0; k < size; k++) {
+        chunk[k] = (uint8_t)(tag + k);
+    }
+}
+
+bool stress_intact(const uint8_t *chunk, size_t size, size_t tag) {
+    for (size_t k = 0; k < size; k++) {
+        if (chunk[k] != (uint8_t)(tag + k)) {
+            return false;
+        }
+    }
+    return true;
+}
+
+static size_t draw_size(const stress_s *stress, uint32_t seed) {
+    bool large = stress->large_every && seed % stress->large_every == 0;
+
+    return 1 + (seed >> 4) % (large ? stress->large_size : stress->max_size);
+}
+
+int stress_run(const stress_s *stress, uint8_t **chunks) {
+    // Sizes of the chunks, as far as their content is known. A reallocation
+    // only keeps the smaller part intact
+    size_t sizes[STRESS_MAX_SLOTS] = {};
+    uint32_t seed = stress->seed;
+
+    ASSERT(stress->slots <= STRESS_MAX_SLOTS);
+
+    for (size_t round = 0; round < stress->rounds; round++) {
+        if (stress->phase && stress->phase_rounds &&
+            round % stress->phase_rounds == 0) {
+            stress->phase(round / stress->phase_rounds);
+        }
+
+        seed = seed * 1103515245 + 12345;
+        size_t i = (seed >> 8) % stress->slots;
+
+        if (chunks[i]) {
+            // Check the content before giving the chunk back
+            if (!stress_intact(chunks[i], sizes[i], i)) {
+                pr_error("Chunk %zu got overwritten", i);
+                return EXIT_FAILURE;
+            }
+
+            if (seed % 3 >= 3 - stress->frees) {
+                free(chunks[i]);
+                chunks[i] = nullptr;
+                continue;
+            }
+
+            size_t new_size = draw_size(stress, seed);
+            chunks[i] = realloc(chunks[i], new_size);
+            if (new_size < sizes[i]) {
+                sizes[i] = new_size;
+            }
+        } else {
+            sizes[i] = draw_size(stress, seed);
+            chunks[i] = malloc(sizes[i]);
+        }
+
+        if (!chunks[i] || (uintptr_t)chunks[i] % ALIGNMENT) {
+            pr_error("Invalid alloc");
+            return EXIT_FAILURE;
+        }
+
+        stress_fill(chunks[i], sizes[i], i);
+    }
+
+    return EXIT_SUCCESS;
+}
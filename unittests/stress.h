@@ -0,0 +1,67 @@
+/**
+ * @file
+ * @brief Shared loop of random allocations, reallocations and frees for the
+ * stress tests
+ */
+#ifndef UNITTESTS_STRESS_H
+#define UNITTESTS_STRESS_H
+
+#include <stddef.h>
+#include <stdint.h>
+
+//! Largest number of chunks a stress run keeps alive at once
+#define STRESS_MAX_SLOTS 4096
+
+// A run of pseudo-random allocations, reallocations and frees. Each round
+// picks a slot. An empty slot gets a new chunk, the chunk of a full slot is
+// checked and then freed or reallocated. Every chunk is filled with a pattern
+// derived from its slot, so a chunk overwriting another one is noticed
+typedef struct stress_s {
+    size_t slots;       /**< Number of slots, at most STRESS_MAX_SLOTS */
+    size_t rounds;      /**< Number of rounds */
+    uint32_t seed;      /**< Seed of the pseudo-random sequence */
+    size_t max_size;    /**< Largest size of a chunk */
+    size_t large_every; /**< Every this many chunks on average are drawn up to
+                           large_size instead, 0 for never */
+    size_t large_size;  /**< Largest size of the occasional large chunk */
+    size_t frees;       /**< Out of three rounds on a full slot, the number
+                           freeing the chunk instead of reallocating it */
+    size_t phase_rounds;         /**< Rounds per phase, 0 for a single one */
+    void (*phase)(size_t phase); /**< Called at the start of each phase with
+                                    its index, for example to switch the
+                                    strategy. May be nullptr */
+} stress_s;
+
+/**
+ * @brief Run a stress test
+ *
+ * @param[in] stress Parameters of the run
+ * @param[in,out] chunks Array of stress->slots chunks, nullptr for empty
+ * slots. The chunks left over are not freed
+ *
+ * @return EXIT_SUCCESS, or EXIT_FAILURE if an allocation failed or a chunk got
+ * overwritten
+ */
+int stress_run(const stress_s *stress, uint8_t **chunks);
+
+/**
+ * @brief Fill a chunk with the pattern of a tag
+ *
+ * @param[out] chunk Chunk to fill
+ * @param[in] size Size of the chunk
+ * @param[in] tag Any number identifying the chunk
+ */
+void stress_fill(uint8_t *chunk, size_t size, size_t tag);
+
+/**
+ * @brief Check that a chunk still holds the pattern of its tag
+ *
+ * @param[in] chunk Chunk filled with stress_fill()
+ * @param[in] size Number of bytes to check
+ * @param[in] tag Tag the chunk was filled with
+ *
+ * @return true if the chunk is intact
+ */
+bool stress_intact(const uint8_t *chunk, size_t size, size_t tag);
+
+#endif